@@ -0,0 +1,43 @@
+#!/bin/bash
+#
+# Compares the throughput of "cat FILE | wc -l" through tsh for pipe
+# sizes set with shopt pipesize.
+#
+#   bench/pipesize.sh [MEGABYTES] [RUNS] [SIZES...]
+#
+# Run it from the shell directory after make. Sizes above
+# /proc/sys/fs/pipe-max-size are cut down to it by the shell.
+
+TSH=${TSH:-./tsh}
+MB=${1:-512}
+RUNS=${2:-5}
+shift 2 2>/dev/null
+SIZES=${*:-off 256K 1M}
+
+if [ ! -x "$TSH" ]; then
+  echo "pipesize.sh: $TSH not found, run make first" >&2
+  exit 1
+fi
+
+FILE=$(mktemp /tmp/pipesize.XXXXXX)
+trap 'rm -f "$FILE"' EXIT
+
+# lines of 64 bytes, in the page cache after the first read
+yes "$(printf '%063d' 0)" | head -c $((MB * 1024 * 1024)) > "$FILE"
+cat "$FILE" > /dev/null
+
+echo "file: $MB MB, pipe-max-size: $(cat /proc/sys/fs/pipe-max-size), best of $RUNS"
+printf '%-10s %10s %10s\n' size seconds MB/s
+for size in $SIZES; do
+  best=
+  for ((run = 0; run < RUNS; run++)); do
+    start=$(date +%s%N)
+    printf 'shopt pipesize=%s\ncat %s | wc -l\n' "$size" "$FILE" | "$TSH" > /dev/null
+    ns=$(($(date +%s%N) - start))
+    if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+      best=$ns
+    fi
+  done
+  awk -v size="$size" -v ns="$best" -v mb="$MB" \
+    'BEGIN { printf "%-10s %10.3f %10.1f\n", size, ns / 1e9, mb / (ns / 1e9) }'
+done
@@ -0,0 +1,53 @@
+#!/bin/bash
+#
+# Compares launching /bin/true through the zygote and by forking the
+# shell, with the shell holding a variable of the given size so there is
+# something for fork to copy.
+#
+#   bench/zygote.sh [MEGABYTES] [LAUNCHES] [RUNS]
+#
+# Run it from the shell directory after make. The time to fill the
+# variable is measured on its own and taken off.
+
+TSH=${TSH:-./tsh}
+MB=${1:-256}
+LAUNCHES=${2:-500}
+RUNS=${3:-3}
+
+if [ ! -x "$TSH" ]; then
+  echo "zygote.sh: $TSH not found, run make first" >&2
+  exit 1
+fi
+
+SCRIPT=$(mktemp /tmp/zygote.XXXXXX)
+trap 'rm -f "$SCRIPT"' EXIT
+
+# best of RUNS in nanoseconds for shopt zygote=$1, with $2 launches
+best() {
+  local best= ns run
+  {
+    echo "shopt zygote=$1"
+    echo "X=\$(head -c $((MB * 1024 * 1024)) /dev/zero | tr '\\0' a)"
+    for ((run = 0; run < $2; run++)); do
+      echo /bin/true
+    done
+  } > "$SCRIPT"
+  for ((run = 0; run < RUNS; run++)); do
+    start=$(date +%s%N)
+    "$TSH" < "$SCRIPT" > /dev/null
+    ns=$(($(date +%s%N) - start))
+    if [ -z "$best" ] || [ "$ns" -lt "$best" ]; then
+      best=$ns
+    fi
+  done
+  echo "$best"
+}
+
+echo "shell holding $MB MB, $LAUNCHES launches, best of $RUNS"
+printf '%-8s %12s\n' zygote us/launch
+for mode in on off; do
+  base=$(best "$mode" 0)
+  total=$(best "$mode" "$LAUNCHES")
+  awk -v mode="$mode" -v ns=$((total - base)) -v n="$LAUNCHES" \
+    'BEGIN { printf "%-8s %12.1f\n", mode, ns / n / 1000 }'
+done
@@ -0,0 +1,811 @@
+/***************************************************************************
+ *  Title: Builtin utilities
+ * -------------------------------------------------------------------------
+ *    Purpose: In-process versions of echo, printf, test, [, true, false
+ *    and pwd, so scripts do not fork for trivial commands, and a tee
+ *    that moves data with tee(2) and splice(2) instead of copying it.
+ *    They follow the coreutils behavior.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: builtin.c
+ ***************************************************************************/
+#define __BUILTIN_IMPL__
+#define _GNU_SOURCE
+
+/************System include***********************************************/
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "builtin.h"
+#include "runtime.h"
+#include "interpreter.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* state of the test expression parser */
+typedef struct test_s {
+  char** argv;
+  int pos;
+  int end;
+  int error;
+} testT;
+
+/* size of the buffer tee copies through when splicing is not possible */
+#define TEE_BUFSIZE 65536
+
+/* an output of tee */
+typedef struct tee_out_s {
+  int fd;
+  char* name;
+  /* the output does not take splice, data is copied to it */
+  bool copy;
+} teeOutT;
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+static int BuiltInEcho(commandT*);
+static int BuiltInPrintf(commandT*);
+static int BuiltInTest(commandT*);
+static int BuiltInPwd(commandT*);
+static int BuiltInTee(commandT*);
+/* fans a pipe out with tee(2) and splice(2) */
+static bool TeeSplice(teeOutT*, int, char*);
+/* fans any input out with read and write */
+static bool TeeCopy(teeOutT*, int, char*);
+/* moves an exact number of bytes from a pipe to an output */
+static bool TeeMove(int, teeOutT*, ssize_t, char*);
+static bool WriteAll(int, char*, ssize_t);
+/* prints the escape sequence starting at a backslash */
+static char* PrintEscape(char*, bool, bool*);
+/* prints a string with its escape sequences */
+static bool PrintEscaped(char*, bool);
+/* converts a printf argument to a number */
+static bool PrintfNumber(char*, long long*, double*, bool);
+/* the test expression grammar */
+static bool TestOr(testT*);
+static bool TestAnd(testT*);
+static bool TestNot(testT*);
+static bool TestPrimary(testT*);
+static bool TestUnary(testT*, char*, char*);
+static bool TestBinary(testT*, char*, char*, char*);
+static bool IsTestBinary(char*);
+static bool IsTestUnary(char*);
+static bool TestInteger(testT*, char*, long long*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+bool IsUtilityBuiltIn(char* cmd)
+{
+  return strcmp(cmd, "echo") == 0
+      || strcmp(cmd, "printf") == 0
+      || strcmp(cmd, "test") == 0
+      || strcmp(cmd, "[") == 0
+      || strcmp(cmd, "true") == 0
+      || strcmp(cmd, "false") == 0
+      || strcmp(cmd, "pwd") == 0;
+}
+
+int RunUtilityBuiltIn(commandT* cmd)
+{
+  int status = 0;
+
+  if(strcmp(cmd->argv[0], "echo") == 0)
+    status = BuiltInEcho(cmd);
+  else if(strcmp(cmd->argv[0], "printf") == 0)
+    status = BuiltInPrintf(cmd);
+  else if(strcmp(cmd->argv[0], "test") == 0 || strcmp(cmd->argv[0], "[") == 0)
+    status = BuiltInTest(cmd);
+  else if(strcmp(cmd->argv[0], "false") == 0)
+    status = 1;
+  else if(strcmp(cmd->argv[0], "pwd") == 0)
+    status = BuiltInPwd(cmd);
+
+  fflush(stdout);
+  return status;
+}
+
+bool IsFilterBuiltIn(char* cmd)
+{
+  return strcmp(cmd, "tee") == 0;
+}
+
+int RunFilterBuiltIn(commandT* cmd)
+{
+  return BuiltInTee(cmd);
+}
+
+static int BuiltInEcho(commandT* cmd)
+{
+  int i = 1, j;
+  bool newline = TRUE, escapes = FALSE, stop = FALSE;
+
+  //options are only taken if the whole word is made of n, e and E
+  for(; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1] != '\0'; i++)
+  {
+    for(j = 1; cmd->argv[i][j] != '\0'; j++)
+      if(strchr("neE", cmd->argv[i][j]) == NULL) break;
+    if(cmd->argv[i][j] != '\0') break;
+    for(j = 1; cmd->argv[i][j] != '\0'; j++)
+    {
+      if(cmd->argv[i][j] == 'n') newline = FALSE;
+      else if(cmd->argv[i][j] == 'e') escapes = TRUE;
+      else escapes = FALSE;
+    }
+  }
+
+  for(; i < cmd->argc && !stop; i++)
+  {
+    if(escapes)
+      stop = PrintEscaped(cmd->argv[i], TRUE);
+    else
+      fputs(cmd->argv[i], stdout);
+    if(i + 1 < cmd->argc && !stop) putchar(' ');
+  }
+  if(newline && !stop) putchar('\n');
+  return 0;
+}
+
+static int BuiltInPrintf(commandT* cmd)
+{
+  char *fmt, *p, *arg;
+  char spec[64];
+  int argi = 2, n, status = 0, star;
+  bool stop = FALSE, consumed;
+  long long num;
+  double dbl;
+
+  if(cmd->argc < 2)
+  {
+    fprintf(stderr, "printf: missing operand\n");
+    return 1;
+  }
+  fmt = cmd->argv[1];
+
+  //the format is reused as long as it consumes arguments
+  do
+  {
+    consumed = FALSE;
+    for(p = fmt; *p != '\0' && !stop; p++)
+    {
+      if(*p == '\\')
+      {
+        p = PrintEscape(p, FALSE, &stop);
+        continue;
+      }
+      if(*p != '%')
+      {
+        putchar(*p);
+        continue;
+      }
+      if(p[1] == '%')
+      {
+        putchar('%');
+        p++;
+        continue;
+      }
+
+      //copy the conversion specification, with '*' filled in
+      n = 0;
+      spec[n++] = *p++;
+      while(*p != '\0' && strchr("-+ #0", *p) != NULL && n < 20)
+        spec[n++] = *p++;
+      for(star = 0; star < 2; star++)
+      {
+        if(*p == '*')
+        {
+          arg = argi < cmd->argc ? cmd->argv[argi++] : "0";
+          consumed = TRUE;
+          if(!PrintfNumber(arg, &num, NULL, FALSE)) status = 1;
+          n += snprintf(spec + n, sizeof(spec) - n - 8, "%d", (int) num);
+          p++;
+        }
+        else
+        {
+          while(isdigit((unsigned char) *p) && n < 40)
+            spec[n++] = *p++;
+        }
+        if(star == 0 && *p == '.')
+          spec[n++] = *p++;
+        else
+          break;
+      }
+
+      arg = argi < cmd->argc ? cmd->argv[argi++] : NULL;
+      if(arg != NULL) consumed = TRUE;
+      switch(*p)
+      {
+        case 'd': case 'i':
+          if(!PrintfNumber(arg, &num, NULL, FALSE)) status = 1;
+          strcpy(spec + n, "lld");
+          printf(spec, num);
+          break;
+        case 'u': case 'o': case 'x': case 'X':
+          if(!PrintfNumber(arg, &num, NULL, FALSE)) status = 1;
+          spec[n] = 'l';
+          spec[n + 1] = 'l';
+          spec[n + 2] = *p;
+          spec[n + 3] = '\0';
+          printf(spec, (unsigned long long) num);
+          break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+          if(!PrintfNumber(arg, NULL, &dbl, TRUE)) status = 1;
+          spec[n] = *p;
+          spec[n + 1] = '\0';
+          printf(spec, dbl);
+          break;
+        case 'c':
+          //like coreutils, an empty or missing argument is a NUL
+          spec[n] = 'c';
+          spec[n + 1] = '\0';
+          printf(spec, arg != NULL ? *arg : '\0');
+          break;
+        case 's':
+          spec[n] = 's';
+          spec[n + 1] = '\0';
+          printf(spec, arg != NULL ? arg : "");
+          break;
+        case 'b':
+          if(arg != NULL) stop = PrintEscaped(arg, TRUE);
+          break;
+        default:
+          fflush(stdout);
+          fprintf(stderr, "printf: %%%c: invalid conversion specification\n", *p);
+          return 1;
+      }
+    }
+  } while(argi < cmd->argc && consumed && !stop);
+
+  return status;
+}
+
+static int BuiltInPwd(commandT* cmd)
+{
+  char* cwd = getCurrentWorkingDir();
+
+  if(cwd == NULL)
+  {
+    fprintf(stderr, "pwd: %s\n", strerror(errno));
+    return 1;
+  }
+  puts(cwd);
+  free(cwd);
+  return 0;
+}
+
+static int BuiltInTee(commandT* cmd)
+{
+  teeOutT* outs = malloc(sizeof(teeOutT) * cmd->argc);
+  char* buf = malloc(TEE_BUFSIZE);
+  int i, nouts = 0, status = 0, mode = O_TRUNC;
+  struct stat st;
+
+  for(i = 1; i < cmd->argc && cmd->argv[i][0] == '-' && cmd->argv[i][1] != '\0'; i++)
+  {
+    if(strcmp(cmd->argv[i], "--") == 0)
+    {
+      i++;
+      break;
+    }
+    if(strcmp(cmd->argv[i], "-a") == 0)
+      mode = O_APPEND;
+    else if(strcmp(cmd->argv[i], "-i") == 0)
+      signal(SIGINT, SIG_IGN);
+    else
+    {
+      fprintf(stderr, "tee: invalid option '%s'\n", cmd->argv[i]);
+      free(outs);
+      free(buf);
+      return 1;
+    }
+  }
+
+  outs[nouts].fd = STDOUT_FILENO;
+  outs[nouts].name = "standard output";
+  outs[nouts++].copy = FALSE;
+  for(; i < cmd->argc; i++)
+  {
+    outs[nouts].fd = open(cmd->argv[i], O_WRONLY | O_CREAT | mode, 0666);
+    if(outs[nouts].fd < 0)
+    {
+      fprintf(stderr, "tee: %s: %s\n", cmd->argv[i], strerror(errno));
+      status = 1;
+      continue;
+    }
+    outs[nouts].name = cmd->argv[i];
+    outs[nouts++].copy = FALSE;
+  }
+
+  //only a pipe can be teed, anything else is read
+  if(fstat(STDIN_FILENO, &st) == 0 && S_ISFIFO(st.st_mode))
+  {
+    if(!TeeSplice(outs, nouts, buf)) status = 1;
+  }
+  else if(!TeeCopy(outs, nouts, buf))
+  {
+    status = 1;
+  }
+
+  for(i = 1; i < nouts; i++)
+    close(outs[i].fd);
+  free(outs);
+  free(buf);
+  return status;
+}
+
+/*Each round duplicates what the input pipe holds into a scratch pipe with
+ *tee(2), without consuming it, and splices the duplicate to one output; the
+ *last output gets the data itself. tee(2) always starts at the front of the
+ *pipe, so every output sees the same bytes, and a round only ends when the
+ *slowest output has taken them.*/
+static bool TeeSplice(teeOutT* outs, int nouts, char* buf)
+{
+  int scratch[2], i;
+  ssize_t n, m;
+  bool ok = TRUE;
+
+  if(nouts == 1)
+  {
+    //a lone output just gets the data moved over
+    while((n = splice(STDIN_FILENO, NULL, outs[0].fd, NULL, TEE_BUFSIZE, SPLICE_F_MOVE)) != 0)
+    {
+      if(n < 0 && errno == EINVAL)
+        return TeeCopy(outs, nouts, buf);
+      if(n < 0 && errno != EINTR)
+      {
+        fprintf(stderr, "tee: %s: %s\n", outs[0].name, strerror(errno));
+        return FALSE;
+      }
+    }
+    return TRUE;
+  }
+
+  if(pipe(scratch) < 0)
+    return TeeCopy(outs, nouts, buf);
+  //as large as the input so a round takes all it holds
+  fcntl(scratch[1], F_SETPIPE_SZ, fcntl(STDIN_FILENO, F_GETPIPE_SZ));
+
+  while(ok)
+  {
+    //the first duplicate decides how much this round moves
+    n = tee(STDIN_FILENO, scratch[1], INT_MAX, 0);
+    if(n < 0 && errno == EINTR) continue;
+    if(n == 0) break;
+    if(n < 0)
+    {
+      fprintf(stderr, "tee: %s\n", strerror(errno));
+      ok = FALSE;
+      break;
+    }
+    for(i = 0; ok && i < nouts - 1; i++)
+    {
+      //the scratch pipe is empty again, so it takes the same bytes again
+      if(i > 0 && (m = tee(STDIN_FILENO, scratch[1], n, 0)) != n)
+      {
+        fprintf(stderr, "tee: %s: %s\n", outs[i].name,
+                m < 0 ? strerror(errno) : "input pipe changed while being copied");
+        ok = FALSE;
+      }
+      else
+        ok = TeeMove(scratch[0], &outs[i], n, buf);
+    }
+    if(ok) ok = TeeMove(STDIN_FILENO, &outs[nouts - 1], n, buf);
+  }
+  close(scratch[0]);
+  close(scratch[1]);
+  return ok;
+}
+
+static bool TeeCopy(teeOutT* outs, int nouts, char* buf)
+{
+  ssize_t n;
+  int i;
+
+  while((n = read(STDIN_FILENO, buf, TEE_BUFSIZE)) != 0)
+  {
+    if(n < 0)
+    {
+      if(errno == EINTR) continue;
+      fprintf(stderr, "tee: %s\n", strerror(errno));
+      return FALSE;
+    }
+    for(i = 0; i < nouts; i++)
+    {
+      if(!WriteAll(outs[i].fd, buf, n))
+      {
+        fprintf(stderr, "tee: %s: %s\n", outs[i].name, strerror(errno));
+        return FALSE;
+      }
+    }
+  }
+  return TRUE;
+}
+
+/*Blocks until the output has taken all of it, falling back to copying for
+ *outputs splice does not support, like terminals and append-only files.
+ *Failures are reported against the output's name.*/
+static bool TeeMove(int from, teeOutT* out, ssize_t len, char* buf)
+{
+  ssize_t n;
+
+  while(len > 0)
+  {
+    if(!out->copy)
+    {
+      n = splice(from, NULL, out->fd, NULL, len, SPLICE_F_MOVE);
+      if(n < 0 && errno == EINVAL)
+      {
+        out->copy = TRUE;
+        continue;
+      }
+    }
+    else
+    {
+      n = read(from, buf, len < TEE_BUFSIZE ? len : TEE_BUFSIZE);
+      if(n > 0 && !WriteAll(out->fd, buf, n))
+      {
+        fprintf(stderr, "tee: %s: %s\n", out->name, strerror(errno));
+        return FALSE;
+      }
+    }
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0)
+    {
+      fprintf(stderr, "tee: %s: %s\n", out->name, strerror(errno));
+      return FALSE;
+    }
+    //the bytes were already counted in the pipe, so an end here is a bug
+    if(n == 0)
+    {
+      fprintf(stderr, "tee: %s: input ended early\n", out->name);
+      return FALSE;
+    }
+    len -= n;
+  }
+  return TRUE;
+}
+
+static bool WriteAll(int fd, char* buf, ssize_t len)
+{
+  ssize_t n;
+
+  while(len > 0)
+  {
+    n = write(fd, buf, len);
+    if(n < 0 && errno == EINTR) continue;
+    //a write that takes nothing leaves errno as it was
+    if(n == 0) errno = EIO;
+    if(n <= 0) return FALSE;
+    buf += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+static int BuiltInTest(commandT* cmd)
+{
+  testT t;
+  bool result;
+
+  t.argv = cmd->argv;
+  t.pos = 1;
+  t.end = cmd->argc;
+  t.error = 0;
+
+  if(strcmp(cmd->argv[0], "[") == 0)
+  {
+    if(cmd->argc < 2 || strcmp(cmd->argv[cmd->argc - 1], "]") != 0)
+    {
+      fprintf(stderr, "[: missing ']'\n");
+      return 2;
+    }
+    t.end--;
+  }
+  //no expression is false
+  if(t.pos == t.end) return 1;
+
+  result = TestOr(&t);
+  if(!t.error && t.pos != t.end)
+  {
+    fprintf(stderr, "%s: %s: unexpected argument\n", cmd->argv[0], t.argv[t.pos]);
+    t.error = 1;
+  }
+  if(t.error) return 2;
+  return result ? 0 : 1;
+}
+
+static bool TestOr(testT* t)
+{
+  bool result = TestAnd(t);
+
+  while(!t->error && t->pos < t->end && strcmp(t->argv[t->pos], "-o") == 0)
+  {
+    t->pos++;
+    result = TestAnd(t) || result;
+  }
+  return result;
+}
+
+static bool TestAnd(testT* t)
+{
+  bool result = TestNot(t);
+
+  while(!t->error && t->pos < t->end && strcmp(t->argv[t->pos], "-a") == 0)
+  {
+    t->pos++;
+    result = TestNot(t) && result;
+  }
+  return result;
+}
+
+static bool TestNot(testT* t)
+{
+  //a lone '!' is just a string
+  if(t->pos + 1 < t->end && strcmp(t->argv[t->pos], "!") == 0)
+  {
+    t->pos++;
+    return !TestNot(t);
+  }
+  return TestPrimary(t);
+}
+
+static bool TestPrimary(testT* t)
+{
+  char** argv = t->argv;
+  int pos = t->pos;
+  bool result;
+
+  if(pos >= t->end)
+  {
+    fprintf(stderr, "%s: argument expected\n", argv[0]);
+    t->error = 1;
+    return FALSE;
+  }
+  //a binary operator wins over everything else, so [ -f = -f ] compares strings
+  if(pos + 2 < t->end && IsTestBinary(argv[pos + 1]))
+  {
+    t->pos += 3;
+    return TestBinary(t, argv[pos], argv[pos + 1], argv[pos + 2]);
+  }
+  if(strcmp(argv[pos], "(") == 0 && pos + 1 < t->end)
+  {
+    t->pos++;
+    result = TestOr(t);
+    if(t->pos >= t->end || strcmp(argv[t->pos], ")") != 0)
+    {
+      if(!t->error) fprintf(stderr, "%s: missing ')'\n", argv[0]);
+      t->error = 1;
+      return FALSE;
+    }
+    t->pos++;
+    return result;
+  }
+  if(IsTestUnary(argv[pos]) && pos + 1 < t->end)
+  {
+    t->pos += 2;
+    return TestUnary(t, argv[pos], argv[pos + 1]);
+  }
+  //a single string is true unless it is empty
+  t->pos++;
+  return argv[pos][0] != '\0';
+}
+
+static bool IsTestBinary(char* op)
+{
+  static char* ops[] = { "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le",
+                         "-gt", "-ge", "-nt", "-ot", "-ef", NULL };
+  int i;
+
+  for(i = 0; ops[i] != NULL; i++)
+    if(strcmp(op, ops[i]) == 0) return TRUE;
+  return FALSE;
+}
+
+static bool IsTestUnary(char* op)
+{
+  return op[0] == '-' && op[1] != '\0' && op[2] == '\0'
+      && strchr("bcdefghLknprsStuvwxOGz", op[1]) != NULL;
+}
+
+static bool TestUnary(testT* t, char* op, char* arg)
+{
+  struct stat fs;
+  long long fd;
+
+  switch(op[1])
+  {
+    case 'n':
+      return arg[0] != '\0';
+    case 'z':
+      return arg[0] == '\0';
+    case 'v':
+      return GetVar(arg) != NULL;
+    case 't':
+      return TestInteger(t, arg, &fd) && isatty((int) fd);
+    case 'h': case 'L':
+      return lstat(arg, &fs) == 0 && S_ISLNK(fs.st_mode);
+    case 'r':
+      return access(arg, R_OK) == 0;
+    case 'w':
+      return access(arg, W_OK) == 0;
+    case 'x':
+      return access(arg, X_OK) == 0;
+  }
+  if(stat(arg, &fs) != 0) return FALSE;
+  switch(op[1])
+  {
+    case 'b': return S_ISBLK(fs.st_mode);
+    case 'c': return S_ISCHR(fs.st_mode);
+    case 'd': return S_ISDIR(fs.st_mode);
+    case 'f': return S_ISREG(fs.st_mode);
+    case 'p': return S_ISFIFO(fs.st_mode);
+    case 'S': return S_ISSOCK(fs.st_mode);
+    case 's': return fs.st_size > 0;
+    case 'g': return (fs.st_mode & S_ISGID) != 0;
+    case 'u': return (fs.st_mode & S_ISUID) != 0;
+    case 'k': return (fs.st_mode & S_ISVTX) != 0;
+    case 'O': return fs.st_uid == geteuid();
+    case 'G': return fs.st_gid == getegid();
+  }
+  return TRUE;
+}
+
+static bool TestBinary(testT* t, char* left, char* op, char* right)
+{
+  long long a, b;
+  struct stat fa, fb;
+  bool hasa, hasb;
+
+  if(strcmp(op, "=") == 0 || strcmp(op, "==") == 0) return strcmp(left, right) == 0;
+  if(strcmp(op, "!=") == 0) return strcmp(left, right) != 0;
+  if(strcmp(op, "<") == 0) return strcmp(left, right) < 0;
+  if(strcmp(op, ">") == 0) return strcmp(left, right) > 0;
+
+  if(op[1] == 'n' || op[1] == 'o' || strcmp(op, "-ef") == 0)
+  {
+    hasa = stat(left, &fa) == 0;
+    hasb = stat(right, &fb) == 0;
+    if(strcmp(op, "-ef") == 0)
+      return hasa && hasb && fa.st_dev == fb.st_dev && fa.st_ino == fb.st_ino;
+    if(strcmp(op, "-nt") == 0)
+      return hasa && (!hasb || fa.st_mtime > fb.st_mtime);
+    if(strcmp(op, "-ot") == 0)
+      return hasb && (!hasa || fa.st_mtime < fb.st_mtime);
+    if(strcmp(op, "-ne") != 0)
+      return FALSE;
+  }
+
+  if(!TestInteger(t, left, &a) || !TestInteger(t, right, &b)) return FALSE;
+  if(strcmp(op, "-eq") == 0) return a == b;
+  if(strcmp(op, "-ne") == 0) return a != b;
+  if(strcmp(op, "-lt") == 0) return a < b;
+  if(strcmp(op, "-le") == 0) return a <= b;
+  if(strcmp(op, "-gt") == 0) return a > b;
+  return a >= b;
+}
+
+static bool TestInteger(testT* t, char* arg, long long* value)
+{
+  char* end;
+
+  errno = 0;
+  *value = strtoll(arg, &end, 10);
+  while(isspace((unsigned char) *end)) end++;
+  if(end == arg || *end != '\0' || errno != 0)
+  {
+    fprintf(stderr, "%s: %s: integer expression expected\n", t->argv[0], arg);
+    t->error = 1;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/*Print a string with its escape sequences, returns true if \c was hit*/
+static bool PrintEscaped(char* s, bool zeroOctal)
+{
+  bool stop = FALSE;
+
+  for(; *s != '\0' && !stop; s++)
+  {
+    if(*s == '\\')
+      s = PrintEscape(s, zeroOctal, &stop);
+    else
+      putchar(*s);
+  }
+  return stop;
+}
+
+/*Print the escape at p, which points at the backslash. echo and %b take
+ *octal as \0nnn, the printf format as \nnn. Returns the last character used.*/
+static char* PrintEscape(char* p, bool zeroOctal, bool* stop)
+{
+  int n, value = 0;
+
+  switch(*++p)
+  {
+    case 'a': putchar('\a'); break;
+    case 'b': putchar('\b'); break;
+    case 'e': putchar('\033'); break;
+    case 'f': putchar('\f'); break;
+    case 'n': putchar('\n'); break;
+    case 'r': putchar('\r'); break;
+    case 't': putchar('\t'); break;
+    case 'v': putchar('\v'); break;
+    case '\\': putchar('\\'); break;
+    case 'c': *stop = TRUE; break;
+    case 'x':
+      for(n = 0; n < 2 && isxdigit((unsigned char) p[1]); n++)
+      {
+        p++;
+        value = value * 16 + (isdigit((unsigned char) *p) ? *p - '0' : tolower((unsigned char) *p) - 'a' + 10);
+      }
+      if(n == 0)
+        fputs("\\x", stdout);
+      else
+        putchar(value);
+      break;
+    case '\0':
+      putchar('\\');
+      p--;
+      break;
+    default:
+      if(*p >= '0' && *p <= '7' && (!zeroOctal || *p == '0'))
+      {
+        if(zeroOctal) p++;
+        else value = *p++ - '0';
+        for(n = zeroOctal ? 0 : 1; n < 3 && *p >= '0' && *p <= '7'; n++)
+          value = value * 8 + (*p++ - '0');
+        p--;
+        putchar(value);
+      }
+      else
+      {
+        putchar('\\');
+        putchar(*p);
+      }
+  }
+  return p;
+}
+
+/*Convert a printf argument, 'c and "c give the character code*/
+static bool PrintfNumber(char* arg, long long* num, double* dbl, bool isfloat)
+{
+  char* end;
+
+  if(num != NULL) *num = 0;
+  if(dbl != NULL) *dbl = 0;
+  if(arg == NULL || *arg == '\0') return TRUE;
+  if(arg[0] == '\'' || arg[0] == '"')
+  {
+    if(num != NULL) *num = (unsigned char) arg[1];
+    if(dbl != NULL) *dbl = (unsigned char) arg[1];
+    return TRUE;
+  }
+  errno = 0;
+  if(isfloat)
+    *dbl = strtod(arg, &end);
+  else
+    *num = strtoll(arg, &end, 0);
+  if(end == arg || *end != '\0' || errno != 0)
+  {
+    fflush(stdout);
+    fprintf(stderr, "printf: %s: expected a numeric value\n", arg);
+    return FALSE;
+  }
+  return TRUE;
+}
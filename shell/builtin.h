@@ -0,0 +1,86 @@
+/***************************************************************************
+ *  Title: Builtin utilities
+ * -------------------------------------------------------------------------
+ *    Purpose: In-process versions of common utilities
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: builtin.h
+ ***************************************************************************/
+
+#ifndef __BUILTIN_H__
+#define __BUILTIN_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+
+/************Private include**********************************************/
+#include "runtime.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __BUILTIN_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Checks whether a command is a builtin utility
+ * ---------------------------------------------------------------------
+ *    Purpose: Checks whether a command is one of the utilities that
+ *    run inside the shell (echo, printf, test, [, true, false, pwd).
+ *    They never read standard input and never touch the job list, so
+ *    they can run in-process as a pipeline stage.
+ *    Input: the command name
+ *    Output: true if it is a builtin utility
+ ***********************************************************************/
+EXTERN bool IsUtilityBuiltIn(char*);
+
+/***********************************************************************
+ *  Title: Runs a builtin utility
+ * ---------------------------------------------------------------------
+ *    Purpose: Runs a builtin utility, writing to standard output and
+ *    standard error. The caller sets up the file descriptors.
+ *    Input: a command structure
+ *    Output: the exit status
+ ***********************************************************************/
+EXTERN int RunUtilityBuiltIn(commandT*);
+
+/***********************************************************************
+ *  Title: Checks whether a command is a builtin filter
+ * ---------------------------------------------------------------------
+ *    Purpose: Checks whether a command is a builtin that reads standard
+ *    input (tee). It runs in a child of its own like a program, it
+ *    only saves the exec.
+ *    Input: the command name
+ *    Output: true if it is a builtin filter
+ ***********************************************************************/
+EXTERN bool IsFilterBuiltIn(char*);
+
+/***********************************************************************
+ *  Title: Runs a builtin filter
+ * ---------------------------------------------------------------------
+ *    Purpose: Runs a builtin filter in the current process, which is
+ *    expected to be a child of the shell.
+ *    Input: a command structure
+ *    Output: the exit status
+ ***********************************************************************/
+EXTERN int RunFilterBuiltIn(commandT*);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __BUILTIN_H__ */
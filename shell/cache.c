@@ -0,0 +1,462 @@
+/***************************************************************************
+ *  Title: Command cache
+ * -------------------------------------------------------------------------
+ *    Purpose: Stores the stdout, stderr and exit status of commands run
+ *    through the cache builtin under a hash of everything the user says
+ *    they depend on, and replays them when the hash comes up again.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: cache.c
+ ***************************************************************************/
+#define __CACHE_IMPL__
+#define _GNU_SOURCE
+
+/************System include***********************************************/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "cache.h"
+#include "io.h"
+#include "stats.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* starts every entry, a change of the format changes it */
+#define CACHE_MAGIC "tshcach1"
+
+/* an entry is named after its key in hex */
+#define CACHE_NAMELEN 32
+
+/* what replaying copies at a time */
+#define CACHE_CHUNK 65536
+
+/* the head of an entry, followed by the stdout and the stderr */
+typedef struct cache_entry_s {
+  char magic[8];
+  uint64_t outLen;
+  uint64_t errLen;
+  int status;
+} cacheEntryT;
+
+/* an entry looked at for eviction */
+typedef struct cache_file_s {
+  struct timespec used;
+  off_t size;
+  char name[CACHE_NAMELEN + 1];
+} cacheFileT;
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+/* the directory of the store, created if asked */
+static bool CacheDir(char*, size_t, bool);
+/* hashes the key of a cache call into a file name */
+static void CacheKey(commandT*, char**, int, char**, int, bool, char*);
+/* adds bytes to the two lanes of a key */
+static void HashBytes(uint64_t*, const void*, size_t);
+/* adds what an input is, or what it holds, to a key */
+static void HashInput(uint64_t*, char*, bool);
+/* writes a stored entry out, false if it is not a valid one */
+static bool ReplayEntry(int, int*);
+/* runs the command with its output captured, stores and replays it */
+static int RunCached(commandT*, int, char*);
+/* writes an entry and makes room for it */
+static void StoreEntry(char*, char*, int, int, off_t, int, off_t);
+/* removes the least recently used entries above shopt cachesize */
+static void EvictEntries(char*);
+static int CompareUsed(const void*, const void*);
+/* copies len bytes from an offset of one fd to another */
+static bool CopyFd(int, off_t, off_t, int);
+/* removes every entry */
+static int ClearCache();
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+int RunCache(commandT* cmd)
+{
+  char **envs, **inputs;
+  char dir[PATH_MAX], path[PATH_MAX + CACHE_NAMELEN + 2], name[CACHE_NAMELEN + 1];
+  int nenvs = 0, ninputs = 0, i, fd, status;
+  //0 before any option, 1 after --env, 2 after --inputs
+  int list = 0;
+  bool content = FALSE;
+
+  if(cmd->argc == 2 && strcmp(cmd->argv[1], "--clear") == 0)
+    return ClearCache();
+  envs = malloc(sizeof(char*) * cmd->argc);
+  inputs = malloc(sizeof(char*) * cmd->argc);
+  for(i = 1; i < cmd->argc && strcmp(cmd->argv[i], "--") != 0; i++)
+  {
+    if(strcmp(cmd->argv[i], "--content") == 0)
+      content = TRUE;
+    else if(strcmp(cmd->argv[i], "--env") == 0)
+      list = 1;
+    else if(strcmp(cmd->argv[i], "--inputs") == 0)
+      list = 2;
+    else if(list == 0 || strncmp(cmd->argv[i], "--", 2) == 0)
+      break;
+    else if(list == 1)
+      envs[nenvs++] = cmd->argv[i];
+    else
+      inputs[ninputs++] = cmd->argv[i];
+  }
+  if(i + 1 >= cmd->argc || strcmp(cmd->argv[i], "--") != 0)
+  {
+    fprintf(stderr, "cache: usage: cache [--content] [--env NAME...] [--inputs FILE...] -- command [args]\n"
+                    "       cache --clear\n");
+    free(envs);
+    free(inputs);
+    return 2;
+  }
+
+  CacheKey(cmd, envs, nenvs, inputs, ninputs, content, name);
+  free(envs);
+  free(inputs);
+  if(CacheDir(dir, sizeof(dir), FALSE))
+  {
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) >= 0)
+    {
+      if(ReplayEntry(fd, &status))
+      {
+        close(fd);
+        stats.cacheHits++;
+        return status;
+      }
+      close(fd);
+    }
+  }
+  stats.cacheMisses++;
+  return RunCached(cmd, i + 1, name);
+}
+
+/*$TSH_CACHE_DIR, else $XDG_CACHE_HOME/tsh, else ~/.cache/tsh*/
+static bool CacheDir(char* dir, size_t size, bool create)
+{
+  char* p;
+
+  if((p = getenv("TSH_CACHE_DIR")) != NULL && *p != '\0')
+    snprintf(dir, size, "%s", p);
+  else if((p = getenv("XDG_CACHE_HOME")) != NULL && *p != '\0')
+    snprintf(dir, size, "%s/tsh", p);
+  else if((p = getenv("HOME")) != NULL && *p != '\0')
+    snprintf(dir, size, "%s/.cache/tsh", p);
+  else
+    return FALSE;
+  if(!create)
+    return TRUE;
+  //like mkdir -p
+  for(p = dir + 1; *p != '\0'; p++)
+  {
+    if(*p != '/')
+      continue;
+    *p = '\0';
+    mkdir(dir, 0755);
+    *p = '/';
+  }
+  return mkdir(dir, 0755) == 0 || errno == EEXIST;
+}
+
+/*The key covers the directory, since relative paths depend on it, and
+ *separates every part with a NUL so "a b" and "ab" differ. An unset
+ *variable differs from an empty one.*/
+static void CacheKey(commandT* cmd, char** envs, int nenvs, char** inputs, int ninputs, bool content, char* name)
+{
+  uint64_t h[2] = { 0xcbf29ce484222325ULL, 0x9e3779b97f4a7c15ULL };
+  char cwd[PATH_MAX];
+  char* value;
+  int i;
+
+  HashBytes(h, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+  if(getcwd(cwd, sizeof(cwd)) != NULL)
+    HashBytes(h, cwd, strlen(cwd) + 1);
+  for(i = 0; i < cmd->argc && strcmp(cmd->argv[i], "--") != 0; i++)
+    ;
+  for(i++; i < cmd->argc; i++)
+    HashBytes(h, cmd->argv[i], strlen(cmd->argv[i]) + 1);
+  for(i = 0; i < nenvs; i++)
+  {
+    HashBytes(h, envs[i], strlen(envs[i]) + 1);
+    if((value = getenv(envs[i])) != NULL)
+      HashBytes(h, value, strlen(value) + 1);
+    else
+      HashBytes(h, "\001", 1);
+  }
+  for(i = 0; i < ninputs; i++)
+    HashInput(h, inputs[i], content);
+  snprintf(name, CACHE_NAMELEN + 1, "%016llx%016llx", (unsigned long long) h[0], (unsigned long long) h[1]);
+}
+
+/*Two independent 64 bit lanes, FNV-1a and a multiply-add one, for a 128
+ *bit name*/
+static void HashBytes(uint64_t* h, const void* data, size_t len)
+{
+  const unsigned char* p = data;
+  size_t i;
+
+  for(i = 0; i < len; i++)
+  {
+    h[0] = (h[0] ^ p[i]) * 0x100000001b3ULL;
+    h[1] = (h[1] + p[i] + 1) * 0xff51afd7ed558ccdULL;
+    h[1] ^= h[1] >> 29;
+  }
+}
+
+static void HashInput(uint64_t* h, char* path, bool content)
+{
+  static char buf[CACHE_CHUNK];
+  struct stat st;
+  ssize_t n;
+  int fd;
+
+  HashBytes(h, path, strlen(path) + 1);
+  if(!content)
+  {
+    //a missing input is part of the key as well
+    if(stat(path, &st) < 0)
+      HashBytes(h, "\001", 1);
+    else
+    {
+      HashBytes(h, &st.st_dev, sizeof(st.st_dev));
+      HashBytes(h, &st.st_ino, sizeof(st.st_ino));
+      HashBytes(h, &st.st_size, sizeof(st.st_size));
+      HashBytes(h, &st.st_mtim.tv_sec, sizeof(st.st_mtim.tv_sec));
+      HashBytes(h, &st.st_mtim.tv_nsec, sizeof(st.st_mtim.tv_nsec));
+    }
+    return;
+  }
+  if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+  {
+    HashBytes(h, "\001", 1);
+    return;
+  }
+  while((n = read(fd, buf, sizeof(buf))) > 0)
+    HashBytes(h, buf, n);
+  close(fd);
+}
+
+static bool ReplayEntry(int fd, int* status)
+{
+  cacheEntryT entry;
+  struct stat st;
+
+  if(fstat(fd, &st) < 0 || read(fd, &entry, sizeof(entry)) != sizeof(entry)
+     || memcmp(entry.magic, CACHE_MAGIC, sizeof(entry.magic)) != 0
+     || (uint64_t) st.st_size != sizeof(entry) + entry.outLen + entry.errLen)
+    return FALSE;
+  //the mtime is when it was last used
+  futimens(fd, NULL);
+  fflush(stdout);
+  fflush(stderr);
+  CopyFd(fd, sizeof(entry), entry.outLen, STDOUT_FILENO);
+  CopyFd(fd, sizeof(entry) + entry.outLen, entry.errLen, STDERR_FILENO);
+  *status = entry.status;
+  return TRUE;
+}
+
+/*The command writes into memfds put in place of stdout and stderr, so it
+ *goes through RunCmd like any other, builtins and limit prefixes included.
+ *What it wrote comes out once it has ended.*/
+static int RunCached(commandT* cmd, int first, char* name)
+{
+  commandT* run;
+  char dir[PATH_MAX];
+  int mem[2], saved[2], status, i;
+  off_t len[2];
+  size_t linelen = 0;
+
+  mem[0] = memfd_create("cache-stdout", MFD_CLOEXEC);
+  mem[1] = memfd_create("cache-stderr", MFD_CLOEXEC);
+  if(mem[0] < 0 || mem[1] < 0)
+  {
+    PrintPError("cache: memfd_create");
+    if(mem[0] >= 0)
+      close(mem[0]);
+    return 1;
+  }
+
+  //the command after --, with the fds of its substitutions
+  run = CreateCmdT(cmd->argc - first);
+  for(i = first; i < cmd->argc; i++)
+  {
+    run->argv[i - first] = strdup(cmd->argv[i]);
+    linelen += strlen(cmd->argv[i]) + 1;
+  }
+  run->cmdline = malloc(linelen + 1);
+  run->cmdline[0] = '\0';
+  for(i = first; i < cmd->argc; i++)
+  {
+    if(i > first)
+      strcat(run->cmdline, " ");
+    strcat(run->cmdline, cmd->argv[i]);
+  }
+  run->substFds = cmd->substFds;
+  run->nsubstFds = cmd->nsubstFds;
+  cmd->substFds = NULL;
+  cmd->nsubstFds = 0;
+
+  fflush(stdout);
+  fflush(stderr);
+  for(i = 0; i < 2; i++)
+  {
+    saved[i] = fcntl(STDOUT_FILENO + i, F_DUPFD_CLOEXEC, 10);
+    dup2(mem[i], STDOUT_FILENO + i);
+  }
+  RunCmd(&run, 1);
+  status = lastStatus;
+  fflush(stdout);
+  fflush(stderr);
+  for(i = 0; i < 2; i++)
+  {
+    dup2(saved[i], STDOUT_FILENO + i);
+    close(saved[i]);
+    len[i] = lseek(mem[i], 0, SEEK_END);
+  }
+
+  //126 and up are failures to start it, signals and stops
+  if(status < 126 && cacheSize > 0 && sizeof(cacheEntryT) + len[0] + len[1] <= (uint64_t) cacheSize << 20
+     && CacheDir(dir, sizeof(dir), TRUE))
+    StoreEntry(dir, name, status, mem[0], len[0], mem[1], len[1]);
+  CopyFd(mem[0], 0, len[0], STDOUT_FILENO);
+  CopyFd(mem[1], 0, len[1], STDERR_FILENO);
+  close(mem[0]);
+  close(mem[1]);
+  return status;
+}
+
+/*Written under a temporary name and renamed, so a reader never sees half
+ *of an entry*/
+static void StoreEntry(char* dir, char* name, int status, int out, off_t outLen, int err, off_t errLen)
+{
+  char tmp[PATH_MAX + 32], path[PATH_MAX + CACHE_NAMELEN + 2];
+  cacheEntryT entry;
+  int fd;
+  bool ok;
+
+  memset(&entry, 0, sizeof(entry));
+  memcpy(entry.magic, CACHE_MAGIC, sizeof(entry.magic));
+  entry.outLen = outLen;
+  entry.errLen = errLen;
+  entry.status = status;
+  snprintf(tmp, sizeof(tmp), "%s/.tmp%d", dir, (int) getpid());
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  if((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+    return;
+  ok = write(fd, &entry, sizeof(entry)) == sizeof(entry)
+       && CopyFd(out, 0, outLen, fd) && CopyFd(err, 0, errLen, fd);
+  close(fd);
+  if(!ok || rename(tmp, path) < 0)
+  {
+    unlink(tmp);
+    return;
+  }
+  EvictEntries(dir);
+}
+
+static void EvictEntries(char* dir)
+{
+  cacheFileT* files = NULL;
+  struct dirent* ent;
+  struct stat st;
+  long long total = 0, limit = (long long) cacheSize << 20;
+  int n = 0, cap = 0, i, dfd;
+  DIR* d;
+
+  if((d = opendir(dir)) == NULL)
+    return;
+  dfd = dirfd(d);
+  while((ent = readdir(d)) != NULL)
+  {
+    if(strlen(ent->d_name) != CACHE_NAMELEN || fstatat(dfd, ent->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0
+       || !S_ISREG(st.st_mode))
+      continue;
+    if(n == cap)
+    {
+      cap = cap > 0 ? 2 * cap : 64;
+      files = realloc(files, sizeof(cacheFileT) * cap);
+    }
+    files[n].used = st.st_mtim;
+    files[n].size = st.st_size;
+    memcpy(files[n].name, ent->d_name, sizeof(files[n].name));
+    total += st.st_size;
+    n++;
+  }
+  if(total > limit)
+  {
+    qsort(files, n, sizeof(cacheFileT), CompareUsed);
+    for(i = 0; i < n && total > limit; i++)
+    {
+      if(unlinkat(dfd, files[i].name, 0) == 0)
+        total -= files[i].size;
+    }
+  }
+  closedir(d);
+  free(files);
+}
+
+/*Least recently used first*/
+static int CompareUsed(const void* a, const void* b)
+{
+  const struct timespec* x = &((const cacheFileT*) a)->used;
+  const struct timespec* y = &((const cacheFileT*) b)->used;
+
+  if(x->tv_sec != y->tv_sec)
+    return x->tv_sec < y->tv_sec ? -1 : 1;
+  return x->tv_nsec < y->tv_nsec ? -1 : x->tv_nsec > y->tv_nsec;
+}
+
+static bool CopyFd(int from, off_t offset, off_t len, int to)
+{
+  static char buf[CACHE_CHUNK];
+  ssize_t n, done, w;
+
+  while(len > 0)
+  {
+    n = pread(from, buf, len < sizeof(buf) ? len : sizeof(buf), offset);
+    if(n <= 0)
+      return FALSE;
+    for(done = 0; done < n; done += w)
+    {
+      if((w = write(to, buf + done, n - done)) <= 0)
+        return FALSE;
+    }
+    offset += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+static int ClearCache()
+{
+  char dir[PATH_MAX];
+  struct dirent* ent;
+  int dfd;
+  DIR* d;
+
+  if(!CacheDir(dir, sizeof(dir), FALSE) || (d = opendir(dir)) == NULL)
+    return 0;
+  dfd = dirfd(d);
+  while((ent = readdir(d)) != NULL)
+  {
+    if(strlen(ent->d_name) == CACHE_NAMELEN || strncmp(ent->d_name, ".tmp", 4) == 0)
+      unlinkat(dfd, ent->d_name, 0);
+  }
+  closedir(d);
+  return 0;
+}
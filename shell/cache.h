@@ -0,0 +1,63 @@
+/***************************************************************************
+ *  Title: Command cache
+ * -------------------------------------------------------------------------
+ *    Purpose: Remembers what deterministic commands printed, so running
+ *    one again over the same inputs replays it instead of forking
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: cache.h
+ ***************************************************************************/
+
+#ifndef __CACHE_H__
+#define __CACHE_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+
+/************Private include**********************************************/
+#include "runtime.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __CACHE_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Runs the cache builtin
+ * ---------------------------------------------------------------------
+ *    Purpose: cache [--content] [--env NAME...] [--inputs FILE...] --
+ *    command [args] looks the command up by its argv, the directory,
+ *    the named environment variables and the size, mtime and inode of
+ *    the inputs (their contents with --content). A hit writes the
+ *    stored stdout and stderr and returns the stored status without
+ *    running anything. A miss runs the command with its output
+ *    captured, replays it and stores it if the status is below 126.
+ *    Entries live in $TSH_CACHE_DIR, else $XDG_CACHE_HOME/tsh, else
+ *    ~/.cache/tsh, one file per key, and the least recently used go
+ *    when they add up to more than shopt cachesize MB (0 stores
+ *    nothing). cache --clear removes them all.
+ *    Input: a command structure
+ *    Output: the exit status
+ ***********************************************************************/
+EXTERN int RunCache(commandT*);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __CACHE_H__ */
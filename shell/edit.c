@@ -0,0 +1,660 @@
+/***************************************************************************
+ *  Title: Line editor
+ * -------------------------------------------------------------------------
+ *    Purpose: Reads command lines from a terminal with emacs keys, a kill
+ *    buffer and history. A long line scrolls sideways in one row. It
+ *    remembers what the row shows and where the cursor is, so a key
+ *    costs only the escape sequences that take the screen from there to
+ *    the new row, all in one write.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: edit.c
+ ***************************************************************************/
+#define __EDIT_IMPL__
+
+/************System include***********************************************/
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "edit.h"
+#include "event.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* lines kept in the history */
+#define EDIT_HISTORY 1000
+/* bytes read from the terminal at once */
+#define EDIT_READ 4096
+/* the longest escape sequence that is recognized */
+#define EDIT_SEQ 16
+
+#define CONTROL(c) ((c) & 0x1f)
+
+/* keys that are no single byte */
+enum {
+  KEY_DELETE = 256,
+  KEY_WORD_LEFT,
+  KEY_WORD_RIGHT,
+  KEY_KILL_WORD,
+  KEY_RUBOUT_WORD
+};
+
+/* a run of bytes that grows as needed */
+typedef struct text_s {
+  char* s;
+  size_t len;
+  size_t cap;
+} textT;
+
+/* the escape sequences of the keys, after the escape */
+static const struct {
+  const char* seq;
+  int key;
+} escapes[] = {
+  { "[A",    CONTROL('P')       },
+  { "OA",    CONTROL('P')       },
+  { "[B",    CONTROL('N')       },
+  { "OB",    CONTROL('N')       },
+  { "[C",    CONTROL('F')       },
+  { "OC",    CONTROL('F')       },
+  { "[D",    CONTROL('B')       },
+  { "OD",    CONTROL('B')       },
+  { "[H",    CONTROL('A')       },
+  { "OH",    CONTROL('A')       },
+  { "[1~",   CONTROL('A')       },
+  { "[7~",   CONTROL('A')       },
+  { "[F",    CONTROL('E')       },
+  { "OF",    CONTROL('E')       },
+  { "[4~",   CONTROL('E')       },
+  { "[8~",   CONTROL('E')       },
+  { "[3~",   KEY_DELETE      },
+  { "[1;5C", KEY_WORD_RIGHT  },
+  { "[1;3C", KEY_WORD_RIGHT  },
+  { "f",     KEY_WORD_RIGHT  },
+  { "[1;5D", KEY_WORD_LEFT   },
+  { "[1;3D", KEY_WORD_LEFT   },
+  { "b",     KEY_WORD_LEFT   },
+  { "d",     KEY_KILL_WORD   },
+  { "\x7f",  KEY_RUBOUT_WORD },
+  { "\b",    KEY_RUBOUT_WORD },
+};
+
+/************Global Variables*********************************************/
+
+/* the line and the byte the cursor is on */
+static textT line;
+static size_t pos;
+/* the first byte of the line in the row, the row it should show and
+ * what the screen shows with the column of the terminal cursor */
+static size_t offset;
+static textT view;
+static textT shown;
+static size_t cursor;
+static size_t width = 80;
+/* what goes to the terminal in the next write */
+static textT out;
+/* bytes typed after the enter that ended the last line */
+static textT pending;
+/* the escape sequence being read */
+static char seq[EDIT_SEQ];
+static int seqLen = 0;
+
+static textT killed;
+/* the key before killed, so the next kill adds to the buffer */
+static bool killing = FALSE;
+static bool killNow = FALSE;
+
+static char** history = NULL;
+static int historyLen = 0;
+/* the line shown from the history, historyLen for the new line */
+static int historyPos = 0;
+/* the new line while the history is looked at */
+static textT scratch;
+
+static bool editing = FALSE;
+static bool accepted, ended;
+static struct termios saved;
+
+/************Function Prototypes******************************************/
+/* replaces bytes of a text */
+static void Splice(textT*, size_t, size_t, const char*, size_t);
+/* adds to the end of a text */
+static void Put(textT*, const char*, size_t);
+/* counts the columns of n bytes */
+static size_t Cols(const char*, size_t);
+/* moves the terminal cursor to a column of the row */
+static void MoveTo(size_t);
+/* writes part of the line where the terminal cursor is */
+static void Emit(const char*, size_t);
+/* moves to the start of a fresh row below the line */
+static void NewLine();
+/* moves the window over the line to keep the cursor in it */
+static void Scroll();
+/* lays out the row for the window */
+static void BuildView();
+/* brings the screen up to date with the line */
+static void Redraw();
+/* writes what was collected */
+static void Flush();
+/* handles one byte from the terminal */
+static void Key(unsigned char);
+/* handles one byte of an escape sequence, true when a key is complete */
+static bool Escape(unsigned char);
+/* does what a key does */
+static void Do(int);
+/* moves the line between from and to into the kill buffer */
+static void Kill(size_t, size_t);
+/* shows an older (-1) or newer (1) line of the history */
+static void Recall(int);
+/* remembers an accepted line */
+static void AddHistory(const char*);
+static size_t PrevChar(size_t);
+static size_t NextChar(size_t);
+static size_t PrevWord(size_t, bool);
+static size_t NextWord(size_t, bool);
+static bool IsWord(unsigned char, bool);
+static size_t TermWidth();
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+bool UseEditor()
+{
+  char* term = getenv("TERM");
+
+  return isatty(STDIN_FILENO) && isatty(STDOUT_FILENO) &&
+    term != NULL && strcmp(term, "dumb") != 0;
+}
+
+bool EditLine(char** buf)
+{
+  struct termios raw;
+  char in[EDIT_READ];
+  ssize_t n, i;
+
+  tcgetattr(STDIN_FILENO, &saved);
+  raw = saved;
+  //keys come one by one and unchanged, ctrl+c and ctrl+z included
+  raw.c_iflag &= ~(BRKINT | ICRNL | INLCR | IGNCR | ISTRIP | IXON);
+  raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+
+  line.len = pos = offset = 0;
+  shown.len = cursor = 0;
+  width = TermWidth();
+  historyPos = historyLen;
+  killing = FALSE;
+  accepted = ended = FALSE;
+  editing = TRUE;
+
+  while(!accepted && !ended)
+  {
+    if(pending.len > 0)
+    {
+      n = pending.len < sizeof(in) ? pending.len : sizeof(in);
+      memcpy(in, pending.s, n);
+      Splice(&pending, 0, n, "", 0);
+    }
+    else
+    {
+      //everything that came in together is answered at once
+      Redraw();
+      Flush();
+      //sleep until there is input, reporting jobs that end meanwhile
+      if(!WaitEvents(TRUE, -1))
+        continue;
+      n = read(STDIN_FILENO, in, sizeof(in));
+      if(n < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      if(n <= 0)
+      {
+        ended = TRUE;
+        break;
+      }
+    }
+    for(i = 0; i < n && !accepted && !ended; i++)
+      Key(in[i]);
+    //what was typed after the line is for the next one
+    if(i < n)
+      Splice(&pending, 0, 0, in + i, n - i);
+  }
+
+  Redraw();
+  MoveTo(Cols(shown.s, shown.len));
+  NewLine();
+  Flush();
+  editing = FALSE;
+  tcsetattr(STDIN_FILENO, TCSADRAIN, &saved);
+
+  if(!accepted)
+    return FALSE;
+  *buf = realloc(*buf, line.len + 1);
+  memcpy(*buf, line.s, line.len);
+  (*buf)[line.len] = '\0';
+  AddHistory(*buf);
+  return TRUE;
+}
+
+void HideEditLine()
+{
+  if(!editing)
+    return;
+  MoveTo(0);
+  Put(&out, "\x1b[K", 3);
+  shown.len = 0;
+  Flush();
+}
+
+static void Splice(textT* t, size_t at, size_t cut, const char* s, size_t n)
+{
+  if(t->len - cut + n > t->cap)
+  {
+    t->cap = (t->len - cut + n) * 2 + 64;
+    t->s = realloc(t->s, t->cap);
+  }
+  memmove(t->s + at + n, t->s + at + cut, t->len - at - cut);
+  memcpy(t->s + at, s, n);
+  t->len = t->len - cut + n;
+}
+
+static void Put(textT* t, const char* s, size_t n)
+{
+  Splice(t, t->len, 0, s, n);
+}
+
+/*A column per character, UTF-8 continuation bytes take none*/
+static size_t Cols(const char* s, size_t n)
+{
+  size_t cols = 0, i;
+
+  for(i = 0; i < n; i++)
+    if((s[i] & 0xc0) != 0x80)
+      cols++;
+  return cols;
+}
+
+static void MoveTo(size_t col)
+{
+  char esc[32];
+
+  if(col == 0 && cursor != 0)
+    Put(&out, "\r", 1);
+  else if(col > cursor)
+    Put(&out, esc, sprintf(esc, "\x1b[%zuC", col - cursor));
+  else if(col < cursor)
+    Put(&out, esc, sprintf(esc, "\x1b[%zuD", cursor - col));
+  cursor = col;
+}
+
+static void Emit(const char* s, size_t n)
+{
+  Put(&out, s, n);
+  cursor += Cols(s, n);
+}
+
+static void NewLine()
+{
+  Put(&out, "\r\n", 2);
+  cursor = 0;
+}
+
+/*Keeps the cursor off the last two columns, which are left for the
+ *marker and the wrap, by centering it when it leaves the window*/
+static void Scroll()
+{
+  size_t i;
+
+  if(pos >= offset && (offset > 0) + Cols(line.s + offset, pos - offset) + 2 < width)
+    return;
+  offset = pos;
+  for(i = 0; i < width / 2 && offset > 0; i++)
+    offset = PrevChar(offset);
+}
+
+/*The row shows the line from offset with a < in front when the start is
+ *scrolled off and a > in its last column when the end is. The last
+ *column of the terminal is never used, so it never wraps.*/
+static void BuildView()
+{
+  size_t cols = offset > 0, p = offset, next;
+
+  view.len = 0;
+  if(offset > 0)
+    Put(&view, "<", 1);
+  while(p < line.len && cols < width - 1)
+  {
+    next = NextChar(p);
+    if(cols == width - 2 && next < line.len)
+    {
+      Put(&view, ">", 1);
+      break;
+    }
+    Put(&view, line.s + p, next - p);
+    cols++;
+    p = next;
+  }
+}
+
+/*Rewrites the row from the first byte that differs from the screen.
+ *When the length is the same only the bytes up to the last difference
+ *are written, otherwise the rest of the row is and what is left of the
+ *longer old row is cleared. A row is at most a terminal wide, so a key
+ *costs the same on a line of any length.*/
+static void Redraw()
+{
+  size_t w = TermWidth(), pre = 0, end, post = 0;
+
+  //the terminal may have rewrapped the old row, start over on this one
+  if(w != width)
+  {
+    Put(&out, "\r\x1b[K", 4);
+    shown.len = cursor = 0;
+    width = w;
+  }
+  Scroll();
+  BuildView();
+
+  while(pre < view.len && pre < shown.len && view.s[pre] == shown.s[pre])
+    pre++;
+  while(pre > 0 && ((pre < view.len && (view.s[pre] & 0xc0) == 0x80) ||
+                    (pre < shown.len && (shown.s[pre] & 0xc0) == 0x80)))
+    pre--;
+
+  if(view.len == shown.len)
+  {
+    while(post < view.len - pre && view.s[view.len - 1 - post] == shown.s[view.len - 1 - post])
+      post++;
+    end = view.len - post;
+    while(end < view.len && (view.s[end] & 0xc0) == 0x80)
+      end++;
+    if(end > pre)
+    {
+      MoveTo(Cols(view.s, pre));
+      Emit(view.s + pre, end - pre);
+    }
+  }
+  else
+  {
+    MoveTo(Cols(view.s, pre));
+    Emit(view.s + pre, view.len - pre);
+    if(Cols(view.s, view.len) < Cols(shown.s, shown.len))
+      Put(&out, "\x1b[K", 3);
+  }
+  MoveTo((offset > 0) + Cols(line.s + offset, pos - offset));
+
+  shown.len = 0;
+  Put(&shown, view.s, view.len);
+}
+
+static void Flush()
+{
+  size_t done = 0;
+  ssize_t n;
+
+  //what stdio holds was printed before the line
+  fflush(stdout);
+  while(done < out.len)
+  {
+    n = write(STDOUT_FILENO, out.s + done, out.len - done);
+    if(n < 0 && errno == EINTR)
+      continue;
+    if(n <= 0)
+      break;
+    done += n;
+  }
+  out.len = 0;
+}
+
+static void Key(unsigned char c)
+{
+  if(seqLen > 0 || c == 27)
+  {
+    if(!Escape(c))
+      return;
+  }
+  else
+    Do(c);
+  killing = killNow;
+  killNow = FALSE;
+}
+
+/*An escape is followed by one byte for alt+key, or by [ or O, then
+ *parameters and a final byte between @ and ~*/
+static bool Escape(unsigned char c)
+{
+  int i;
+
+  seq[seqLen++] = c;
+  seq[seqLen] = '\0';
+  if(seqLen == 1)
+    return FALSE;
+  if((seq[1] == '[' || seq[1] == 'O') && (seqLen == 2 || c < 0x40 || c > 0x7e))
+  {
+    if(seqLen < EDIT_SEQ - 1)
+      return FALSE;
+    //too long to be anything known
+    seqLen = 0;
+    return TRUE;
+  }
+  seqLen = 0;
+  for(i = 0; i < sizeof(escapes) / sizeof(escapes[0]); i++)
+  {
+    if(strcmp(seq + 1, escapes[i].seq) == 0)
+    {
+      Do(escapes[i].key);
+      break;
+    }
+  }
+  return TRUE;
+}
+
+static void Do(int key)
+{
+  size_t p;
+
+  switch(key)
+  {
+    case CONTROL('A'):
+      pos = 0;
+      break;
+    case CONTROL('E'):
+      pos = line.len;
+      break;
+    case CONTROL('B'):
+      pos = PrevChar(pos);
+      break;
+    case CONTROL('F'):
+      pos = NextChar(pos);
+      break;
+    case KEY_WORD_LEFT:
+      pos = PrevWord(pos, FALSE);
+      break;
+    case KEY_WORD_RIGHT:
+      pos = NextWord(pos, FALSE);
+      break;
+    case CONTROL('D'):
+      if(line.len == 0)
+      {
+        ended = TRUE;
+        break;
+      }
+      Splice(&line, pos, NextChar(pos) - pos, "", 0);
+      break;
+    case KEY_DELETE:
+      Splice(&line, pos, NextChar(pos) - pos, "", 0);
+      break;
+    case CONTROL('H'):
+    case 127:
+      p = PrevChar(pos);
+      Splice(&line, p, pos - p, "", 0);
+      pos = p;
+      break;
+    case CONTROL('K'):
+      Kill(pos, line.len);
+      break;
+    case CONTROL('U'):
+      Kill(0, pos);
+      break;
+    case CONTROL('W'):
+      Kill(PrevWord(pos, TRUE), pos);
+      break;
+    case KEY_RUBOUT_WORD:
+      Kill(PrevWord(pos, FALSE), pos);
+      break;
+    case KEY_KILL_WORD:
+      Kill(pos, NextWord(pos, FALSE));
+      break;
+    case CONTROL('Y'):
+      Splice(&line, pos, 0, killed.s, killed.len);
+      pos += killed.len;
+      break;
+    case CONTROL('P'):
+      Recall(-1);
+      break;
+    case CONTROL('N'):
+      Recall(1);
+      break;
+    case CONTROL('L'):
+      Put(&out, "\x1b[H\x1b[2J", 7);
+      shown.len = cursor = 0;
+      break;
+    case CONTROL('C'):
+      //the line stays on the screen, marked, and a new one starts below
+      Redraw();
+      MoveTo(Cols(shown.s, shown.len));
+      if(cursor + 2 < width)
+        Emit("^C", 2);
+      NewLine();
+      line.len = pos = offset = 0;
+      shown.len = 0;
+      historyPos = historyLen;
+      break;
+    case '\r':
+    case '\n':
+      accepted = TRUE;
+      break;
+    default:
+      //the other control characters are ignored
+      if(key >= ' ' && key < 256 && key != 127)
+      {
+        char c = key;
+        Splice(&line, pos, 0, &c, 1);
+        pos++;
+      }
+      break;
+  }
+}
+
+/*Kills one after another add up, those going back at the front*/
+static void Kill(size_t from, size_t to)
+{
+  if(!killing)
+    killed.len = 0;
+  Splice(&killed, from < pos ? 0 : killed.len, 0, line.s + from, to - from);
+  Splice(&line, from, to - from, "", 0);
+  pos = from;
+  killNow = TRUE;
+}
+
+static void Recall(int dir)
+{
+  int to = historyPos + dir;
+
+  if(to < 0 || to > historyLen)
+    return;
+  if(historyPos == historyLen)
+  {
+    scratch.len = 0;
+    Put(&scratch, line.s, line.len);
+  }
+  historyPos = to;
+  line.len = 0;
+  if(to == historyLen)
+    Put(&line, scratch.s, scratch.len);
+  else
+    Put(&line, history[to], strlen(history[to]));
+  pos = line.len;
+}
+
+static void AddHistory(const char* s)
+{
+  if(*s == '\0' || (historyLen > 0 && strcmp(history[historyLen - 1], s) == 0))
+    return;
+  if(history == NULL)
+    history = malloc(sizeof(char*) * EDIT_HISTORY);
+  if(historyLen == EDIT_HISTORY)
+  {
+    free(history[0]);
+    memmove(history, history + 1, sizeof(char*) * --historyLen);
+  }
+  history[historyLen++] = strdup(s);
+}
+
+static size_t PrevChar(size_t p)
+{
+  if(p > 0)
+    p--;
+  while(p > 0 && (line.s[p] & 0xc0) == 0x80)
+    p--;
+  return p;
+}
+
+static size_t NextChar(size_t p)
+{
+  if(p < line.len)
+    p++;
+  while(p < line.len && (line.s[p] & 0xc0) == 0x80)
+    p++;
+  return p;
+}
+
+/*Words are made of letters and digits, or of anything but blanks for
+ *ctrl+w*/
+static bool IsWord(unsigned char c, bool blanks)
+{
+  if(blanks)
+    return !isspace(c);
+  return isalnum(c) || c == '_' || c >= 0x80;
+}
+
+static size_t PrevWord(size_t p, bool blanks)
+{
+  while(p > 0 && !IsWord(line.s[p - 1], blanks))
+    p--;
+  while(p > 0 && IsWord(line.s[p - 1], blanks))
+    p--;
+  return p;
+}
+
+static size_t NextWord(size_t p, bool blanks)
+{
+  while(p < line.len && !IsWord(line.s[p], blanks))
+    p++;
+  while(p < line.len && IsWord(line.s[p], blanks))
+    p++;
+  return p;
+}
+
+static size_t TermWidth()
+{
+  struct winsize ws;
+
+  //a narrower terminal gets a row that wraps, but still works
+  if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+    return ws.ws_col < 8 ? 8 : ws.ws_col;
+  return 80;
+}
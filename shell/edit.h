@@ -0,0 +1,82 @@
+/***************************************************************************
+ *  Title: Line editor
+ * -------------------------------------------------------------------------
+ *    Purpose: Reads command lines from a terminal with emacs keys, a kill
+ *    buffer and history, redrawing only what changed
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: edit.h
+ ***************************************************************************/
+
+#ifndef __EDIT_H__
+#define __EDIT_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+
+/************Private include**********************************************/
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __EDIT_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Checks whether the line editor is used
+ * ---------------------------------------------------------------------
+ *    Purpose: Lines are edited when stdin and stdout are a terminal
+ *    that is not dumb.
+ *    Input: void
+ *    Output: true if getCommandLine should call EditLine
+ ***********************************************************************/
+EXTERN bool UseEditor();
+
+/***********************************************************************
+ *  Title: Edits one command line
+ * ---------------------------------------------------------------------
+ *    Purpose: Puts the terminal in raw mode and reads keys until enter.
+ *    Keys: ctrl+a/e, home/end, ctrl+b/f and the arrows move, alt+b/f
+ *    and ctrl+arrows move by word, backspace, ctrl+d and delete delete,
+ *    ctrl+k/u/w and alt+d kill into a buffer ctrl+y yanks back, up,
+ *    down and ctrl+p/n go through the history, ctrl+l redraws, ctrl+c
+ *    drops the line and ctrl+d on an empty line ends the input. A line
+ *    wider than the terminal scrolls sideways. Each batch of keys that
+ *    came in together is answered by one write of the escape sequences
+ *    that take the row from what it showed to what it shows now.
+ *    Events are handled while it waits.
+ *    Input: pointer to the buffer (will be resized as necessary)
+ *    Output: false at the end of the input
+ ***********************************************************************/
+EXTERN bool EditLine(char**);
+
+/***********************************************************************
+ *  Title: Hides the line being edited
+ * ---------------------------------------------------------------------
+ *    Purpose: Clears the line from the screen so a message, like a job
+ *    that is done, can be printed in its place; it is drawn again
+ *    below the message. Does nothing while no line is edited.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void HideEditLine();
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __EDIT_H__ */
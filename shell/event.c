@@ -0,0 +1,227 @@
+/***************************************************************************
+ *  Title: Event loop
+ * -------------------------------------------------------------------------
+ *    Purpose: Waits for input, signals and jobs in one place. Signals
+ *    are read from a signalfd, so the job list is only ever changed
+ *    from the main flow of the shell and never from a handler.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: event.c
+ ***************************************************************************/
+#define __EVENT_IMPL__
+
+/************System include***********************************************/
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "event.h"
+#include "io.h"
+#include "runtime.h"
+#include "stats.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* events handled by one round at most */
+#define MAXEVENTS 16
+
+/* the event of a pidfd carries the pid of its process next to the fd,
+ * so the job it belongs to is found without looking at the others */
+#define EVENT_DATA(fd, pid) ((uint64_t) (uint32_t) (pid) << 32 | (uint32_t) (fd))
+#define EVENT_PID(data) ((pid_t) ((data) >> 32))
+
+/************Global Variables*********************************************/
+
+static int epollFd = -1;
+static int signalFd = -1;
+/* the period of stats -w, -1 while it is off */
+static int timerFd = -1;
+/* where input comes from: stdin, or the socket of tsh --serve */
+static int inputFd = STDIN_FILENO;
+/* regular files cannot be in an epoll set, they are always readable */
+static bool inputPollable = FALSE;
+/* whether stdin currently wakes the loop */
+static bool inputOn = FALSE;
+/* connections that became readable, until TakeReadyFd hands them out */
+static int* readyFds = NULL;
+static int nreadyFds = 0;
+
+/************Function Prototypes******************************************/
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+void InitEvents()
+{
+  sigset_t mask;
+  struct epoll_event ev;
+
+  if(epollFd >= 0) close(epollFd);
+  if(signalFd >= 0) close(signalFd);
+  //a forked shell does not write out statistics
+  if(timerFd >= 0) close(timerFd);
+  timerFd = -1;
+
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGCHLD);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTSTP);
+  sigprocmask(SIG_BLOCK, &mask, NULL);
+  //an ignored SIGCHLD is not even sent for stopped children, and what
+  //was ignored when the shell started would be ignored by its programs
+  signal(SIGCHLD, SIG_DFL);
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTSTP, SIG_DFL);
+  if((signalFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+    PrintPError("signalfd");
+  if((epollFd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+    PrintPError("epoll_create1");
+
+  ev.events = EPOLLIN;
+  ev.data.u64 = EVENT_DATA(signalFd, 0);
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &ev);
+  inputFd = STDIN_FILENO;
+  ev.data.u64 = EVENT_DATA(inputFd, 0);
+  inputPollable = epoll_ctl(epollFd, EPOLL_CTL_ADD, inputFd, &ev) == 0;
+  inputOn = inputPollable;
+}
+
+void SetEventInput(int fd)
+{
+  struct epoll_event ev;
+
+  if(inputPollable)
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, inputFd, NULL);
+  inputFd = fd;
+  ev.events = EPOLLIN;
+  ev.data.u64 = EVENT_DATA(inputFd, 0);
+  inputPollable = epoll_ctl(epollFd, EPOLL_CTL_ADD, inputFd, &ev) == 0;
+  inputOn = inputPollable;
+}
+
+void WatchFd(int fd, pid_t pid)
+{
+  struct epoll_event ev;
+
+  //one shot: the pidfd stays readable until the process is reaped and
+  //must not keep waking the loop until then
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.u64 = EVENT_DATA(fd, pid);
+  epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev);
+}
+
+int TakeReadyFd()
+{
+  int fd;
+
+  if(nreadyFds == 0)
+    return -1;
+  fd = readyFds[0];
+  memmove(readyFds, readyFds + 1, sizeof(int) * --nreadyFds);
+  return fd;
+}
+
+void SetEventTimer(int seconds)
+{
+  struct itimerspec period = { { seconds, 0 }, { seconds, 0 } };
+  struct epoll_event ev;
+
+  if(timerFd < 0 && seconds > 0)
+  {
+    if((timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) < 0)
+    {
+      PrintPError("timerfd_create");
+      return;
+    }
+    ev.events = EPOLLIN;
+    ev.data.u64 = EVENT_DATA(timerFd, 0);
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, timerFd, &ev);
+  }
+  //a zero period disarms it
+  if(timerFd >= 0)
+    timerfd_settime(timerFd, 0, &period, NULL);
+}
+
+bool WaitEvents(bool input, int timeout)
+{
+  struct epoll_event ev[MAXEVENTS];
+  struct signalfd_siginfo info;
+  uint64_t expired;
+  bool ready = FALSE, changed = FALSE;
+  int i, n;
+
+  if(input && !inputPollable)
+  {
+    //only pick up what is pending
+    ready = TRUE;
+    timeout = 0;
+  }
+  //stdin only wakes the loop while a line is awaited
+  if(inputPollable && input != inputOn)
+  {
+    ev[0].events = input ? EPOLLIN : 0;
+    ev[0].data.u64 = EVENT_DATA(inputFd, 0);
+    epoll_ctl(epollFd, EPOLL_CTL_MOD, inputFd, &ev[0]);
+    inputOn = input;
+  }
+
+  n = epoll_wait(epollFd, ev, MAXEVENTS, timeout);
+  for(i = 0; i < n; i++)
+  {
+    if(ev[i].data.u64 == EVENT_DATA(inputFd, 0))
+    {
+      ready = TRUE;
+    }
+    else if(ev[i].data.u64 == EVENT_DATA(signalFd, 0))
+    {
+      while(read(signalFd, &info, sizeof(info)) == sizeof(info))
+      {
+        if(info.ssi_signo == SIGINT)
+          KillJob();
+        else if(info.ssi_signo == SIGTSTP)
+          StopJob();
+        else
+        {
+          //a child stopped, or ended without a pidfd
+          JobChanged(info.ssi_pid);
+          changed = TRUE;
+        }
+      }
+    }
+    else if(timerFd >= 0 && ev[i].data.u64 == EVENT_DATA(timerFd, 0))
+    {
+      //rounds missed while busy are not made up
+      if(read(timerFd, &expired, sizeof(expired)) == sizeof(expired))
+        DumpStats();
+    }
+    else if(EVENT_PID(ev[i].data.u64) == 0)
+    {
+      //a connection, read by whoever waits for it and not from in here
+      readyFds = realloc(readyFds, sizeof(int) * (nreadyFds + 1));
+      readyFds[nreadyFds++] = (int) (uint32_t) ev[i].data.u64;
+    }
+    else
+    {
+      //a pidfd, a process of a job ended
+      JobChanged(EVENT_PID(ev[i].data.u64));
+      changed = TRUE;
+    }
+  }
+
+  if(changed && input)
+    CheckJobs();
+  return ready;
+}
@@ -0,0 +1,109 @@
+/***************************************************************************
+ *  Title: Event loop
+ * -------------------------------------------------------------------------
+ *    Purpose: Waits for input, signals and jobs in one place
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: event.h
+ ***************************************************************************/
+
+#ifndef __EVENT_H__
+#define __EVENT_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+#include <sys/types.h>
+
+/************Private include**********************************************/
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __EVENT_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Sets up the event loop
+ * ---------------------------------------------------------------------
+ *    Purpose: Blocks SIGCHLD, SIGINT and SIGTSTP and has them delivered
+ *    through a signalfd instead, and creates the epoll set over it and
+ *    stdin. A forked shell calls it again to get a set of its own.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void InitEvents();
+
+/***********************************************************************
+ *  Title: Changes where input comes from
+ * ---------------------------------------------------------------------
+ *    Purpose: Has the loop wait for an fd other than stdin when input
+ *    is awaited, like the listening socket of tsh --serve.
+ *    Input: the fd
+ *    Output: void
+ ***********************************************************************/
+EXTERN void SetEventInput(int);
+
+/***********************************************************************
+ *  Title: Watches a pidfd
+ * ---------------------------------------------------------------------
+ *    Purpose: Wakes the loop once when the process of the pidfd ends
+ *    and hands its pid to JobChanged. With a pid of 0 the fd is a
+ *    connection instead, handed out by TakeReadyFd once it can be
+ *    read. Closing the fd takes it out of the set.
+ *    Input: the pidfd and the pid of its process
+ *    Output: void
+ ***********************************************************************/
+EXTERN void WatchFd(int, pid_t);
+
+/***********************************************************************
+ *  Title: Takes a connection that can be read
+ * ---------------------------------------------------------------------
+ *    Purpose: Hands out the fds watched with a pid of 0 that the loop
+ *    found readable, oldest first. Each is handed out once.
+ *    Input: void
+ *    Output: the fd, -1 when there is none
+ ***********************************************************************/
+EXTERN int TakeReadyFd();
+
+/***********************************************************************
+ *  Title: Sets the statistics timer
+ * ---------------------------------------------------------------------
+ *    Purpose: Has the loop call DumpStats every period while it waits
+ *    or checks for events.
+ *    Input: the period in seconds, 0 to stop
+ *    Output: void
+ ***********************************************************************/
+EXTERN void SetEventTimer(int);
+
+/***********************************************************************
+ *  Title: Waits for events
+ * ---------------------------------------------------------------------
+ *    Purpose: Sleeps until input, a signal or a change of a job, and
+ *    handles them: ctrl+c and ctrl+z go to the foreground job, a
+ *    background job is reaped as soon as one of its processes changes,
+ *    and jobs that end while input is awaited are reported right away.
+ *    Input: whether input is awaited and the timeout in milliseconds,
+ *    -1 for none
+ *    Output: true if stdin, or the fd of SetEventInput, can be read
+ ***********************************************************************/
+EXTERN bool WaitEvents(bool, int);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __EVENT_H__ */
@@ -22,6 +22,7 @@
 
 /************System include***********************************************/
 #include <assert.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -30,6 +31,7 @@
 #include "interpreter.h"
 #include "io.h"
 #include "runtime.h"
+#include "script.h"
 
 /************Defines and Typedefs*****************************************/
 /*  #defines and typedefs should have their names in all caps.
@@ -42,26 +44,117 @@ typedef struct string_l {
   struct string_l* next;
 } stringL;
 
+/* number of parsed command lines kept in the parse cache */
+#define PARSECACHE_SIZE 64
+/* number of hash buckets, must be a power of two */
+#define PARSECACHE_BUCKETS 128
+
+/* a cached parse tree, never handed out directly: callers get a copy */
+typedef struct parse_cache_l {
+  unsigned long long hash;
+  char* line;
+  int task;
+  commandT** command;
+  /* the compiled script of a line with control flow or ';', NULL for a
+   * pipeline; scripts keep no state between runs and are run in place */
+  scriptT* script;
+  /* runs of the entry in progress, one evicted meanwhile is freed once
+   * the last one is done */
+  int running;
+  bool evicted;
+  struct parse_cache_l* hnext;
+  struct parse_cache_l* prev;
+  struct parse_cache_l* next;
+} parseCacheL;
+
+/* number of hash buckets of the shell variables, must be a power of two */
+#define VAR_BUCKETS 64
+
+typedef struct var_l {
+  char* name;
+  char* value;
+  struct var_l* next;
+} varL;
+
+/************Global Variables*********************************************/
+
+/* hash buckets of the parse cache */
+static parseCacheL* parseCache[PARSECACHE_BUCKETS];
+/* most and least recently used entries */
+static parseCacheL* parseCacheHead = NULL;
+static parseCacheL* parseCacheTail = NULL;
+static int parseCacheCount = 0;
+static unsigned long parseCacheHits = 0;
+static unsigned long parseCacheMisses = 0;
+
+/* the shell variables */
+static varL* vars[VAR_BUCKETS];
+
+/* text of a control flow construct that is still missing lines */
+static char* pendingScript = NULL;
+
+/************Function Prototypes******************************************/
+/* parses a whole command line into commands */
+static int ParseLine(char*, commandT***);
+/* hashes a raw command line */
+static unsigned long long HashLine(char*);
+/* finds a cached parse tree and marks it as most recently used */
+static parseCacheL* LookupParseCache(char*, unsigned long long);
+/* stores a parse tree or a script, evicting the least recently used one */
+static parseCacheL* InsertParseCache(char*, unsigned long long, commandT**, int, scriptT*);
+/* unlinks a cache entry and frees it unless it is running */
+static void ReleaseParseCacheEntry(parseCacheL*);
+/* frees an unlinked cache entry */
+static void FreeParseCacheEntry(parseCacheL*);
+/* runs the script or the commands of a cache entry */
+static void RunParseCacheEntry(parseCacheL*);
+/* compiles and runs the pending script once it is complete */
+static void RunPendingScript();
+/* expands a word, optionally marking the fields of command substitutions */
+static char* Expand(char*, bool);
+/* turns the blanks of a command substitution's output into field separators */
+static void SplitFields(char*);
+/* replaces an argument with the fields of its expansion */
+static commandT* SpliceFields(commandT*, int*, char*);
+/* checks whether a command has nothing to expand */
+static bool IsPlain(commandT*);
+/* checks whether a command is a variable assignment */
+static bool IsAssignment(commandT*);
+/* finds a shell variable */
+static varL* FindVar(char*);
+
 /*Parse a single word from the param. Get rid of '"' or '''*/
 char* single_param(char *st)
 {
-  int quot1 = 0,quot2 = 0, start = 0;
+  int quot1 = 0,quot2 = 0, start = 0, n;
   char *t = st;
   static int idx;
 
   idx = 0;
   while(1){
     if(start == 1){
+      if(quot1 == 0 && (n = SubstLength(&st[idx])) > 0){
+        //a command substitution belongs to the word, whatever it contains
+        if(st[idx] == '<' || st[idx] == '>'){
+          //a process substitution only outside of quotes
+          if(!quot2) st[idx] = (st[idx] == '<') ? PROC_SUBST_IN : PROC_SUBST_OUT;
+        }
+        else if(quot2) st[idx] = (st[idx] == '$') ? QUOTED_SUBST : QUOTED_BACKTICK;
+        idx += n;
+        continue;
+      }
       if(st[idx] == '\0') return t;
       if(st[idx] == '<' || st[idx] == '>') {st[idx] = '\0'; return t;}
       if(st[idx] == ' ' && quot1 == 0 && quot2 == 0) {st[idx] = '\0';return t;}
       if(st[idx] == '\'' && quot1 == 1) {st[idx] = '\0';return t;}
       if(st[idx] == '"' && quot2 == 1) {st[idx] = '\0';return t;}
+      if(st[idx] == '$' && quot1 == 1) st[idx] = QUOTED_DOLLAR;
     }
     else{
       if(st[idx] == ' ' || st[idx] =='\0');
       else if(st[idx] == '"') {quot2 = 1; start = 1; t = &(st[idx+1]);}
       else if(st[idx] == '\'') {quot1 = 1; start = 1; t = &(st[idx+1]);}
+      else if(SubstLength(&st[idx]) > 0) {start = 1; t = &(st[idx]); continue;}
       else {start = 1; t = &(st[idx]);}
     }
     idx++;
@@ -71,8 +164,8 @@ char* single_param(char *st)
 /*Parse the single command and call single_param to parse each word in the command*/
 void parser_single(char *c, int sz, commandT** cd, int bg)
 {
-  int i, task_argc = 0, quot1 = 0, quot2 = 0;
-  char *in = NULL, * out = NULL, *tmp;
+  int i, n, task_argc = 0, quot1 = 0, quot2 = 0, heredoc = HEREDOC_NONE;
+  char *in = NULL, * out = NULL, *here = NULL, *tmp;
   int cmd_length;
   c[sz] = '\0';
   for(i = 0; i < sz; i++)
@@ -81,6 +174,10 @@ void parser_single(char *c, int sz, commandT** cd, int bg)
   sz = sz - i;
   cmd_length = sz;
   for(i = 0; i < sz; i++){
+    if(quot1 != 1 && (n = SubstLength(&c[i])) > 0){
+      i += n - 1;
+      continue;
+    }
     if(c[i] == '\''){
       if(quot2) continue;
       else if(quot1){
@@ -97,6 +194,16 @@ void parser_single(char *c, int sz, commandT** cd, int bg)
     }
     if(c[i] == '<' && quot1 != 1 && quot2 != 1){
       if(cmd_length == sz) cmd_length = i; 
+      //<<WORD, <<-WORD and <<<word
+      if(c[i + 1] == '<'){
+        i++;
+        heredoc = HEREDOC_DOC;
+        if(c[i + 1] == '<') {heredoc = HEREDOC_STRING; i++;}
+        else if(c[i + 1] == '-') {heredoc = HEREDOC_TABS; i++;}
+        while(i < (sz - 1) && c[i + 1] == ' ') i++;
+        here = &(c[i+1]);
+        continue;
+      }
       while(i < (sz - 1) && c[i + 1] == ' ') i++;
       in = &(c[i+1]);
     }
@@ -129,6 +236,17 @@ void parser_single(char *c, int sz, commandT** cd, int bg)
     (*cd) -> is_redirect_out = 1;
     (*cd) -> redirect_out = strdup(single_param(out));
   }
+  if(here){
+    (*cd) -> is_heredoc = heredoc;
+    //a quoted delimiter keeps the body from being expanded
+    (*cd) -> heredoc_quoted = heredoc != HEREDOC_STRING
+        && (*here == '\'' || *here == '"' || *here == '\\');
+    if(*here == '\\') here++;
+    if(heredoc == HEREDOC_STRING)
+      (*cd) -> heredoc = strdup(single_param(here));
+    else
+      (*cd) -> heredoc_delim = strdup(single_param(here));
+  }
 }
 
 
@@ -136,13 +254,456 @@ void parser_single(char *c, int sz, commandT** cd, int bg)
 /*Parse the whole command line and split commands if a piped command is sent.*/
 void Interpret(char* cmdLine)
 {
-  int task = 1;
-  int bg = 0, i,k,j = 0, quotation1 = 0, quotation2 = 0;
+  int task, status;
+  unsigned long long hash;
+  parseCacheL* entry;
   commandT **command;
+  scriptT* script;
+
+  //the line belongs to a loop or if that is not closed yet
+  if(pendingScript != NULL)
+  {
+    pendingScript = realloc(pendingScript, strlen(pendingScript) + strlen(cmdLine) + 2);
+    strcat(pendingScript, "\n");
+    strcat(pendingScript, cmdLine);
+    RunPendingScript();
+    return;
+  }
 
   if(cmdLine[0] == '\0') return;
 
+  hash = HashLine(cmdLine);
+
+  //control flow and command lists are compiled and run as a script, a
+  //line that holds all of it is cached like a pipeline
+  if(IsScript(cmdLine))
+  {
+    entry = LookupParseCache(cmdLine, hash);
+    if(entry == NULL)
+    {
+      script = CompileScript(cmdLine, &status);
+      //wait for the rest of the construct, those lines are not cached
+      if(status == SCRIPT_MORE)
+      {
+        pendingScript = strdup(cmdLine);
+        return;
+      }
+      if(script == NULL) return;
+      entry = InsertParseCache(cmdLine, hash, NULL, 0, script);
+    }
+    RunParseCacheEntry(entry);
+    return;
+  }
+
+  entry = LookupParseCache(cmdLine, hash);
+  if(entry == NULL)
+  {
+    //ParseLine cuts the line up in place, so keep the raw key around
+    char* raw = strdup(cmdLine);
+    task = ParseLine(cmdLine, &command);
+    if(task > 0)
+      entry = InsertParseCache(raw, hash, command, task, NULL);
+    free(raw);
+    if(task == 0) return;
+  }
+
+  RunParseCacheEntry(entry);
+}
+
+int ParseCommandLine(char* cmdLine, commandT*** command)
+{
+  int task;
+  char* line = strdup(cmdLine);
+  task = ParseLine(line, command);
+  free(line);
+  return task;
+}
+
+void RunParsed(commandT** templates, int task)
+{
+  int i;
+  char *eq, *word;
+  commandT** command = (commandT **) malloc(sizeof(commandT *) * task);
+
+  //only what expansion changes needs its own copy of the words
+  for(i = 0; i < task; i++)
+    command[i] = IsPlain(templates[i]) ? ShareCmdT(templates[i]) : CopyCmdT(templates[i]);
+
+  //NAME=value sets a shell variable, the value is not split into fields
+  if(task == 1 && IsAssignment(command[0]))
+  {
+    //a command substitution in the value sets the status
+    lastStatus = 0;
+    word = ExpandWord(command[0]->argv[0]);
+    eq = strchr(word, '=');
+    *eq = '\0';
+    SetVar(word, eq + 1);
+    free(word);
+    TakeProcSubst(command[0]);
+    ReleaseCmdT(&command[0]);
+  }
+  else
+  {
+    for(i = 0; i < task; i++)
+      if(!command[i]->shared)
+        command[i] = ExpandCmdT(command[i]);
+    RunCmd(command, task);
+  }
+  WaitProcSubst();
+  free(command);
+}
+
+void SetVar(char* name, char* value)
+{
+  varL* var = FindVar(name);
+
+  if(var == NULL)
+  {
+    varL** bucket = &vars[HashLine(name) & (VAR_BUCKETS - 1)];
+    var = (varL*) malloc(sizeof(varL));
+    var->name = strdup(name);
+    var->value = NULL;
+    var->next = *bucket;
+    *bucket = var;
+  }
+  //reuse the old buffer when the new value fits, loops set the same variable a lot
+  if(var->value == NULL || strlen(var->value) < strlen(value))
+  {
+    free(var->value);
+    var->value = strdup(value);
+  }
+  else
+  {
+    strcpy(var->value, value);
+  }
+}
+
+void UnsetVar(char* name)
+{
+  varL** link = &vars[HashLine(name) & (VAR_BUCKETS - 1)];
+  varL* var;
+
+  while(*link != NULL && strcmp((*link)->name, name) != 0)
+    link = &(*link)->next;
+  if((var = *link) == NULL)
+    return;
+  *link = var->next;
+  free(var->name);
+  free(var->value);
+  free(var);
+}
+
+char* GetVar(char* name)
+{
+  varL* var = FindVar(name);
+  if(var != NULL)
+    return var->value;
+  return getenv(name);
+}
+
+char* ExpandWord(char* word)
+{
+  return Expand(word, FALSE);
+}
+
+char* ExpandFields(char* word)
+{
+  return Expand(word, TRUE);
+}
+
+int SubstLength(char* p)
+{
+  int depth = 0, quot1 = 0, quot2 = 0;
+  char* start = p;
+
+  if(*p == '`' || *p == QUOTED_BACKTICK)
+  {
+    while(*++p != '\0')
+      if(*p == '`') return p - start + 1;
+    return 0;
+  }
+  if((*p != '$' && *p != QUOTED_SUBST && *p != '<' && *p != '>'
+      && *p != PROC_SUBST_IN && *p != PROC_SUBST_OUT) || p[1] != '(')
+    return 0;
+  for(p++; *p != '\0'; p++)
+  {
+    if(*p == '\'' && !quot2) quot1 = !quot1;
+    else if(*p == '"' && !quot1) quot2 = !quot2;
+    else if(quot1 || quot2) continue;
+    else if(*p == '(') depth++;
+    else if(*p == ')' && --depth == 0) return p - start + 1;
+  }
+  return 0;
+}
+
+static char* Expand(char* word, bool split)
+{
+  size_t len = 0, cap = strlen(word) + 1, n;
+  char* out = malloc(cap);
+  char *value, *inner, *output;
+  char name[MAXLINE];
+  char num[16];
+  bool subst = FALSE;
+
+  while(*word != '\0')
+  {
+    value = output = NULL;
+    n = 0;
+    //a bare "<(" is only left where it is not a process substitution
+    if(*word != '<' && *word != '>' && (n = SubstLength(word)) > 0)
+    {
+      //$(command) or `command`, the quoted forms are not split
+      bool quoted = (*word == QUOTED_SUBST || *word == QUOTED_BACKTICK);
+      size_t skip = (*word == '`' || *word == QUOTED_BACKTICK) ? 1 : 2;
+      inner = strndup(word + skip, n - skip - 1);
+      //<(command) and >(command) become the path of a pipe
+      if(*word == PROC_SUBST_IN || *word == PROC_SUBST_OUT)
+      {
+        output = RunProcSubst(inner, *word == PROC_SUBST_OUT);
+        value = output != NULL ? output : "";
+      }
+      else
+        value = output = RunCmdCapture(inner);
+      free(inner);
+      word += n;
+      if(split && !quoted)
+      {
+        SplitFields(output);
+        subst = TRUE;
+      }
+    }
+    else if(*word == QUOTED_DOLLAR)
+    {
+      //a '$' that was single quoted
+      value = "$";
+      word++;
+    }
+    else if(*word == '$' && (word[1] == '?' || word[1] == '$'))
+    {
+      snprintf(num, sizeof(num), "%d", word[1] == '?' ? lastStatus : (int) getpid());
+      value = num;
+      word += 2;
+    }
+    else if(*word == '$' && word[1] == '{' && strchr(word, '}') != NULL)
+    {
+      n = strchr(word, '}') - word - 2;
+      if(n >= MAXLINE) n = MAXLINE - 1;
+      strncpy(name, word + 2, n);
+      name[n] = '\0';
+      value = GetVar(name);
+      if(value == NULL) value = "";
+      word = strchr(word, '}') + 1;
+    }
+    else if(*word == '$' && (isalpha((unsigned char) word[1]) || word[1] == '_'))
+    {
+      word++;
+      while((isalnum((unsigned char) word[n]) || word[n] == '_') && n < MAXLINE - 1)
+      {
+        name[n] = word[n];
+        n++;
+      }
+      name[n] = '\0';
+      word += n;
+      value = GetVar(name);
+      if(value == NULL) value = "";
+    }
+
+    if(value == NULL)
+    {
+      //plain character, including a lone '$'
+      value = num;
+      num[0] = *word++;
+      num[1] = '\0';
+    }
+    n = strlen(value);
+    if(len + n + 1 > cap)
+    {
+      cap = (len + n + 1) * 2;
+      out = realloc(out, cap);
+    }
+    memcpy(out + len, value, n);
+    len += n;
+    free(output);
+  }
+  //a word that was only an empty substitution disappears
+  if(subst && len == 0)
+    out[len++] = FIELD_SEP;
+  out[len] = '\0';
+  return out;
+}
+
+/*Blanks separate fields, runs of them collapse into one separator*/
+static void SplitFields(char* s)
+{
+  char* d = s;
+  bool blank = FALSE;
+
+  for(; *s != '\0'; s++)
+  {
+    if(*s == ' ' || *s == '\t' || *s == '\n')
+    {
+      if(!blank) *d++ = FIELD_SEP;
+      blank = TRUE;
+    }
+    else
+    {
+      *d++ = *s;
+      blank = FALSE;
+    }
+  }
+  *d = '\0';
+}
+
+static void RunPendingScript()
+{
+  int status;
+  scriptT* script = CompileScript(pendingScript, &status);
+
+  //wait for the rest of the construct
+  if(status == SCRIPT_MORE) return;
+
+  free(pendingScript);
+  pendingScript = NULL;
+  if(script != NULL)
+  {
+    RunScript(script);
+    ReleaseScript(script);
+  }
+}
+
+/*Expand the variables and command substitutions in the words of a command*/
+commandT* ExpandCmdT(commandT* cmd)
+{
+  int i;
+  char* word;
+
+  for(i = 0; i < cmd->argc; i++)
+  {
+    if(cmd->argv[i] != NULL && strpbrk(cmd->argv[i], EXPAND_CHARS) != NULL)
+    {
+      word = ExpandFields(cmd->argv[i]);
+      free(cmd->argv[i]);
+      if(strchr(word, FIELD_SEP) != NULL)
+        cmd = SpliceFields(cmd, &i, word);
+      else
+        cmd->argv[i] = word;
+    }
+  }
+  if(cmd->redirect_in != NULL && strpbrk(cmd->redirect_in, EXPAND_CHARS) != NULL)
+  {
+    word = ExpandWord(cmd->redirect_in);
+    free(cmd->redirect_in);
+    cmd->redirect_in = word;
+  }
+  if(cmd->redirect_out != NULL && strpbrk(cmd->redirect_out, EXPAND_CHARS) != NULL)
+  {
+    word = ExpandWord(cmd->redirect_out);
+    free(cmd->redirect_out);
+    cmd->redirect_out = word;
+  }
+  if(cmd->heredoc != NULL && !cmd->heredoc_quoted && strpbrk(cmd->heredoc, EXPAND_CHARS) != NULL)
+  {
+    word = ExpandWord(cmd->heredoc);
+    free(cmd->heredoc);
+    cmd->heredoc = word;
+  }
+  TakeProcSubst(cmd);
+  return cmd;
+}
+
+/*Replace argv[*i] with the non-empty fields of word, leaving *i on the last one*/
+static commandT* SpliceFields(commandT* cmd, int* i, char* word)
+{
+  int n = 0, j;
+  char *f, *sep;
+
+  for(f = word; f != NULL; f = sep ? sep + 1 : NULL)
+  {
+    sep = strchr(f, FIELD_SEP);
+    if(f[0] != FIELD_SEP && f[0] != '\0') n++;
+  }
+  if(n > 1)
+    cmd = realloc(cmd, sizeof(commandT) + sizeof(char*) * (cmd->argc + n));
+  //move the following arguments and the terminating NULL
+  memmove(&cmd->argv[*i + n], &cmd->argv[*i + 1], sizeof(char*) * (cmd->argc - *i));
+  cmd->argc += n - 1;
+
+  j = *i;
+  for(f = word; f != NULL; f = sep ? sep + 1 : NULL)
+  {
+    sep = strchr(f, FIELD_SEP);
+    if(sep != NULL) *sep = '\0';
+    if(*f != '\0') cmd->argv[j++] = strdup(f);
+  }
+  free(word);
+  *i += n - 1;
+  return cmd;
+}
+
+/*Nothing in the command is expanded, it runs as it was parsed*/
+static bool IsPlain(commandT* cmd)
+{
+  int i;
+
+  for(i = 0; i < cmd->argc; i++)
+    if(cmd->argv[i] != NULL && strpbrk(cmd->argv[i], EXPAND_CHARS) != NULL)
+      return FALSE;
+  if(cmd->redirect_in != NULL && strpbrk(cmd->redirect_in, EXPAND_CHARS) != NULL)
+    return FALSE;
+  if(cmd->redirect_out != NULL && strpbrk(cmd->redirect_out, EXPAND_CHARS) != NULL)
+    return FALSE;
+  return cmd->heredoc == NULL || cmd->heredoc_quoted || strpbrk(cmd->heredoc, EXPAND_CHARS) == NULL;
+}
+
+/*A single word of the form NAME=value*/
+static bool IsAssignment(commandT* cmd)
+{
+  char* c = cmd->argv[0];
+
+  if(cmd->argc != 1 || c == NULL || !(isalpha((unsigned char) *c) || *c == '_'))
+    return FALSE;
+  while(isalnum((unsigned char) *c) || *c == '_')
+    c++;
+  return *c == '=';
+}
+
+static varL* FindVar(char* name)
+{
+  varL* var = vars[HashLine(name) & (VAR_BUCKETS - 1)];
+  while(var != NULL && strcmp(var->name, name) != 0)
+    var = var->next;
+  return var;
+}
+
+void PrintParseCacheStats()
+{
+  unsigned long total = parseCacheHits + parseCacheMisses;
+
+  printf("parse cache: %d/%d entries, %lu hits, %lu misses, %.1f%% hit rate\n",
+      parseCacheCount, PARSECACHE_SIZE, parseCacheHits, parseCacheMisses,
+      total == 0 ? 0.0 : 100.0 * parseCacheHits / total);
+  fflush(stdout);
+}
+
+void ClearParseCache()
+{
+  while(parseCacheTail != NULL)
+    ReleaseParseCacheEntry(parseCacheTail);
+  parseCacheHits = parseCacheMisses = 0;
+}
+
+/*Split the command line into its piped commands, returns the number of commands*/
+static int ParseLine(char* cmdLine, commandT*** out)
+{
+  int task = 1;
+  int bg = 0, i,k,n,j = 0, quotation1 = 0, quotation2 = 0;
+  commandT **command;
+
   for(i = 0; i < strlen(cmdLine); i++){
+    if(quotation1 != 1 && (n = SubstLength(&cmdLine[i])) > 0){
+      i += n - 1;
+      continue;
+    }
     if(cmdLine[i] == '\''){
       if(quotation2) continue;
       else if(quotation1){
@@ -163,19 +724,25 @@ void Interpret(char* cmdLine)
     }
   }
 
-  command = (commandT **) malloc(sizeof(commandT *) * task);
   i = strlen(cmdLine) - 1;
   while(i >= 0 && cmdLine[i] == ' ') i--;
+  if(i < 0) return 0;
   if(cmdLine[i] == '&'){
-    if(i == 0) return;
+    if(i == 0) return 0;
     bg = 1;
     cmdLine[i] = '\0';
   }
+  command = (commandT **) malloc(sizeof(commandT *) * task);
 
   quotation1 = quotation2 = 0;
   task = 0;
   k = strlen(cmdLine);
   for(i = 0; i < k; i++, j++){
+    if(quotation1 != 1 && (n = SubstLength(&cmdLine[i])) > 0){
+      i += n - 1;
+      j += n - 1;
+      continue;
+    }
     if(cmdLine[i] == '\''){
       if(quotation2) continue;
       else if(quotation1){
@@ -198,6 +765,130 @@ void Interpret(char* cmdLine)
   }
   parser_single(&(cmdLine[i-j]), j, &(command[task]),bg);
 
-  RunCmd(command, task+1);
-  free(command);
+  *out = command;
+  return task + 1;
+}
+
+/*FNV-1a hash of the raw command line*/
+static unsigned long long HashLine(char* line)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  while(*line != '\0')
+  {
+    hash ^= (unsigned char) *line++;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static parseCacheL* LookupParseCache(char* line, unsigned long long hash)
+{
+  parseCacheL* entry = parseCache[hash & (PARSECACHE_BUCKETS - 1)];
+
+  while(entry != NULL && (entry->hash != hash || strcmp(entry->line, line) != 0))
+    entry = entry->hnext;
+  if(entry == NULL)
+  {
+    parseCacheMisses++;
+    return NULL;
+  }
+  parseCacheHits++;
+
+  //move the entry to the front of the LRU list
+  if(entry != parseCacheHead)
+  {
+    entry->prev->next = entry->next;
+    if(entry->next != NULL)
+      entry->next->prev = entry->prev;
+    else
+      parseCacheTail = entry->prev;
+    entry->prev = NULL;
+    entry->next = parseCacheHead;
+    parseCacheHead->prev = entry;
+    parseCacheHead = entry;
+  }
+  return entry;
+}
+
+static parseCacheL* InsertParseCache(char* line, unsigned long long hash, commandT** command, int task, scriptT* script)
+{
+  parseCacheL* entry;
+  parseCacheL** bucket = &parseCache[hash & (PARSECACHE_BUCKETS - 1)];
+
+  if(parseCacheCount == PARSECACHE_SIZE)
+    ReleaseParseCacheEntry(parseCacheTail);
+
+  entry = (parseCacheL*) malloc(sizeof(parseCacheL));
+  entry->hash = hash;
+  entry->line = strdup(line);
+  entry->task = task;
+  //the cache owns the parsed commands or the script from now on
+  entry->command = command;
+  entry->script = script;
+  entry->running = 0;
+  entry->evicted = FALSE;
+
+  entry->hnext = *bucket;
+  *bucket = entry;
+  entry->prev = NULL;
+  entry->next = parseCacheHead;
+  if(parseCacheHead != NULL)
+    parseCacheHead->prev = entry;
+  else
+    parseCacheTail = entry;
+  parseCacheHead = entry;
+  parseCacheCount++;
+  return entry;
+}
+
+static void ReleaseParseCacheEntry(parseCacheL* entry)
+{
+  parseCacheL** link = &parseCache[entry->hash & (PARSECACHE_BUCKETS - 1)];
+
+  //unlink from the hash bucket
+  while(*link != entry)
+    link = &((*link)->hnext);
+  *link = entry->hnext;
+
+  //unlink from the LRU list
+  if(entry->prev != NULL)
+    entry->prev->next = entry->next;
+  else
+    parseCacheHead = entry->next;
+  if(entry->next != NULL)
+    entry->next->prev = entry->prev;
+  else
+    parseCacheTail = entry->prev;
+  parseCacheCount--;
+
+  //a line can evict itself, like parsecache -c does
+  if(entry->running > 0)
+    entry->evicted = TRUE;
+  else
+    FreeParseCacheEntry(entry);
+}
+
+static void FreeParseCacheEntry(parseCacheL* entry)
+{
+  int i;
+
+  for(i = 0; i < entry->task; i++)
+    ReleaseCmdT(&(entry->command[i]));
+  free(entry->command);
+  if(entry->script != NULL)
+    ReleaseScript(entry->script);
+  free(entry->line);
+  free(entry);
+}
+
+static void RunParseCacheEntry(parseCacheL* entry)
+{
+  entry->running++;
+  //the cached commands are templates, RunParsed runs copies of them
+  if(entry->script != NULL)
+    RunScript(entry->script);
+  else
+    RunParsed(entry->command, entry->task);
+  if(--entry->running == 0 && entry->evicted)
+    FreeParseCacheEntry(entry);
 }
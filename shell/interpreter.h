@@ -30,6 +30,7 @@
 /************System include***********************************************/
 
 /************Private include**********************************************/
+#include "runtime.h"
 
 /************Defines and Typedefs*****************************************/
 /*  #defines and typedefs should have their names in all caps.
@@ -38,6 +39,24 @@
  *  structures and arrays, line everything up in neat columns.
  */
 
+/* marks a '$' that was single quoted and must not be expanded */
+#define QUOTED_DOLLAR '\001'
+#define QUOTED_DOLLAR_STR "\001"
+/* marks a command substitution inside double quotes, which is not split
+ * into fields: "$(" is stored as QUOTED_SUBST "(" and '`' as QUOTED_BACKTICK */
+#define QUOTED_SUBST '\002'
+#define QUOTED_BACKTICK '\003'
+/* separates the fields of an unquoted command substitution */
+#define FIELD_SEP '\004'
+#define FIELD_SEP_STR "\004"
+/* marks an unquoted process substitution: "<(" is stored as PROC_SUBST_IN
+ * "(" and ">(" as PROC_SUBST_OUT "(", so the same text in a here-document
+ * or in quotes stays as it is */
+#define PROC_SUBST_IN '\005'
+#define PROC_SUBST_OUT '\006'
+/* characters that make a word need expanding */
+#define EXPAND_CHARS "$`\001\002\003\005\006"
+
 #undef EXTERN
 #ifdef __INTERPRETER_IMPL__
 #define EXTERN 
@@ -59,6 +78,121 @@
  ***********************************************************************/
 EXTERN void Interpret(char*);
 
+/***********************************************************************
+ *  Title: Parse a command line 
+ * ---------------------------------------------------------------------
+ *    Purpose: Splits a command line into its piped commands without
+ *    running them. The words are not expanded.
+ *    Input: a command line and a pointer to receive the commands
+ *    Output: the number of commands, 0 if the line is empty
+ ***********************************************************************/
+EXTERN int ParseCommandLine(char*, commandT***);
+
+/***********************************************************************
+ *  Title: Run parsed commands 
+ * ---------------------------------------------------------------------
+ *    Purpose: Expands a copy of the parsed commands and runs it. The
+ *    parsed commands are left untouched so they can be run again.
+ *    Input: the parsed commands and their number
+ *    Output: void
+ ***********************************************************************/
+EXTERN void RunParsed(commandT**, int);
+
+/***********************************************************************
+ *  Title: Set a shell variable 
+ * ---------------------------------------------------------------------
+ *    Purpose: Sets a shell variable, creating it if needed.
+ *    Input: the name and the value
+ *    Output: void
+ ***********************************************************************/
+EXTERN void SetVar(char*, char*);
+
+/***********************************************************************
+ *  Title: Unset a shell variable 
+ * ---------------------------------------------------------------------
+ *    Purpose: Removes a shell variable, nothing happens if it is not
+ *    set.
+ *    Input: the name
+ *    Output: void
+ ***********************************************************************/
+EXTERN void UnsetVar(char*);
+
+/***********************************************************************
+ *  Title: Get a shell variable 
+ * ---------------------------------------------------------------------
+ *    Purpose: Looks up a shell variable, falling back to the
+ *    environment.
+ *    Input: the name
+ *    Output: the value or NULL if it is not set
+ ***********************************************************************/
+EXTERN char* GetVar(char*);
+
+/***********************************************************************
+ *  Title: Expand a word 
+ * ---------------------------------------------------------------------
+ *    Purpose: Substitutes $NAME, ${NAME}, $?, $$, $(command) and
+ *    `command` in a word. The output of a command substitution is
+ *    kept as it is, only the trailing newlines are removed.
+ *    Input: the word
+ *    Output: a newly allocated expanded word
+ ***********************************************************************/
+EXTERN char* ExpandWord(char*);
+
+/***********************************************************************
+ *  Title: Expand a word into fields 
+ * ---------------------------------------------------------------------
+ *    Purpose: Expands a word like ExpandWord, but the blanks in the
+ *    output of an unquoted command substitution become FIELD_SEP. A
+ *    word that was only an empty substitution becomes FIELD_SEP_STR,
+ *    so callers can drop every empty field.
+ *    Input: the word
+ *    Output: a newly allocated expanded word
+ ***********************************************************************/
+EXTERN char* ExpandFields(char*);
+
+/***********************************************************************
+ *  Title: Expand a command 
+ * ---------------------------------------------------------------------
+ *    Purpose: Expands the words of a command, splitting the output of
+ *    unquoted command substitutions into separate arguments.
+ *    Input: the command structure
+ *    Output: the command structure, moved if it had to grow
+ ***********************************************************************/
+EXTERN commandT* ExpandCmdT(commandT*);
+
+/***********************************************************************
+ *  Title: Length of a command substitution 
+ * ---------------------------------------------------------------------
+ *    Purpose: Measures a $(command), `command`, <(command) or
+ *    >(command) starting at the given position, so scanners can skip
+ *    the quotes, blanks and operators inside it.
+ *    Input: a position in a command line
+ *    Output: the length, 0 if no complete substitution starts there
+ ***********************************************************************/
+EXTERN int SubstLength(char*);
+
+/***********************************************************************
+ *  Title: Print the parse cache statistics 
+ * ---------------------------------------------------------------------
+ *    Purpose: Prints the number of cached command lines and the hit
+ *    rate of the parse cache to standard output. Pipelines and lines
+ *    that hold a whole script, like "a; b" or a one-line loop, are
+ *    cached; the lines of a construct spread over several are not.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void PrintParseCacheStats();
+
+/***********************************************************************
+ *  Title: Clear the parse cache 
+ * ---------------------------------------------------------------------
+ *    Purpose: Drops all cached parse trees and scripts and resets the
+ *    statistics.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void ClearParseCache();
+
 /************External Declaration*****************************************/
 
 /**************Definition***************************************************/
@@ -31,6 +31,7 @@
 #define __IO_IMPL__
 
 /************System include***********************************************/
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,6 +43,8 @@
 /************Private include**********************************************/
 #include "io.h"
 #include "runtime.h"
+#include "event.h"
+#include "edit.h"
 
 /************Defines and Typedefs*****************************************/
 /*  #defines and typedefs should have their names in all caps.
@@ -55,6 +58,12 @@
 /* indicates that the standard input stream is currently read  */
 bool isReading = FALSE;
 
+/* what was read from stdin and not handed out as a line yet */
+static char* input = NULL;
+static size_t inputLen = 0, inputCap = 0;
+/* whether stdin has reached its end */
+static bool inputEnd = FALSE;
+
 /************Function Prototypes******************************************/
 
 /************External Declaration*****************************************/
@@ -90,26 +99,50 @@ bool IsReading()
   return isReading;
 }
 
-void getCommandLine(char** buf, int size)
+bool getCommandLine(char** buf, int size)
 {
-  char ch;
-  size_t used=0;
-  char* cmd = *buf;
-  cmd[0] = '\0';
+  char* nl;
+  size_t used;
+  ssize_t n;
 
   isReading = TRUE;
-  while (((ch = getc(stdin)) != EOF) &&
-      (ch != '\n'))
+  //a terminal gets the line editor once piped-in lines are used up
+  if(inputLen == 0 && !inputEnd && UseEditor())
+  {
+    inputEnd = !EditLine(buf);
+    isReading = FALSE;
+    return !inputEnd;
+  }
+  //read straight from the fd, stdio could hold lines the loop never sees;
+  //input is NULL until the first read
+  while((nl = inputLen > 0 ? memchr(input, '\n', inputLen) : NULL) == NULL && !inputEnd)
   {
-    if (used == size)
+    //sleep until there is input, reporting jobs that end meanwhile
+    if(!WaitEvents(TRUE, -1))
+      continue;
+    if(inputLen == inputCap)
     {
-      size *= 2;
-      cmd = realloc(cmd, sizeof(char)*(size+1));
-    }		
-    cmd[used] = ch;
-    used++;
-    cmd[used] = '\0';
+      inputCap = inputCap == 0 ? size : inputCap * 2;
+      input = realloc(input, inputCap);
+    }
+    n = read(STDIN_FILENO, input + inputLen, inputCap - inputLen);
+    if(n > 0)
+      inputLen += n;
+    else if(n == 0 || (errno != EINTR && errno != EAGAIN))
+      inputEnd = TRUE;
   }
   isReading = FALSE;
+
+  //a last line without a newline still counts
+  used = nl != NULL ? (size_t) (nl - input) : inputLen;
+  if(nl == NULL && used == 0)
+    return FALSE;
+  *buf = realloc(*buf, used + 1);
+  memcpy(*buf, input, used);
+  (*buf)[used] = '\0';
+  if(nl != NULL) used++;
+  memmove(input, input + used, inputLen - used);
+  inputLen -= used;
+  return TRUE;
 }
 
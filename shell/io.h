@@ -95,11 +95,12 @@ EXTERN bool IsReading();
  *  Title: Read one command line from stdin 
  * ---------------------------------------------------------------------
  *    Purpose: Reads one command line from stdin and returns it to the
- *    callee.
+ *    callee, through the line editor when it is a terminal. Events are
+ *    handled while it waits.
  *    Input: pointer to the buffer (will be resized as necessary) & size
- *    Output: void
+ *    Output: false at the end of the input
  ***********************************************************************/
-EXTERN void getCommandLine(char**, int);
+EXTERN bool getCommandLine(char**, int);
 
 /************External Declaration*****************************************/
 
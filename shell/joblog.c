@@ -0,0 +1,235 @@
+/***************************************************************************
+ *  Title: Job event log
+ * -------------------------------------------------------------------------
+ *    Purpose: Writes start, stop, continue and exit events of jobs as
+ *    JSON Lines. An event is built in memory and written with a single
+ *    write to an O_APPEND fd, so lines never interleave.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: joblog.c
+ ***************************************************************************/
+#define __JOBLOG_IMPL__
+
+/************System include***********************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "joblog.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* the log fd is kept above the fds commands are redirected to */
+#define JOBLOG_MINFD 10
+
+/************Global Variables*********************************************/
+
+static int logFd = -1;
+
+/* indexed by JOBLOG_ */
+static char* eventNames[] = { "start", "stop", "continue", "exit" };
+
+/************Function Prototypes******************************************/
+/* writes a JSON string */
+static void JsonString(FILE*, char*);
+/* the length of the UTF-8 sequence a string starts with, 0 if invalid */
+static int Utf8Length(unsigned char*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+bool SetJobLog(char* target)
+{
+  char* end;
+  long fd;
+  int newFd;
+
+  if(strcmp(target, "off") == 0)
+  {
+    newFd = -1;
+  }
+  else
+  {
+    fd = strtol(target, &end, 10);
+    if(*end == '\0' && end != target)
+    {
+      //an inherited fd, moved out of the way of redirections
+      newFd = fd < 0 || fd > INT_MAX ? -1 : fcntl((int) fd, F_DUPFD_CLOEXEC, JOBLOG_MINFD);
+    }
+    else
+    {
+      newFd = open(target, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+      if(newFd >= 0 && newFd < JOBLOG_MINFD)
+      {
+        fd = fcntl(newFd, F_DUPFD_CLOEXEC, JOBLOG_MINFD);
+        close(newFd);
+        newFd = fd;
+      }
+    }
+    if(newFd < 0)
+    {
+      fprintf(stderr, "shopt: joblog: %s: %s\n", target, strerror(errno));
+      return FALSE;
+    }
+  }
+  if(logFd >= 0)
+    close(logFd);
+  logFd = newFd;
+  free(jobLogTarget);
+  jobLogTarget = newFd >= 0 ? strdup(target) : NULL;
+  return TRUE;
+}
+
+char* JobLogArgv(commandT** cmd, int n)
+{
+  char* text = NULL;
+  size_t len;
+  FILE* out;
+  int i, j;
+
+  if(logFd < 0)
+    return NULL;
+  out = open_memstream(&text, &len);
+  fputc('[', out);
+  for(i = 0; i < n; i++)
+  {
+    fputs(i > 0 ? ",[" : "[", out);
+    for(j = 0; j < cmd[i]->argc; j++)
+    {
+      if(j > 0)
+        fputc(',', out);
+      JsonString(out, cmd[i]->argv[j]);
+    }
+    fputc(']', out);
+  }
+  fputc(']', out);
+  fclose(out);
+  return text;
+}
+
+void LogJobEvent(int event, int jid, pid_t pgid, pid_t pid, char* argv, int status,
+                 struct timespec* started, struct rusage* usage)
+{
+  struct timespec now, mono;
+  char* text = NULL;
+  size_t len, done = 0;
+  ssize_t n;
+  FILE* out;
+
+  if(logFd < 0)
+    return;
+  clock_gettime(CLOCK_REALTIME, &now);
+  out = open_memstream(&text, &len);
+  fprintf(out, "{\"event\":\"%s\",\"time\":%lld.%06ld,\"jid\":%d,\"pgid\":%d,\"pid\":%d,\"argv\":%s",
+          eventNames[event], (long long) now.tv_sec, now.tv_nsec / 1000, jid, pgid, pid,
+          argv != NULL ? argv : "[]");
+  if(event == JOBLOG_EXIT)
+  {
+    fprintf(out, ",\"status\":%d", status);
+    if(started != NULL)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &mono);
+      fprintf(out, ",\"elapsed\":%.6f", (mono.tv_sec - started->tv_sec) + (mono.tv_nsec - started->tv_nsec) / 1e9);
+    }
+    if(usage != NULL)
+    {
+      fprintf(out, ",\"rusage\":{\"utime\":%ld.%06ld,\"stime\":%ld.%06ld,\"maxrss\":%ld,"
+                   "\"minflt\":%ld,\"majflt\":%ld,\"inblock\":%ld,\"oublock\":%ld,\"nvcsw\":%ld,\"nivcsw\":%ld}",
+              (long) usage->ru_utime.tv_sec, (long) usage->ru_utime.tv_usec,
+              (long) usage->ru_stime.tv_sec, (long) usage->ru_stime.tv_usec,
+              usage->ru_maxrss, usage->ru_minflt, usage->ru_majflt,
+              usage->ru_inblock, usage->ru_oublock, usage->ru_nvcsw, usage->ru_nivcsw);
+    }
+  }
+  fputs("}\n", out);
+  fclose(out);
+  //one write per line, O_APPEND keeps it whole next to other writers
+  while(done < len && (n = write(logFd, text + done, len - done)) > 0)
+    done += n;
+  free(text);
+}
+
+void AddRusage(struct rusage* sum, struct rusage* ru)
+{
+  timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+  timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+  //the largest process, not a sum
+  if(ru->ru_maxrss > sum->ru_maxrss)
+    sum->ru_maxrss = ru->ru_maxrss;
+  sum->ru_minflt += ru->ru_minflt;
+  sum->ru_majflt += ru->ru_majflt;
+  sum->ru_inblock += ru->ru_inblock;
+  sum->ru_oublock += ru->ru_oublock;
+  sum->ru_nvcsw += ru->ru_nvcsw;
+  sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+/*Bytes that are not valid UTF-8, which an argv can hold, become \u00XX
+ *so the line stays valid JSON and the byte can still be told*/
+static void JsonString(FILE* out, char* s)
+{
+  int n;
+
+  fputc('"', out);
+  for(; *s != '\0'; s++)
+  {
+    if((unsigned char) *s >= 0x80)
+    {
+      if((n = Utf8Length((unsigned char*) s)) == 0)
+        fprintf(out, "\\u%04x", (unsigned char) *s);
+      else
+      {
+        fwrite(s, 1, n, out);
+        s += n - 1;
+      }
+    }
+    else if(*s == '"' || *s == '\\')
+      fprintf(out, "\\%c", *s);
+    else if(*s == '\n')
+      fputs("\\n", out);
+    else if(*s == '\t')
+      fputs("\\t", out);
+    else if((unsigned char) *s < 0x20)
+      fprintf(out, "\\u%04x", (unsigned char) *s);
+    else
+      fputc(*s, out);
+  }
+  fputc('"', out);
+}
+
+static int Utf8Length(unsigned char* s)
+{
+  int n, i;
+  unsigned char lo = 0x80, hi = 0xbf;
+
+  if(s[0] >= 0xc2 && s[0] <= 0xdf)
+    n = 2;
+  else if(s[0] >= 0xe0 && s[0] <= 0xef)
+    n = 3;
+  else if(s[0] >= 0xf0 && s[0] <= 0xf4)
+    n = 4;
+  else
+    return 0;
+  //no overlong forms, surrogates or code points past U+10FFFF
+  if(s[0] == 0xe0) lo = 0xa0;
+  if(s[0] == 0xed) hi = 0x9f;
+  if(s[0] == 0xf0) lo = 0x90;
+  if(s[0] == 0xf4) hi = 0x8f;
+  if(s[1] < lo || s[1] > hi)
+    return 0;
+  for(i = 2; i < n; i++)
+    if(s[i] < 0x80 || s[i] > 0xbf)
+      return 0;
+  return n;
+}
@@ -0,0 +1,100 @@
+/***************************************************************************
+ *  Title: Job event log
+ * -------------------------------------------------------------------------
+ *    Purpose: Writes what happens to jobs as JSON Lines for programs
+ *    that supervise the shell
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: joblog.h
+ ***************************************************************************/
+
+#ifndef __JOBLOG_H__
+#define __JOBLOG_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+#include <sys/resource.h>
+#include <time.h>
+
+/************Private include**********************************************/
+#include "runtime.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __JOBLOG_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/* events of the log */
+#define JOBLOG_START 0
+#define JOBLOG_STOP  1
+#define JOBLOG_CONT  2
+#define JOBLOG_EXIT  3
+
+/************Global Variables*********************************************/
+
+/* the path or fd the log goes to, NULL while it is off */
+EXTERN char* jobLogTarget;
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Sets where the log goes
+ * ---------------------------------------------------------------------
+ *    Purpose: Opens a path for appending, or takes a number as a file
+ *    descriptor the shell inherited; "off" closes the log. This is
+ *    shopt joblog=. Errors are reported on standard error.
+ *    Input: the path, fd or "off"
+ *    Output: false if it cannot be opened
+ ***********************************************************************/
+EXTERN bool SetJobLog(char*);
+
+/***********************************************************************
+ *  Title: Encodes the argv of a job
+ * ---------------------------------------------------------------------
+ *    Purpose: Builds the JSON array of the argv arrays of the commands
+ *    of a job, kept with the job for all of its events.
+ *    Input: the commands and how many there are
+ *    Output: the JSON text, NULL while the log is off
+ ***********************************************************************/
+EXTERN char* JobLogArgv(commandT**, int);
+
+/***********************************************************************
+ *  Title: Logs an event of a job
+ * ---------------------------------------------------------------------
+ *    Purpose: Writes one line like
+ *    {"event":"exit","time":...,"jid":1,"pgid":..,"pid":..,"argv":[[..]],
+ *     "status":0,"elapsed":..,"rusage":{..}} with a single write. The
+ *    status, elapsed time and rusage are only in exit events.
+ *    Input: the JOBLOG_ event, the job id (0 for a foreground job),
+ *    the process group, the last process, the argv from JobLogArgv,
+ *    the exit status, when the job started (CLOCK_MONOTONIC) and what
+ *    its processes used (may be NULL)
+ *    Output: void
+ ***********************************************************************/
+EXTERN void LogJobEvent(int, int, pid_t, pid_t, char*, int, struct timespec*, struct rusage*);
+
+/***********************************************************************
+ *  Title: Adds up resource usage
+ * ---------------------------------------------------------------------
+ *    Purpose: Adds what a process used to what its job used so far.
+ *    Input: the sum and the usage of the process
+ *    Output: void
+ ***********************************************************************/
+EXTERN void AddRusage(struct rusage*, struct rusage*);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __JOBLOG_H__ */
@@ -0,0 +1,1459 @@
+/***************************************************************************
+ *  Title: Launch options
+ * -------------------------------------------------------------------------
+ *    Purpose: Resource limits and accounting for the jobs the shell
+ *    starts. A job with limits gets a cgroup v2 leaf of its own, which
+ *    caps and measures its whole process tree. Without a delegated
+ *    hierarchy the limits fall back to setrlimit in each process.
+ *    ulimit sets rlimits for the children, shell-wide or per command.
+ *    pin sets the cpu affinity and NUMA memory policy of a command, or
+ *    spreads the background jobs over the cores or nodes. Background
+ *    jobs can run with a lower scheduling class, nice and io priority.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: launch.c
+ ***************************************************************************/
+#define __LAUNCH_IMPL__
+#define _GNU_SOURCE
+
+/************System include***********************************************/
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <linux/ioprio.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "launch.h"
+#include "runtime.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* period of the cpu limit in microseconds */
+#define CPU_PERIOD 100000
+
+/* where the NUMA nodes are described */
+#define NODE_DIR "/sys/devices/system/node"
+
+/* how often a pipeline is sampled with shopt pipestats=on, in ms */
+#define PIPESTATS_PERIOD 10
+
+/* how pin auto= spreads the background jobs */
+#define PIN_OFF   0
+#define PIN_CORES 1
+#define PIN_NODES 2
+
+/* an rlimit ulimit knows about */
+typedef struct rlimit_s {
+  char opt;
+  int resource;
+  char* name;
+  /* bytes per unit of the values ulimit shows and takes */
+  rlim_t unit;
+} rlimitT;
+
+/* a stage of a sampled pipeline */
+typedef struct stage_s {
+  pid_t pid;
+  char* cmdline;
+  int files[NPROCFILES];
+  /* bytes read and written, from rchar and wchar */
+  long long in, out;
+  /* seconds it was seen blocked reading and writing */
+  double readWait, writeWait;
+  /* cpu time in clock ticks */
+  unsigned long long cpu;
+} stageT;
+
+/************Global Variables*********************************************/
+
+/* the cgroup holding the shell's job leaves, NULL if there is none */
+static char* jobsCgroup = NULL;
+/* the delegated cgroup and the leaf the shell moved into from it, NULL
+ * when the shell did not have to move */
+static char* baseCgroup = NULL;
+static char* shellCgroup = NULL;
+/* whether setting it up was tried already */
+static bool cgroupTried = FALSE;
+/* numbers the job leaves */
+static int cgroupSeq = 0;
+
+/* indexed like launchT.rlim */
+static rlimitT rlimits[NRLIMITS] = {
+  { 'n', RLIMIT_NOFILE, "open files",               1    },
+  { 't', RLIMIT_CPU,    "cpu time (seconds)",       1    },
+  { 'u', RLIMIT_NPROC,  "max user processes",       1    },
+  { 'v', RLIMIT_AS,     "virtual memory (kbytes)",  1024 },
+};
+
+/* the rlimits ulimit set for every command */
+static launchT defaults;
+
+/* /proc files kept open for jobs -l, at most half the fds the shell may
+ * have; past that they are opened for each read */
+static int procFilesKept = 0;
+static int procFilesMax = -1;
+
+/* the stages of the pipeline sampled, NULL if there is none */
+static stageT* stages = NULL;
+static int nstages = 0;
+static struct timespec stagesStart, lastSample;
+
+/* the pipe size of shopt pipesize, 0 for the default of the kernel, and
+ * /proc/sys/fs/pipe-max-size, -1 until read */
+static long long pipeSize = 0;
+static long long pipeMaxSize = -1;
+
+/* the pin auto= mode and the core or node it hands out next */
+static int pinAuto = PIN_OFF;
+static int pinNext = 0;
+
+/************Function Prototypes******************************************/
+/* the launch options of a command, created when needed */
+static launchT* CmdLaunch(commandT*);
+/* measures the limit prefix, -1 if it is invalid */
+static int LimitPrefix(commandT*);
+/* parses a NAME=value word of limit */
+static bool ParseLimit(launchT*, char*);
+/* parses ulimit options, setting limits or showing them */
+static bool ParseUlimit(char**, int, launchT*, bool);
+/* parses a value of ulimit */
+static bool ParseRlimit(char*, int, rlim_t*);
+static void PrintRlimit(int, int, bool);
+/* sets the rlimits of a launch in the current process */
+static void ApplyRlimits(launchT*);
+/* measures the pin prefix, -1 if it is invalid */
+static int PinPrefix(commandT*);
+/* parses a NAME=value word of pin */
+static bool ParsePin(launchT*, char*);
+static bool Pinned(launchT*);
+/* moves a thread to the background scheduling options or back, 0 for
+   the calling one */
+/* reads the priority of a thread and works out the background one */
+static void GetPriority(pid_t, prioT*);
+/* gives a thread the background priority of its entry */
+static bool Demote(pid_t, prioT*);
+/* undoes what Demote changed */
+static bool Restore(pid_t, prioT*);
+/* picks the next core or node for pin auto= */
+static bool AutoPlace(launchT*);
+/* the cpus of a set of nodes */
+static void NodeCpus(unsigned long, cpu_set_t*);
+/* parses a list like 0-3,8 */
+static bool ParseList(char*, cpu_set_t*);
+static void FormatList(cpu_set_t*, char*, size_t);
+/* parses a size like 512M or 2G */
+static bool ParseSize(char*, long long*);
+/* finds or creates the cgroup for the job leaves */
+static char* SetupJobsCgroup();
+/* finds the directory of the shell's own cgroup */
+static char* OwnCgroup();
+/* checks that a cgroup offers the memory and cpu controllers */
+static bool HasControllers(char*, char*);
+static bool WriteFile(char*, char*, char*);
+/* moves the shell and the processes it started from one cgroup to another */
+static bool MoveOwnProcs(char*, char*);
+/* whether a process is the shell or descends from it */
+static bool IsOwnProc(pid_t);
+static bool ReadFile(char*, char*, char*, size_t);
+/* prints a byte count with a unit */
+static void FormatSize(long long, char*, size_t);
+/* reads a /proc file of a process, opening it the first time */
+static bool ReadProcFile(pid_t, char*, int*, char*, size_t);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+bool CheckJobLimits(commandT** cmd, int n)
+{
+  launchT* launch;
+  int i;
+
+  for(i = 1; i < n; i++)
+  {
+    launch = cmd[i]->launch;
+    if(launch != NULL && (launch->mem > 0 || launch->cpu > 0 || launch->pipeSize > 0))
+    {
+      fprintf(stderr, "limit: mem=, cpu= and pipe= cover the whole pipeline, put them on its first command\n");
+      lastStatus = 2;
+      return FALSE;
+    }
+  }
+  return TRUE;
+}
+
+bool TakeLaunchPrefix(commandT* cmd)
+{
+  int i, k;
+
+  for(;;)
+  {
+    if(cmd->argc == 0)
+      return TRUE;
+    if(strcmp(cmd->argv[0], "limit") == 0)
+    {
+      k = LimitPrefix(cmd);
+    }
+    else if(strcmp(cmd->argv[0], "pin") == 0)
+    {
+      //pin alone or pin auto= is the builtin
+      if(cmd->argc == 1 || strncmp(cmd->argv[1], "auto=", 5) == 0)
+        return TRUE;
+      k = PinPrefix(cmd);
+    }
+    else if(strcmp(cmd->argv[0], "ulimit") == 0)
+    {
+      //without -- it is the builtin
+      for(k = 1; k < cmd->argc && strcmp(cmd->argv[k], "--") != 0; k++)
+        ;
+      if(k == cmd->argc)
+        return TRUE;
+      k = ParseUlimit(cmd->argv + 1, k - 1, CmdLaunch(cmd), FALSE) ? k + 1 : -1;
+    }
+    else
+    {
+      return TRUE;
+    }
+    if(k < 0)
+    {
+      lastStatus = 2;
+      return FALSE;
+    }
+    if(k >= cmd->argc)
+    {
+      fprintf(stderr, "%s: missing command\n", cmd->argv[0]);
+      lastStatus = 2;
+      return FALSE;
+    }
+
+    //drop the prefix, moving the terminating NULL along
+    for(i = 0; i < k && !cmd->shared; i++)
+      free(cmd->argv[i]);
+    memmove(&cmd->argv[0], &cmd->argv[k], sizeof(char*) * (cmd->argc - k + 1));
+    cmd->argc -= k;
+  }
+  return TRUE;
+}
+
+char* CreateJobCgroup(launchT* launch)
+{
+  char path[PATH_MAX];
+  char value[64];
+
+  if(launch == NULL || (launch->mem == 0 && launch->cpu == 0))
+    return NULL;
+  if(SetupJobsCgroup() == NULL)
+  {
+    if(launch->cpu > 0)
+      fprintf(stderr, "limit: cgroup v2 is not available, cpu= is not enforced\n");
+    return NULL;
+  }
+
+  snprintf(path, sizeof(path), "%s/job%d", jobsCgroup, ++cgroupSeq);
+  if(mkdir(path, 0755) < 0)
+    return NULL;
+  if(launch->mem > 0)
+  {
+    snprintf(value, sizeof(value), "%lld", launch->mem);
+    WriteFile(path, "memory.max", value);
+  }
+  if(launch->cpu > 0)
+  {
+    snprintf(value, sizeof(value), "%lld %d", (long long) launch->cpu * CPU_PERIOD / 100, CPU_PERIOD);
+    WriteFile(path, "cpu.max", value);
+  }
+  return strdup(path);
+}
+
+char* PlaceJob(commandT** cmd, int n, bool bg)
+{
+  launchT place;
+  launchT* launch;
+  char buf[512], list[256];
+  int i;
+
+  //an explicit pin on any stage keeps the whole job out of the rotation
+  for(i = 0; i < n && !Pinned(cmd[i]->launch); i++)
+    ;
+  if(i == n && bg && pinAuto != PIN_OFF && AutoPlace(&place))
+  {
+    for(i = 0; i < n; i++)
+    {
+      launch = CmdLaunch(cmd[i]);
+      launch->pinCpus = place.pinCpus;
+      launch->cpus = place.cpus;
+      launch->nodes = place.nodes;
+      launch->mempolicy = place.mempolicy;
+    }
+    i = 0;
+  }
+  if(i == n)
+    return NULL;
+
+  launch = cmd[i]->launch;
+  buf[0] = '\0';
+  if(launch->pinCpus)
+  {
+    FormatList(&launch->cpus, list, sizeof(list));
+    snprintf(buf, sizeof(buf), "cpus=%s", list);
+  }
+  if(launch->nodes != 0)
+  {
+    CPU_ZERO(&place.cpus);
+    for(i = 0; i < (int) sizeof(launch->nodes) * 8; i++)
+      if(launch->nodes & (1UL << i))
+        CPU_SET(i, &place.cpus);
+    FormatList(&place.cpus, list, sizeof(list));
+    snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), "%snodes=%s mem=%s", buf[0] ? " " : "", list,
+             launch->mempolicy == MPOL_INTERLEAVE ? "interleave" : launch->mempolicy == MPOL_PREFERRED ? "preferred" : "bind");
+  }
+  return strdup(buf);
+}
+
+bool ScheduleJob(commandT** cmd, int n, bool bg)
+{
+  int i;
+
+  if(!bg || !BGSCHED_ON())
+    return FALSE;
+  for(i = 0; i < n; i++)
+    CmdLaunch(cmd[i])->demote = TRUE;
+  return TRUE;
+}
+
+void LaunchPriority(prioT* prio)
+{
+  GetPriority(0, prio);
+}
+
+/*The scheduling class is per thread and there is no call for a whole
+ *group, so the threads of each process are walked*/
+bool SetJobPriority(pid_t* pids, int npids, prioT** prio, int* nprio, bool background)
+{
+  DIR* tasks;
+  struct dirent* task;
+  char path[PATH_MAX];
+  prioT *entry, *own, *shared;
+  pid_t tid;
+  int i, k;
+  bool ok = TRUE;
+
+  for(i = 0; i < npids; i++)
+  {
+    snprintf(path, sizeof(path), "/proc/%d/task", (int) pids[i]);
+    if((tasks = opendir(path)) == NULL)
+      continue;
+    while((task = readdir(tasks)) != NULL)
+    {
+      if(task->d_name[0] < '0' || task->d_name[0] > '9')
+        continue;
+      tid = atoi(task->d_name);
+      //the thread's own entry, else that of its process, which it was
+      //started from, else the one of a job demoted as it started
+      entry = own = shared = NULL;
+      for(k = 0; k < *nprio; k++)
+      {
+        if((*prio)[k].tid == tid) entry = &(*prio)[k];
+        if((*prio)[k].tid == pids[i]) own = &(*prio)[k];
+        if((*prio)[k].tid == 0) shared = &(*prio)[k];
+      }
+      if(background && entry == NULL)
+      {
+        *prio = realloc(*prio, sizeof(prioT) * (*nprio + 1));
+        entry = &(*prio)[(*nprio)++];
+        GetPriority(tid, entry);
+        ok &= Demote(tid, entry);
+      }
+      else if(!background)
+      {
+        entry = entry != NULL ? entry : own != NULL ? own : shared;
+        if(entry != NULL)
+          ok &= Restore(tid, entry);
+      }
+    }
+    closedir(tasks);
+  }
+  if(!background)
+  {
+    free(*prio);
+    *prio = NULL;
+    *nprio = 0;
+  }
+  return ok;
+}
+
+int RunPin(commandT* cmd)
+{
+  cpu_set_t set;
+  char list[256], buf[256];
+  char* modes[] = { "off", "cores", "nodes" };
+  int mode;
+
+  if(cmd->argc == 1)
+  {
+    sched_getaffinity(0, sizeof(set), &set);
+    FormatList(&set, list, sizeof(list));
+    printf("auto=%s cpus=%s", modes[pinAuto], list);
+    if(ReadFile(NODE_DIR, "online", buf, sizeof(buf)))
+      printf(" nodes=%s", strtok(buf, "\n"));
+    printf("\n");
+    fflush(stdout);
+    return 0;
+  }
+
+  for(mode = PIN_OFF; mode <= PIN_NODES && strcmp(cmd->argv[1] + 5, modes[mode]) != 0; mode++)
+    ;
+  if(mode > PIN_NODES || cmd->argc > 2)
+  {
+    fprintf(stderr, "pin: usage: pin auto=off|cores|nodes\n");
+    return 2;
+  }
+  if(mode == PIN_NODES && !ReadFile(NODE_DIR, "online", buf, sizeof(buf)))
+  {
+    fprintf(stderr, "pin: no NUMA nodes on this machine\n");
+    return 1;
+  }
+  pinAuto = mode;
+  pinNext = 0;
+  return 0;
+}
+
+int RunUlimit(commandT* cmd)
+{
+  bool ok = ParseUlimit(cmd->argv + 1, cmd->argc - 1, &defaults, TRUE);
+
+  fflush(stdout);
+  return ok ? 0 : 1;
+}
+
+void EnterLaunch(launchT* launch, char* cgroup)
+{
+  struct rlimit rl;
+  prioT prio;
+
+  ApplyRlimits(&defaults);
+  if(launch != NULL)
+    ApplyRlimits(launch);
+
+  //the memory policy is inherited over exec like the affinity, so
+  //everything the command allocates lands on its nodes without mbind
+  if(launch != NULL && launch->pinCpus && sched_setaffinity(0, sizeof(launch->cpus), &launch->cpus) < 0)
+    fprintf(stderr, "pin: sched_setaffinity: %s\n", strerror(errno));
+  if(launch != NULL && launch->nodes != 0
+     && syscall(SYS_set_mempolicy, launch->mempolicy, &launch->nodes, sizeof(launch->nodes) * 8 + 1) < 0)
+    fprintf(stderr, "pin: set_mempolicy: %s\n", strerror(errno));
+  if(launch != NULL && launch->demote)
+  {
+    GetPriority(0, &prio);
+    Demote(0, &prio);
+  }
+
+  //joining from the child itself leaves no moment outside the cgroup
+  if(cgroup != NULL && WriteFile(cgroup, "cgroup.procs", "0"))
+    return;
+  //setrlimit can only cap the address space of each process
+  if(launch != NULL && launch->mem > 0)
+  {
+    rl.rlim_cur = rl.rlim_max = launch->mem;
+    setrlimit(RLIMIT_AS, &rl);
+  }
+}
+
+bool PlainLaunch(launchT* launch, char* cgroup)
+{
+  int r;
+
+  if(cgroup != NULL)
+    return FALSE;
+  for(r = 0; r < NRLIMITS; r++)
+  {
+    if(defaults.rlimSet[r] != 0 || (launch != NULL && launch->rlimSet[r] != 0))
+      return FALSE;
+  }
+  return launch == NULL || (!launch->pinCpus && launch->nodes == 0 && !launch->demote && launch->mem == 0);
+}
+
+void RemoveJobCgroup(char* cgroup)
+{
+  if(cgroup == NULL)
+    return;
+  rmdir(cgroup);
+  free(cgroup);
+}
+
+void PrintJobUsage(char* cgroup)
+{
+  char buf[256], peak[32], max[32];
+  char *usage;
+  long long cpu = 0, quota, period;
+
+  if(cgroup == NULL)
+  {
+    printf("    no cgroup, usage not measured\n");
+    return;
+  }
+
+  strcpy(peak, "?");
+  if(ReadFile(cgroup, "memory.peak", buf, sizeof(buf)))
+    FormatSize(atoll(buf), peak, sizeof(peak));
+  strcpy(max, "unlimited");
+  if(ReadFile(cgroup, "memory.max", buf, sizeof(buf)) && strncmp(buf, "max", 3) != 0)
+    FormatSize(atoll(buf), max, sizeof(max));
+  if(ReadFile(cgroup, "cpu.stat", buf, sizeof(buf)) && (usage = strstr(buf, "usage_usec ")) != NULL)
+    cpu = atoll(usage + 11);
+
+  printf("    mem %s peak of %s, cpu %lld.%02llds", peak, max, cpu / 1000000, cpu / 10000 % 100);
+  if(ReadFile(cgroup, "cpu.max", buf, sizeof(buf)) && sscanf(buf, "%lld %lld", &quota, &period) == 2)
+    printf(" at most %lld%%", quota * 100 / period);
+  printf("\n");
+}
+
+bool ReadProcStat(pid_t pid, int* files, pid_t pgid, procstatT* sum)
+{
+  char buf[4096], name[64], *p, *end;
+  unsigned long long utime, stime, start;
+  long long cutime, cstime, rss;
+  int pgrp, kin[NPROCFILES];
+  long child;
+
+  //the name may hold spaces and parentheses, the fields start after the last ')'
+  if(!ReadProcFile(pid, "stat", &files[PROC_STAT], buf, sizeof(buf)) || (p = strrchr(buf, ')')) == NULL)
+    return FALSE;
+  if(sscanf(p + 2, "%*c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu %lld %lld %*d %*d %*d %*d %llu",
+            &pgrp, &utime, &stime, &cutime, &cstime, &start) != 6 || pgrp != pgid)
+    return FALSE;
+  memset(kin, -1, sizeof(kin));
+  if(sum->nprocs == 0 || start < sum->start)
+    sum->start = start;
+  sum->cpu += utime + stime + cutime + cstime;
+  sum->nprocs++;
+  //a zombie has no memory left
+  if(ReadProcFile(pid, "statm", &files[PROC_STATM], buf, sizeof(buf)) && sscanf(buf, "%*d %lld", &rss) == 1)
+    sum->rss += rss * sysconf(_SC_PAGESIZE);
+  //only readable for processes we may trace
+  if(ReadProcFile(pid, "io", &files[PROC_IO], buf, sizeof(buf)))
+  {
+    if((p = strstr(buf, "\nread_bytes: ")) != NULL)
+      sum->readBytes += atoll(p + 13);
+    if((p = strstr(buf, "\nwrite_bytes: ")) != NULL)
+      sum->writeBytes += atoll(p + 14);
+  }
+  //what it started itself, unless it became a job of its own; they come
+  //and go, so their files are not kept
+  snprintf(name, sizeof(name), "task/%d/children", pid);
+  if(ReadProcFile(pid, name, &files[PROC_CHILDREN], buf, sizeof(buf)))
+  {
+    for(p = buf; (child = strtol(p, &end, 10)) > 0; p = end)
+    {
+      ReadProcStat(child, kin, pgid, sum);
+      CloseProcFiles(kin);
+    }
+  }
+  return TRUE;
+}
+
+void CloseProcFiles(int* files)
+{
+  int i;
+
+  for(i = 0; i < NPROCFILES; i++)
+  {
+    if(files[i] >= 0)
+    {
+      close(files[i]);
+      procFilesKept--;
+    }
+    files[i] = -1;
+  }
+}
+
+void PrintJobStats(procstatT* sum)
+{
+  struct timespec now;
+  unsigned long long ticks, elapsed;
+  long hz = sysconf(_SC_CLK_TCK);
+  char rss[32], rd[32], wr[32];
+
+  if(sum->nprocs == 0)
+    return;
+  //the start times count from boot, suspended time included
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  ticks = now.tv_sec * hz + now.tv_nsec / (1000000000 / hz);
+  elapsed = ticks > sum->start ? ticks - sum->start : 0;
+  FormatSize(sum->rss, rss, sizeof(rss));
+  FormatSize(sum->readBytes, rd, sizeof(rd));
+  FormatSize(sum->writeBytes, wr, sizeof(wr));
+  printf("    up %llu:%02llu:%02llu, cpu %.1f%%, rss %s, io %s read %s written\n",
+         elapsed / hz / 3600, elapsed / hz / 60 % 60, elapsed / hz % 60,
+         elapsed > 0 ? 100.0 * sum->cpu / elapsed : 0.0, rss, rd, wr);
+}
+
+void StartPipeStats(commandT** cmd, pid_t* pids, int n)
+{
+  int i;
+
+  EndPipeStats(FALSE);
+  if(!pipeStats)
+    return;
+  stages = (stageT*) calloc(n, sizeof(stageT));
+  nstages = n;
+  for(i = 0; i < n; i++)
+  {
+    stages[i].pid = pids[i];
+    stages[i].cmdline = strdup(cmd[i]->cmdline);
+    memset(stages[i].files, -1, sizeof(stages[i].files));
+  }
+  clock_gettime(CLOCK_MONOTONIC, &stagesStart);
+  lastSample = stagesStart;
+  //the files are opened while every process is still there to be read
+  SamplePipeStats();
+}
+
+int SamplePipeStats()
+{
+  struct timespec now;
+  char buf[1024], *p;
+  unsigned long long utime, stime;
+  double dt;
+  long nr;
+  int i;
+
+  if(stages == NULL)
+    return -1;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  dt = (now.tv_sec - lastSample.tv_sec) + (now.tv_nsec - lastSample.tv_nsec) / 1e9;
+  lastSample = now;
+  for(i = 0; i < nstages; i++)
+  {
+    //the files stay open, a reaped stage keeps its last figures and a new
+    //process with its pid is never read
+    if(stages[i].pid <= 0 || !ReadProcFile(stages[i].pid, "stat", &stages[i].files[PROC_STAT], buf, sizeof(buf)))
+      continue;
+    if((p = strrchr(buf, ')')) != NULL &&
+       sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) == 2)
+      stages[i].cpu = utime + stime;
+    if(ReadProcFile(stages[i].pid, "io", &stages[i].files[PROC_IO], buf, sizeof(buf)))
+    {
+      if((p = strstr(buf, "rchar: ")) != NULL)
+        stages[i].in = atoll(p + 7);
+      if((p = strstr(buf, "wchar: ")) != NULL)
+        stages[i].out = atoll(p + 7);
+    }
+    //"running", or the number of the system call it sleeps in
+    if(ReadProcFile(stages[i].pid, "syscall", &stages[i].files[PROC_SYSCALL], buf, sizeof(buf)) &&
+       buf[0] >= '0' && buf[0] <= '9')
+    {
+      nr = atol(buf);
+      if(nr == SYS_read || nr == SYS_readv || nr == SYS_pread64)
+        stages[i].readWait += dt;
+      else if(nr == SYS_write || nr == SYS_writev || nr == SYS_pwrite64)
+        stages[i].writeWait += dt;
+    }
+  }
+  return PIPESTATS_PERIOD;
+}
+
+void EndPipeStats(bool print)
+{
+  struct timespec now;
+  long hz = sysconf(_SC_CLK_TCK);
+  char in[32], out[32];
+  int i;
+
+  if(stages == NULL)
+    return;
+  if(print)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    fflush(stdout);
+    fprintf(stderr, "%-6s%-8s%-10s%-10s%-11s%-11s%-9s%s\n",
+            "stage", "pid", "in", "out", "read-wait", "write-wait", "cpu", "command");
+    for(i = 0; i < nstages; i++)
+    {
+      if(stages[i].pid <= 0)
+      {
+        fprintf(stderr, "%-6d%-8s%-10s%-10s%-11s%-11s%-9s%s\n", i + 1, "-", "-", "-", "-", "-", "-", stages[i].cmdline);
+        continue;
+      }
+      FormatSize(stages[i].in, in, sizeof(in));
+      FormatSize(stages[i].out, out, sizeof(out));
+      fprintf(stderr, "%-6d%-8d%-10s%-10s%-11.2f%-11.2f%-9.2f%s\n", i + 1, stages[i].pid, in, out,
+              stages[i].readWait, stages[i].writeWait, (double) stages[i].cpu / hz, stages[i].cmdline);
+    }
+    fprintf(stderr, "wall %.2fs, sampled every %dms\n",
+            (now.tv_sec - stagesStart.tv_sec) + (now.tv_nsec - stagesStart.tv_nsec) / 1e9, PIPESTATS_PERIOD);
+  }
+  for(i = 0; i < nstages; i++)
+  {
+    CloseProcFiles(stages[i].files);
+    free(stages[i].cmdline);
+  }
+  free(stages);
+  stages = NULL;
+  nstages = 0;
+}
+
+bool SetPipeSize(char* text)
+{
+  long long size = 0;
+
+  if(strcmp(text, "off") != 0 && !ParseSize(text, &size))
+  {
+    fprintf(stderr, "shopt: pipesize: invalid size '%s'\n", text);
+    return FALSE;
+  }
+  pipeSize = size;
+  free(pipeSizeText);
+  pipeSizeText = size > 0 ? strdup(text) : NULL;
+  return TRUE;
+}
+
+void GrowPipe(int fd, launchT* launch)
+{
+  long long size = launch != NULL && launch->pipeSize > 0 ? launch->pipeSize : pipeSize;
+  char buf[32];
+
+  if(size == 0)
+    return;
+  if(pipeMaxSize < 0)
+  {
+    //the default of the kernel when it cannot be read
+    pipeMaxSize = ReadFile("/proc/sys/fs", "pipe-max-size", buf, sizeof(buf)) && atoll(buf) > 0
+                  ? atoll(buf) : 1024 * 1024;
+  }
+  if(size > pipeMaxSize)
+    size = pipeMaxSize;
+  //the kernel rounds up to a power of two of pages, and refuses when the
+  //user has more than fs/pipe-user-pages-soft in pipes; the pipe still works
+  fcntl(fd, F_SETPIPE_SZ, (int) size);
+}
+
+void CleanupLaunch()
+{
+  if(jobsCgroup != NULL)
+    rmdir(jobsCgroup);
+  free(jobsCgroup);
+  jobsCgroup = NULL;
+  //the leaf the shell parked in goes too; the base takes processes again
+  //only once no other shell there uses its controllers
+  if(shellCgroup != NULL)
+  {
+    WriteFile(baseCgroup, "cgroup.subtree_control", "-memory -cpu");
+    if(MoveOwnProcs(shellCgroup, baseCgroup))
+      rmdir(shellCgroup);
+  }
+  free(shellCgroup);
+  free(baseCgroup);
+  shellCgroup = baseCgroup = NULL;
+}
+
+static launchT* CmdLaunch(commandT* cmd)
+{
+  if(cmd->launch == NULL)
+    cmd->launch = (launchT*) calloc(1, sizeof(launchT));
+  return cmd->launch;
+}
+
+/*NAME=value words up to -- or the first word that is not one*/
+static int LimitPrefix(commandT* cmd)
+{
+  int k;
+
+  for(k = 1; k < cmd->argc; k++)
+  {
+    if(strcmp(cmd->argv[k], "--") == 0)
+      return k + 1;
+    if(strchr(cmd->argv[k], '=') == NULL)
+      break;
+    if(!ParseLimit(CmdLaunch(cmd), cmd->argv[k]))
+    {
+      fprintf(stderr, "limit: invalid limit '%s'\n", cmd->argv[k]);
+      return -1;
+    }
+  }
+  return k;
+}
+
+static bool ParseLimit(launchT* launch, char* word)
+{
+  char* end;
+
+  if(strncmp(word, "mem=", 4) == 0)
+    return ParseSize(word + 4, &launch->mem);
+  if(strncmp(word, "pipe=", 5) == 0)
+    return ParseSize(word + 5, &launch->pipeSize);
+  if(strncmp(word, "cpu=", 4) == 0)
+  {
+    launch->cpu = (int) strtol(word + 4, &end, 10);
+    return end != word + 4 && launch->cpu > 0 && (*end == '\0' || strcmp(end, "%") == 0);
+  }
+  return FALSE;
+}
+
+/*NAME=value words like limit; nodes= alone also pins to the cpus of the
+ *nodes*/
+static int PinPrefix(commandT* cmd)
+{
+  launchT* launch = CmdLaunch(cmd);
+  int k;
+
+  for(k = 1; k < cmd->argc && strcmp(cmd->argv[k], "--") != 0 && strchr(cmd->argv[k], '=') != NULL; k++)
+  {
+    if(!ParsePin(launch, cmd->argv[k]))
+    {
+      fprintf(stderr, "pin: invalid placement '%s'\n", cmd->argv[k]);
+      return -1;
+    }
+  }
+  if(launch->mempolicy != MPOL_DEFAULT && launch->nodes == 0)
+  {
+    fprintf(stderr, "pin: mem= needs nodes=\n");
+    return -1;
+  }
+  if(launch->nodes != 0 && launch->mempolicy == MPOL_DEFAULT)
+    launch->mempolicy = MPOL_BIND;
+  if(launch->nodes != 0 && !launch->pinCpus)
+  {
+    NodeCpus(launch->nodes, &launch->cpus);
+    launch->pinCpus = CPU_COUNT(&launch->cpus) > 0;
+  }
+  return k < cmd->argc && strcmp(cmd->argv[k], "--") == 0 ? k + 1 : k;
+}
+
+static bool ParsePin(launchT* launch, char* word)
+{
+  cpu_set_t set, allowed;
+  char node[32], buf[1024];
+  int i;
+
+  if(strncmp(word, "cpus=", 5) == 0)
+  {
+    //only the cpus the shell may use, a child could not get others
+    if(!ParseList(word + 5, &launch->cpus) || sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+      return FALSE;
+    CPU_AND(&launch->cpus, &launch->cpus, &allowed);
+    launch->pinCpus = TRUE;
+    return CPU_COUNT(&launch->cpus) > 0;
+  }
+  if(strncmp(word, "nodes=", 6) == 0)
+  {
+    if(!ParseList(word + 6, &set))
+      return FALSE;
+    launch->nodes = 0;
+    for(i = 0; i < CPU_SETSIZE; i++)
+    {
+      if(!CPU_ISSET(i, &set))
+        continue;
+      //every node the machine has comes with a cpulist
+      snprintf(node, sizeof(node), "node%d/cpulist", i);
+      if(i >= (int) sizeof(launch->nodes) * 8 || !ReadFile(NODE_DIR, node, buf, sizeof(buf)))
+        return FALSE;
+      launch->nodes |= 1UL << i;
+    }
+    return TRUE;
+  }
+  if(strcmp(word, "mem=bind") == 0)
+    launch->mempolicy = MPOL_BIND;
+  else if(strcmp(word, "mem=interleave") == 0)
+    launch->mempolicy = MPOL_INTERLEAVE;
+  else if(strcmp(word, "mem=preferred") == 0)
+    launch->mempolicy = MPOL_PREFERRED;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+/*Options that are off leave that part of the priority as it is*/
+static void GetPriority(pid_t tid, prioT* prio)
+{
+  prio->tid = tid;
+  prio->policy = sched_getscheduler(tid) & ~SCHED_RESET_ON_FORK;
+  errno = 0;
+  prio->nice = getpriority(PRIO_PROCESS, tid);
+  if(errno != 0)
+    prio->nice = 0;
+  prio->ioprio = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid);
+
+  //a real-time class is left to whoever gave it
+  prio->bgPolicy = prio->policy;
+  if(prio->policy == SCHED_OTHER || prio->policy == SCHED_BATCH || prio->policy == SCHED_IDLE)
+  {
+    if(bgSched == BGSCHED_BATCH) prio->bgPolicy = SCHED_BATCH;
+    if(bgSched == BGSCHED_IDLE) prio->bgPolicy = SCHED_IDLE;
+  }
+  prio->bgNice = prio->nice + bgNice > 19 ? 19 : prio->nice + bgNice;
+  prio->bgIoprio = prio->ioprio;
+  if(bgIoprio == BGIOPRIO_IDLE)
+    prio->bgIoprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 0);
+  else if(bgIoprio >= BGIOPRIO_BE)
+    prio->bgIoprio = IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, bgIoprio - BGIOPRIO_BE);
+}
+
+/*A thread that is gone has nothing left to change*/
+static bool Demote(pid_t tid, prioT* prio)
+{
+  struct sched_param param = { 0 };
+  bool ok = TRUE;
+
+  if(prio->bgPolicy != prio->policy && sched_setscheduler(tid, prio->bgPolicy, &param) < 0)
+    ok &= errno == ESRCH;
+  if(prio->bgNice != prio->nice && setpriority(PRIO_PROCESS, tid, prio->bgNice) < 0)
+    ok &= errno == ESRCH;
+  if(prio->bgIoprio != prio->ioprio && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, prio->bgIoprio) < 0)
+    ok &= errno == ESRCH;
+  return ok;
+}
+
+/*What the job changed since is left alone: a class or io priority only
+ *goes back while it is still the one that was set, and the nice value
+ *goes down by what was added, which keeps a nice -n the job ran itself.
+ *An unprivileged user may only raise a nice value, so EACCES and EPERM
+ *are expected there and leave the job at the background one.*/
+static bool Restore(pid_t tid, prioT* prio)
+{
+  struct sched_param param = { 0 };
+  int nice;
+  bool ok = TRUE;
+
+  if(prio->bgPolicy != prio->policy && sched_getscheduler(tid) == prio->bgPolicy
+     && sched_setscheduler(tid, prio->policy, &param) < 0)
+    ok &= errno == ESRCH;
+  if(prio->bgNice != prio->nice)
+  {
+    errno = 0;
+    nice = getpriority(PRIO_PROCESS, tid);
+    if(errno == 0)
+    {
+      nice -= prio->bgNice - prio->nice;
+      if(nice < -20) nice = -20;
+      if(setpriority(PRIO_PROCESS, tid, nice) < 0)
+        ok &= errno == ESRCH || errno == EACCES || errno == EPERM;
+    }
+  }
+  if(prio->bgIoprio != prio->ioprio && syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, tid) == prio->bgIoprio
+     && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, prio->ioprio) < 0)
+    ok &= errno == ESRCH;
+  return ok;
+}
+
+static bool Pinned(launchT* launch)
+{
+  return launch != NULL && (launch->pinCpus || launch->nodes != 0);
+}
+
+/*cores: the next cpu the shell may use; nodes: the cpus of the next online
+ *node and a preference for its memory*/
+static bool AutoPlace(launchT* place)
+{
+  cpu_set_t allowed, set;
+  char buf[256];
+  int i, k, count;
+
+  memset(place, 0, sizeof(*place));
+  if(sched_getaffinity(0, sizeof(allowed), &allowed) < 0)
+    return FALSE;
+  if(pinAuto == PIN_NODES)
+  {
+    if(!ReadFile(NODE_DIR, "online", buf, sizeof(buf)) || !ParseList(strtok(buf, "\n"), &set))
+      return FALSE;
+  }
+  else
+  {
+    set = allowed;
+  }
+  if((count = CPU_COUNT(&set)) == 0)
+    return FALSE;
+
+  //the k-th member of the set, turn by turn
+  k = pinNext++ % count;
+  for(i = 0; !CPU_ISSET(i, &set) || k-- > 0; i++)
+    ;
+
+  CPU_ZERO(&place->cpus);
+  if(pinAuto == PIN_NODES)
+  {
+    if(i >= (int) sizeof(place->nodes) * 8)
+      return FALSE;
+    place->nodes = 1UL << i;
+    place->mempolicy = MPOL_PREFERRED;
+    NodeCpus(place->nodes, &place->cpus);
+    CPU_AND(&place->cpus, &place->cpus, &allowed);
+  }
+  else
+  {
+    CPU_SET(i, &place->cpus);
+  }
+  place->pinCpus = CPU_COUNT(&place->cpus) > 0;
+  return TRUE;
+}
+
+static void NodeCpus(unsigned long nodes, cpu_set_t* cpus)
+{
+  cpu_set_t set;
+  char file[32], buf[1024];
+  int i;
+
+  CPU_ZERO(cpus);
+  for(i = 0; i < (int) sizeof(nodes) * 8; i++)
+  {
+    if(!(nodes & (1UL << i)))
+      continue;
+    snprintf(file, sizeof(file), "node%d/cpulist", i);
+    if(ReadFile(NODE_DIR, file, buf, sizeof(buf)) && ParseList(strtok(buf, "\n"), &set))
+      CPU_OR(cpus, cpus, &set);
+  }
+}
+
+/*Comma separated numbers and ranges, as in cpulist files*/
+static bool ParseList(char* text, cpu_set_t* set)
+{
+  char* end;
+  long from, to;
+
+  CPU_ZERO(set);
+  if(text == NULL || *text == '\0')
+    return FALSE;
+  for(;;)
+  {
+    from = to = strtol(text, &end, 10);
+    if(end == text || from < 0)
+      return FALSE;
+    if(*end == '-')
+    {
+      text = end + 1;
+      to = strtol(text, &end, 10);
+      if(end == text || to < from)
+        return FALSE;
+    }
+    if(to >= CPU_SETSIZE)
+      return FALSE;
+    for(; from <= to; from++)
+      CPU_SET(from, set);
+    if(*end == '\0')
+      return TRUE;
+    if(*end != ',')
+      return FALSE;
+    text = end + 1;
+  }
+}
+
+static void FormatList(cpu_set_t* set, char* buf, size_t size)
+{
+  int i, j;
+  size_t len = 0;
+
+  buf[0] = '\0';
+  for(i = 0; i < CPU_SETSIZE && len < size; i = j)
+  {
+    if(!CPU_ISSET(i, set))
+    {
+      j = i + 1;
+      continue;
+    }
+    for(j = i + 1; j < CPU_SETSIZE && CPU_ISSET(j, set); j++)
+      ;
+    if(j - 1 > i)
+      len += snprintf(buf + len, size - len, "%s%d-%d", len ? "," : "", i, j - 1);
+    else
+      len += snprintf(buf + len, size - len, "%s%d", len ? "," : "", i);
+  }
+}
+
+/*Options like bash: -S and -H pick the side, -a shows everything and
+ *each of -n, -t, -u and -v takes a value or shows the current one*/
+static bool ParseUlimit(char** args, int n, launchT* into, bool show)
+{
+  int i, r, which = 0;
+  bool all = (n == 0);
+  char* a;
+  rlim_t value;
+
+  for(i = 0; i < n; i++)
+  {
+    a = args[i];
+    if(a[0] != '-' || a[1] == '\0')
+    {
+      fprintf(stderr, "ulimit: invalid argument '%s'\n", a);
+      return FALSE;
+    }
+    for(a++; *a != '\0'; a++)
+    {
+      if(*a == 'S' || *a == 'H')
+      {
+        which |= (*a == 'S') ? LIMIT_SOFT : LIMIT_HARD;
+        continue;
+      }
+      if(*a == 'a')
+      {
+        all = TRUE;
+        continue;
+      }
+      for(r = 0; r < NRLIMITS && rlimits[r].opt != *a; r++)
+        ;
+      if(r == NRLIMITS)
+      {
+        fprintf(stderr, "ulimit: invalid option '-%c'\n", *a);
+        return FALSE;
+      }
+      if(i + 1 < n && args[i + 1][0] != '-')
+      {
+        if(!ParseRlimit(args[++i], r, &value))
+          return FALSE;
+        into->rlimSet[r] = which != 0 ? which : LIMIT_SOFT | LIMIT_HARD;
+        into->rlim[r] = value;
+      }
+      else if(show)
+      {
+        PrintRlimit(r, which, FALSE);
+      }
+      else
+      {
+        fprintf(stderr, "ulimit: -%c needs a value\n", *a);
+        return FALSE;
+      }
+    }
+  }
+  if(show && all)
+    for(r = 0; r < NRLIMITS; r++)
+      PrintRlimit(r, which, TRUE);
+  return TRUE;
+}
+
+/*A count in the unit of the limit or unlimited, no higher than the shell's
+ *hard limit since a child could not raise it*/
+static bool ParseRlimit(char* text, int r, rlim_t* value)
+{
+  char* end;
+  unsigned long long n;
+  struct rlimit rl;
+
+  if(strcmp(text, "unlimited") == 0)
+  {
+    *value = RLIM_INFINITY;
+  }
+  else
+  {
+    n = strtoull(text, &end, 10);
+    if(end == text || *end != '\0' || *text == '-')
+    {
+      fprintf(stderr, "ulimit: %s: invalid number\n", text);
+      return FALSE;
+    }
+    *value = n * rlimits[r].unit;
+  }
+  getrlimit(rlimits[r].resource, &rl);
+  if(geteuid() != 0 && rl.rlim_max != RLIM_INFINITY && (*value == RLIM_INFINITY || *value > rl.rlim_max))
+  {
+    fprintf(stderr, "ulimit: %s: cannot raise the hard limit\n", rlimits[r].name);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static void PrintRlimit(int r, int which, bool label)
+{
+  struct rlimit rl;
+  rlim_t value;
+
+  getrlimit(rlimits[r].resource, &rl);
+  value = (which & LIMIT_HARD) ? rl.rlim_max : rl.rlim_cur;
+  //what ulimit set overrides what the shell itself has
+  if(defaults.rlimSet[r] & ((which & LIMIT_HARD) ? LIMIT_HARD : LIMIT_SOFT))
+    value = defaults.rlim[r];
+
+  if(label)
+    printf("%-28s(-%c) ", rlimits[r].name, rlimits[r].opt);
+  if(value == RLIM_INFINITY)
+    printf("unlimited\n");
+  else
+    printf("%llu\n", (unsigned long long) (value / rlimits[r].unit));
+}
+
+static void ApplyRlimits(launchT* launch)
+{
+  int r;
+  struct rlimit rl;
+
+  for(r = 0; r < NRLIMITS; r++)
+  {
+    if(launch->rlimSet[r] == 0)
+      continue;
+    getrlimit(rlimits[r].resource, &rl);
+    if(launch->rlimSet[r] & LIMIT_HARD)
+    {
+      rl.rlim_max = launch->rlim[r];
+      if(rl.rlim_cur > rl.rlim_max) rl.rlim_cur = rl.rlim_max;
+    }
+    if(launch->rlimSet[r] & LIMIT_SOFT)
+      rl.rlim_cur = launch->rlim[r];
+    setrlimit(rlimits[r].resource, &rl);
+  }
+}
+
+/*A number with an optional K, M, G or T suffix*/
+static bool ParseSize(char* text, long long* size)
+{
+  char* end;
+  long long n = strtoll(text, &end, 10);
+
+  if(end == text || n <= 0) return FALSE;
+  switch(*end)
+  {
+    //each unit falls through to the ones below it
+    case 'T': case 't': n *= 1024;
+    case 'G': case 'g': n *= 1024;
+    case 'M': case 'm': n *= 1024;
+    case 'K': case 'k': n *= 1024;
+      end++;
+    default:
+      break;
+  }
+  if(*end == 'B' || *end == 'b') end++;
+  *size = n;
+  return *end == '\0';
+}
+
+/*The job leaves live in tsh-<pid> below the delegated cgroup. cgroup v2
+ *only hands controllers to children of a cgroup without processes, so when
+ *the shell sits in the delegated cgroup itself it moves into a leaf first,
+ *along with what it started before, like the zygote and coprocs.*/
+static char* SetupJobsCgroup()
+{
+  char *base, *env = getenv("TSH_CGROUP");
+  char path[PATH_MAX];
+
+  if(cgroupTried)
+    return jobsCgroup;
+  cgroupTried = TRUE;
+
+  base = (env != NULL && *env != '\0') ? strdup(env) : OwnCgroup();
+  if(base == NULL || !HasControllers(base, "cgroup.controllers"))
+  {
+    free(base);
+    return NULL;
+  }
+
+  if(!HasControllers(base, "cgroup.subtree_control")
+      && !WriteFile(base, "cgroup.subtree_control", "+memory +cpu"))
+  {
+    //the shell is in the way, park it in a leaf of its own
+    snprintf(path, sizeof(path), "%s/tsh-shell-%d", base, (int) getpid());
+    if(mkdir(path, 0755) < 0 && errno != EEXIST)
+    {
+      free(base);
+      return NULL;
+    }
+    baseCgroup = strdup(base);
+    shellCgroup = strdup(path);
+    if(!MoveOwnProcs(base, path) || !WriteFile(base, "cgroup.subtree_control", "+memory +cpu"))
+    {
+      free(base);
+      return NULL;
+    }
+  }
+
+  snprintf(path, sizeof(path), "%s/tsh-%d", base, (int) getpid());
+  free(base);
+  if(mkdir(path, 0755) < 0 && errno != EEXIST)
+    return NULL;
+  if(!WriteFile(path, "cgroup.subtree_control", "+memory +cpu"))
+  {
+    rmdir(path);
+    return NULL;
+  }
+  jobsCgroup = strdup(path);
+  return jobsCgroup;
+}
+
+/*The cgroup2 mount point from mountinfo joined with the 0:: entry of the
+ *shell's cgroup file in proc*/
+static char* OwnCgroup()
+{
+  FILE* f;
+  char line[1024], mnt[PATH_MAX], root[PATH_MAX], rel[PATH_MAX];
+  char *sep, *path;
+  bool found = FALSE;
+  size_t n;
+
+  if((f = fopen("/proc/self/mountinfo", "re")) == NULL)
+    return NULL;
+  while(!found && fgets(line, sizeof(line), f) != NULL)
+  {
+    sep = strstr(line, " - ");
+    if(sep != NULL && strncmp(sep + 3, "cgroup2 ", 8) == 0
+        && sscanf(line, "%*s %*s %*s %s %s", root, mnt) == 2)
+      found = TRUE;
+  }
+  fclose(f);
+  if(!found || (f = fopen("/proc/self/cgroup", "re")) == NULL)
+    return NULL;
+  found = FALSE;
+  while(!found && fgets(line, sizeof(line), f) != NULL)
+  {
+    if(strncmp(line, "0::", 3) == 0 && sscanf(line + 3, "%s", rel) == 1)
+      found = TRUE;
+  }
+  fclose(f);
+  if(!found)
+    return NULL;
+
+  //a mount of a subtree shows paths below its root
+  n = strlen(root);
+  if(strcmp(root, "/") != 0 && strncmp(rel, root, n) == 0)
+    memmove(rel, rel + n, strlen(rel + n) + 1);
+  path = malloc(strlen(mnt) + strlen(rel) + 1);
+  strcpy(path, mnt);
+  if(strcmp(rel, "/") != 0)
+    strcat(path, rel);
+  return path;
+}
+
+static bool HasControllers(char* dir, char* file)
+{
+  char buf[256];
+
+  if(!ReadFile(dir, file, buf, sizeof(buf)))
+    return FALSE;
+  return strstr(buf, "memory") != NULL && strstr(buf, "cpu") != NULL;
+}
+
+static bool WriteFile(char* dir, char* file, char* text)
+{
+  char path[PATH_MAX];
+  int fd;
+  bool ok;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  if((fd = open(path, O_WRONLY | O_CLOEXEC)) < 0)
+    return FALSE;
+  ok = write(fd, text, strlen(text)) == (ssize_t) strlen(text);
+  close(fd);
+  return ok;
+}
+
+/*The shell goes first, so it is moved even when the list cannot be read*/
+static bool MoveOwnProcs(char* from, char* to)
+{
+  char path[PATH_MAX], pid[32];
+  FILE* f;
+  int other;
+  bool ok;
+
+  snprintf(pid, sizeof(pid), "%d", (int) getpid());
+  ok = WriteFile(to, "cgroup.procs", pid);
+  snprintf(path, sizeof(path), "%s/cgroup.procs", from);
+  if(!ok || (f = fopen(path, "re")) == NULL)
+    return ok;
+  while(fscanf(f, "%d", &other) == 1)
+  {
+    if(!IsOwnProc(other))
+      continue;
+    snprintf(pid, sizeof(pid), "%d", other);
+    //one that exited meanwhile is gone from the list anyway
+    if(!WriteFile(to, "cgroup.procs", pid) && kill(other, 0) == 0)
+      ok = FALSE;
+  }
+  fclose(f);
+  return ok;
+}
+
+/*Follows the parents in the stat files of proc up to init*/
+static bool IsOwnProc(pid_t pid)
+{
+  char dir[32], buf[512], *paren;
+  int depth;
+
+  for(depth = 0; pid > 1 && depth < 64; depth++)
+  {
+    if(pid == getpid())
+      return TRUE;
+    snprintf(dir, sizeof(dir), "/proc/%d", (int) pid);
+    //the name in parentheses can hold anything, the fields follow the last )
+    if(!ReadFile(dir, "stat", buf, sizeof(buf)) || (paren = strrchr(buf, ')')) == NULL
+        || sscanf(paren + 1, " %*c %d", &pid) != 1)
+      return FALSE;
+  }
+  return FALSE;
+}
+
+static bool ReadFile(char* dir, char* file, char* buf, size_t size)
+{
+  char path[PATH_MAX];
+  int fd;
+  ssize_t n;
+
+  snprintf(path, sizeof(path), "%s/%s", dir, file);
+  if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+    return FALSE;
+  n = read(fd, buf, size - 1);
+  close(fd);
+  if(n < 0)
+    return FALSE;
+  buf[n] = '\0';
+  return TRUE;
+}
+
+static bool ReadProcFile(pid_t pid, char* file, int* fd, char* buf, size_t size)
+{
+  char path[64];
+  struct rlimit rl;
+  ssize_t n;
+  bool keep = TRUE;
+
+  if(*fd < 0)
+  {
+    if(procFilesMax < 0)
+      procFilesMax = getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY ? rl.rlim_cur / 2 : 512;
+    snprintf(path, sizeof(path), "/proc/%d/%s", pid, file);
+    if((*fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+      return FALSE;
+    keep = procFilesKept < procFilesMax;
+    if(keep)
+      procFilesKept++;
+  }
+  //reading from the start again gives a fresh copy
+  n = pread(*fd, buf, size - 1, 0);
+  if(!keep)
+  {
+    close(*fd);
+    *fd = -1;
+  }
+  if(n <= 0)
+    return FALSE;
+  buf[n] = '\0';
+  return TRUE;
+}
+
+static void FormatSize(long long n, char* buf, size_t size)
+{
+  char* units = "BKMGT";
+
+  if(n < 1024)
+  {
+    snprintf(buf, size, "%lldB", n);
+    return;
+  }
+  units++;
+  while(n >= 1024 * 1024 && units[1] != '\0')
+  {
+    n /= 1024;
+    units++;
+  }
+  snprintf(buf, size, "%.1f%c", n / 1024.0, *units);
+}
@@ -0,0 +1,355 @@
+/***************************************************************************
+ *  Title: Launch options
+ * -------------------------------------------------------------------------
+ *    Purpose: Resource limits, placement and accounting for the jobs
+ *    the shell starts
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: launch.h
+ ***************************************************************************/
+
+#ifndef __LAUNCH_H__
+#define __LAUNCH_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+#include <sched.h>
+#include <sys/resource.h>
+
+/************Private include**********************************************/
+#include "runtime.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __LAUNCH_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/* resources ulimit knows about: -n, -t, -u and -v */
+#define NRLIMITS 4
+
+/* which side of an rlimit ulimit sets */
+#define LIMIT_SOFT 1
+#define LIMIT_HARD 2
+
+/* how a command is started, set by prefixes like limit */
+struct launch_s {
+  /* memory limit in bytes, 0 for none */
+  long long mem;
+  /* cpu limit in percent of one cpu, 0 for none */
+  int cpu;
+  /* rlimits set by ulimit: LIMIT_SOFT and/or LIMIT_HARD, 0 if unset */
+  int rlimSet[NRLIMITS];
+  rlim_t rlim[NRLIMITS];
+  /* cpus the command may run on, when pinCpus is set */
+  bool pinCpus;
+  cpu_set_t cpus;
+  /* NUMA nodes for its memory, 0 for none, and the MPOL_ policy */
+  unsigned long nodes;
+  int mempolicy;
+  /* whether it starts with the background scheduling options */
+  bool demote;
+  /* buffer size of the pipes of its pipeline in bytes, 0 for shopt pipesize */
+  long long pipeSize;
+};
+
+/* what a thread of a demoted job ran with and what it was set to, so fg
+ * can undo only that */
+typedef struct prio_s {
+  /* the thread, 0 for those of a job demoted when it started */
+  pid_t tid;
+  int policy, nice, ioprio;
+  int bgPolicy, bgNice, bgIoprio;
+} prioT;
+
+/* the /proc files of a process kept open for jobs -l, -1 until used */
+#define PROC_STAT  0
+#define PROC_STATM 1
+#define PROC_IO    2
+#define PROC_CHILDREN 3
+#define PROC_SYSCALL  4
+#define NPROCFILES 5
+
+/* what the processes of a job have used, summed up from /proc */
+typedef struct procstat_s {
+  /* how many processes of the group could be read */
+  int nprocs;
+  /* when the first one started, in clock ticks since boot */
+  unsigned long long start;
+  /* cpu time of them and their reaped children, in clock ticks */
+  unsigned long long cpu;
+  /* resident memory and bytes read from and written to storage */
+  long long rss;
+  long long readBytes;
+  long long writeBytes;
+} procstatT;
+
+/************Global Variables*********************************************/
+
+/* the size shopt pipesize= was given, NULL while it is off */
+EXTERN char* pipeSizeText;
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Takes the launch prefixes off a command
+ * ---------------------------------------------------------------------
+ *    Purpose: Parses and removes prefixes like
+ *    "limit mem=2G cpu=150% pipe=1M --", "pin nodes=1 --" or
+ *    "ulimit -n 64 --"
+ *    from the front of a command and stores them in its launch options.
+ *    Errors are reported on standard error.
+ *    Input: an expanded command structure
+ *    Output: false if the prefix is invalid
+ ***********************************************************************/
+EXTERN bool TakeLaunchPrefix(commandT*);
+
+/***********************************************************************
+ *  Title: Checks the limits of a pipeline
+ * ---------------------------------------------------------------------
+ *    Purpose: mem=, cpu= and pipe= are set for the job as a whole,
+ *    from its first command. On a later command they are reported as
+ *    an error on standard error instead of being dropped.
+ *    Input: the commands of the pipeline and their number
+ *    Output: false if a later command has one of them
+ ***********************************************************************/
+EXTERN bool CheckJobLimits(commandT**, int);
+
+/***********************************************************************
+ *  Title: Creates the cgroup of a job
+ * ---------------------------------------------------------------------
+ *    Purpose: Creates a cgroup v2 leaf with the memory and cpu limits
+ *    of a job, below a delegated hierarchy ($TSH_CGROUP or the shell's
+ *    own cgroup).
+ *    Input: the launch options of the job
+ *    Output: the path of the leaf, NULL if cgroups are not available
+ ***********************************************************************/
+EXTERN char* CreateJobCgroup(launchT*);
+
+/***********************************************************************
+ *  Title: Places a job
+ * ---------------------------------------------------------------------
+ *    Purpose: With pin auto= on, gives a background job that nobody
+ *    pinned the next core or node in turn.
+ *    Input: the commands of the job, how many there are and whether
+ *    it runs in the background
+ *    Output: a description of where the job runs for jobs -l, NULL if
+ *    it is not pinned
+ ***********************************************************************/
+EXTERN char* PlaceJob(commandT**, int, bool);
+
+/***********************************************************************
+ *  Title: Schedules a job
+ * ---------------------------------------------------------------------
+ *    Purpose: Marks the commands of a background job to start with the
+ *    scheduling class, nice value and io priority from shopt.
+ *    Input: the commands of the job, how many there are and whether
+ *    it runs in the background
+ *    Output: true if the job is demoted
+ ***********************************************************************/
+EXTERN bool ScheduleJob(commandT**, int, bool);
+
+/***********************************************************************
+ *  Title: Describes how a job started in the background was demoted
+ * ---------------------------------------------------------------------
+ *    Purpose: Fills an entry for every thread of a job that ScheduleJob
+ *    marked: the shell's own priority and the background one from shopt.
+ *    Input: the entry
+ *    Output: void
+ ***********************************************************************/
+EXTERN void LaunchPriority(prioT*);
+
+/***********************************************************************
+ *  Title: Sets the priority of a running job
+ * ---------------------------------------------------------------------
+ *    Purpose: Moves every thread of the given processes to the
+ *    background scheduling options, for bg, remembering what each had.
+ *    For fg it undoes what was changed: a class or io priority still as
+ *    it was set goes back, and the nice value moves back by as much as
+ *    it was raised, so a nice the job set itself is kept. Lowering a
+ *    nice value takes CAP_SYS_NICE, so without it the job keeps the
+ *    raised one and that does not count as a failure.
+ *    Input: the pids of the job, how many, its entries and their count
+ *    (freed for fg), and whether it goes to the background
+ *    Output: true if every thread could be changed
+ ***********************************************************************/
+EXTERN bool SetJobPriority(pid_t*, int, prioT**, int*, bool);
+
+/***********************************************************************
+ *  Title: Runs the pin builtin
+ * ---------------------------------------------------------------------
+ *    Purpose: Shows where jobs may run or sets how background jobs are
+ *    spread with auto=off, auto=cores or auto=nodes.
+ *    Input: a command structure
+ *    Output: the exit status
+ ***********************************************************************/
+EXTERN int RunPin(commandT*);
+
+/***********************************************************************
+ *  Title: Runs the ulimit builtin
+ * ---------------------------------------------------------------------
+ *    Purpose: Shows or sets the rlimits every command started from now
+ *    on gets. The shell keeps its own limits.
+ *    Input: a command structure
+ *    Output: the exit status
+ ***********************************************************************/
+EXTERN int RunUlimit(commandT*);
+
+/***********************************************************************
+ *  Title: Enters the launch options
+ * ---------------------------------------------------------------------
+ *    Purpose: Runs in a freshly forked child: sets the rlimits from
+ *    ulimit, the cpu affinity and memory policy from pin, the
+ *    background scheduling options if it is demoted, and moves it
+ *    into the job's cgroup, or applies the limits with setrlimit when
+ *    there is none.
+ *    Input: the launch options (may be NULL) and the job's cgroup
+ *    (may be NULL)
+ *    Output: void
+ ***********************************************************************/
+EXTERN void EnterLaunch(launchT*, char*);
+
+/***********************************************************************
+ *  Title: Checks whether a launch is plain
+ * ---------------------------------------------------------------------
+ *    Purpose: Tells whether EnterLaunch would have nothing to do, so
+ *    the command can be started by the zygote.
+ *    Input: the launch options (may be NULL) and the job's cgroup
+ *    (may be NULL)
+ *    Output: true if there are no options, ulimit defaults or cgroup
+ ***********************************************************************/
+EXTERN bool PlainLaunch(launchT*, char*);
+
+/***********************************************************************
+ *  Title: Removes the cgroup of a job
+ * ---------------------------------------------------------------------
+ *    Purpose: Removes the leaf of a job that has ended and frees the
+ *    path.
+ *    Input: the path of the leaf (may be NULL)
+ *    Output: void
+ ***********************************************************************/
+EXTERN void RemoveJobCgroup(char*);
+
+/***********************************************************************
+ *  Title: Prints the resource usage of a job
+ * ---------------------------------------------------------------------
+ *    Purpose: Prints the peak memory and cpu time of a job's cgroup,
+ *    with its limits, for jobs -v.
+ *    Input: the path of the leaf (may be NULL)
+ *    Output: void
+ ***********************************************************************/
+EXTERN void PrintJobUsage(char*);
+
+/***********************************************************************
+ *  Title: Reads what a process has used
+ * ---------------------------------------------------------------------
+ *    Purpose: Adds the cpu time, resident memory and io of a process
+ *    and of its descendants in the same process group to a sum, from
+ *    their stat, statm and io files in /proc. The files of the process
+ *    are opened on first use and kept open, so listing the jobs again
+ *    only costs a pread per file.
+ *    Input: the pid, its NPROCFILES fds, the process group and the sum
+ *    Output: false if the process is gone or in another group
+ ***********************************************************************/
+EXTERN bool ReadProcStat(pid_t, int*, pid_t, procstatT*);
+
+/***********************************************************************
+ *  Title: Closes the /proc files of a process
+ * ---------------------------------------------------------------------
+ *    Purpose: Closes what ReadProcStat opened and marks them unused.
+ *    Input: the NPROCFILES fds
+ *    Output: void
+ ***********************************************************************/
+EXTERN void CloseProcFiles(int*);
+
+/***********************************************************************
+ *  Title: Prints what the processes of a job have used
+ * ---------------------------------------------------------------------
+ *    Purpose: Prints the elapsed time, cpu percentage over that time,
+ *    resident memory and io of a job for jobs -l and -v.
+ *    Input: the sum from ReadProcStat
+ *    Output: void
+ ***********************************************************************/
+EXTERN void PrintJobStats(procstatT*);
+
+/***********************************************************************
+ *  Title: Starts sampling a pipeline
+ * ---------------------------------------------------------------------
+ *    Purpose: With shopt pipestats=on, keeps track of the stages of a
+ *    foreground pipeline that was just started.
+ *    Input: the commands, the pid of each of them (0 for a stage that
+ *    runs in the shell or did not start) and how many there are
+ *    Output: void
+ ***********************************************************************/
+EXTERN void StartPipeStats(commandT**, pid_t*, int);
+
+/***********************************************************************
+ *  Title: Samples the stages of a pipeline
+ * ---------------------------------------------------------------------
+ *    Purpose: Reads the io counters, cpu time and the system call each
+ *    stage is blocked in, and adds the time since the last sample to
+ *    the read or write wait of the stages blocked in one. Called while
+ *    waiting for the pipeline, before a process is reaped.
+ *    Input: void
+ *    Output: the sampling period in milliseconds, -1 if no pipeline
+ *    is sampled
+ ***********************************************************************/
+EXTERN int SamplePipeStats();
+
+/***********************************************************************
+ *  Title: Ends sampling a pipeline
+ * ---------------------------------------------------------------------
+ *    Purpose: Prints the table of the stages on standard error: bytes
+ *    read and written, time blocked reading and writing, and cpu time.
+ *    Input: whether the pipeline ran to the end, false drops the table
+ *    Output: void
+ ***********************************************************************/
+EXTERN void EndPipeStats(bool);
+
+/***********************************************************************
+ *  Title: Sets the size of pipes
+ * ---------------------------------------------------------------------
+ *    Purpose: Sets the buffer size of the pipes between the commands of
+ *    pipelines, like 1M, or "off" for the default of the kernel. This is
+ *    shopt pipesize=. Errors are reported on standard error.
+ *    Input: the size or "off"
+ *    Output: false if the size is invalid
+ ***********************************************************************/
+EXTERN bool SetPipeSize(char*);
+
+/***********************************************************************
+ *  Title: Grows a pipe
+ * ---------------------------------------------------------------------
+ *    Purpose: Gives a pipe of a pipeline the size of limit pipe= of the
+ *    launch, or else of shopt pipesize, at most
+ *    /proc/sys/fs/pipe-max-size. A pipe the kernel will not grow keeps
+ *    its size.
+ *    Input: an fd of the pipe and the launch options of the pipeline
+ *    Output: void
+ ***********************************************************************/
+EXTERN void GrowPipe(int, launchT*);
+
+/***********************************************************************
+ *  Title: Cleans up the launch options
+ * ---------------------------------------------------------------------
+ *    Purpose: Removes the cgroup the shell created for its jobs.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void CleanupLaunch();
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __LAUNCH_H__ */
@@ -35,13 +35,18 @@
  *
  ***************************************************************************/
 #define __RUNTIME_IMPL__
+#define _GNU_SOURCE
 
 /************System include***********************************************/
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -52,6 +57,17 @@
 /************Private include**********************************************/
 #include "runtime.h"
 #include "io.h"
+#include "interpreter.h"
+#include "builtin.h"
+#include "script.h"
+#include "launch.h"
+#include "event.h"
+#include "stats.h"
+#include "joblog.h"
+#include "cache.h"
+#include "serve.h"
+#include "zygote.h"
+#include "edit.h"
 
 /************Defines and Typedefs*****************************************/
 /*  #defines and typedefs should have their names in all caps.
@@ -64,22 +80,183 @@
 
 #define NBUILTINCOMMANDS (sizeof BuiltInCommands / sizeof(char*))
 
+/* newer kernels signal the process group of a pidfd */
+#ifndef PIDFD_SIGNAL_PROCESS_GROUP
+#define PIDFD_SIGNAL_PROCESS_GROUP (1UL << 2)
+#endif
+
+/* how a process whose status was lost to someone else ended: exit 127,
+ * never a success */
+#define LOSTSTATUS (127 << 8)
+
+/* a process of a job */
+typedef struct proc_s {
+  pid_t pid;
+  /* pidfd of the process, -1 where the kernel has none */
+  int pidfd;
+  /* its /proc files, opened by jobs -l */
+  int files[NPROCFILES];
+} procT;
+
 typedef struct bgjob_l {
   pid_t pid;
+  /* processes of the job that are still running */
+  procT* procs;
+  int nprocs;
+  /* last process of the pipeline, its exit status is the job's */
+  pid_t last;
   struct bgjob_l* next;
   struct bgjob_l* prev;
   char* status;
   char* cmdline;
+  /* cgroup leaf of a job with limits, NULL if it has none */
+  char* cgroup;
+  /* where a pinned job runs, for jobs -l, NULL if it is not pinned */
+  char* place;
+  /* whether it runs with the background scheduling options, and what
+   * its threads had before */
+  bool demoted;
+  prioT* prio;
+  int nprio;
+  /* how its last process ended, for wait */
+  int exitStatus;
+  /* when it was started, CLOCK_MONOTONIC */
+  struct timespec started;
+  /* what its ended processes used */
+  struct rusage usage;
+  /* its argv for the job log, NULL while the log is off */
+  char* argv;
+  /* the connection of a tsh --serve request, told how the job ended
+   * instead of reporting it; -1 for none */
+  int reply;
+  /* ended jobs wait in a queue to be reported or taken by wait -n */
+  bool queued;
+  struct bgjob_l* doneNext;
   int id;
 } bgjobL;
 
 /* the pids of the background processes */
 bgjobL *bgjobs = NULL;
 
+/* jobs that have ended and are not reported yet, oldest first */
+static bgjobL* doneHead = NULL;
+static bgjobL* doneTail = NULL;
+/* jobs with processes left, running or stopped */
+static int liveJobs = 0;
+
+/* finds the job of a background process without walking the job list:
+ * open addressing on the pid, at most half full */
+typedef struct pidslot_s {
+  pid_t pid;
+  bgjobL* job;
+} pidslotT;
+
+static pidslotT* pidSlots = NULL;
+static int pidSlotsSize = 0;
+static int pidSlotsUsed = 0;
+
+#define PIDSLOT(pid) ((unsigned int) (pid) * 2654435761u & (pidSlotsSize - 1))
+
+/* set if a process got no pidfd, its end may then only show as a SIGCHLD
+ * that came together with others */
+static bool rawProcs = FALSE;
+
+/* number of hash buckets of the PATH cache, must be a power of two */
+#define PATHCACHE_BUCKETS 256
+
+/* where a command was found on PATH */
+typedef struct path_cache_l {
+  char* name;
+  char* path;
+  struct path_cache_l* next;
+} pathCacheL;
+
+static pathCacheL* pathCache[PATHCACHE_BUCKETS];
+/* the PATH the cache was filled from */
+static char* pathCachePath = NULL;
+
+/* what the kernel reads of a #! line */
+#define SHEBANG_MAX 256
+
+/* the #! line of an executable, as of its inode and mtime */
+typedef struct shebang_cache_l {
+  char* path;
+  dev_t dev;
+  ino_t ino;
+  off_t size;
+  struct timespec mtime;
+  /* NULL for a binary, or a script left to the kernel */
+  char* interp;
+  /* the one argument after the interpreter, NULL for none */
+  char* arg;
+  /* #!/usr/bin/env NAME, NAME is looked up on PATH by the shell */
+  bool viaEnv;
+  struct shebang_cache_l* next;
+} shebangCacheL;
+
+static shebangCacheL* shebangCache[PATHCACHE_BUCKETS];
+
+/* a shell option set with shopt */
+typedef struct shopt_s {
+  char* name;
+  int* value;
+  /* the words the value may be, NULL for a number from min to max */
+  char** words;
+  int min, max;
+  /* an option with text for a value has these instead, NULL text is off */
+  char** text;
+  bool (*set)(char*);
+} shoptT;
+
+static char* bgSchedWords[] = { "off", "batch", "idle", NULL };
+static char* bgIoprioWords[] = { "off", "idle", "0", "1", "2", "3", "4", "5", "6", "7", NULL };
+static char* onOffWords[] = { "off", "on", NULL };
+
+static shoptT shopts[] = {
+  { "bgsched",  &bgSched,  bgSchedWords,  0, 0,  NULL,          NULL      },
+  { "bgnice",   &bgNice,   NULL,          0, 19, NULL,          NULL      },
+  { "bgioprio", &bgIoprio, bgIoprioWords, 0, 0,  NULL,          NULL      },
+  { "joblog",   NULL,      NULL,          0, 0,  &jobLogTarget, SetJobLog },
+  { "pipestats", &pipeStats, onOffWords,  0, 0,  NULL,          NULL      },
+  { "pipesize", NULL,      NULL,          0, 0,  &pipeSizeText, SetPipeSize },
+  { "zygote",   &useZygote, onOffWords,   0, 0,  NULL,          NULL      },
+  { "cachesize", &cacheSize, NULL,        0, 1048576, NULL,     NULL      },
+};
+
+#define NSHOPTS (sizeof shopts / sizeof(shoptT))
+
+/* the shell's ends of the process substitution pipes of the line being
+ * started; those from substClaimed on belong to no command yet */
+static int* substFds = NULL;
+static int nsubstFds = 0;
+static int substClaimed = 0;
+/* the process group the substituted processes started, 0 for none */
+static pid_t substPgid = 0;
+
+/* the job of the coprocess, 0 for none, and the shell's ends of its
+ * pipes: what it writes is read from the first, the second feeds it */
+static pid_t coprocPgid = 0;
+static int coprocFds[2] = { -1, -1 };
+
 /*foreground pid*/
 pid_t fgpid = -1;
+/*processes of the foreground job, or of the job being started, that are still running*/
+procT* fgproc = NULL;
+int fgprocs = 0;
+/*last process of the foreground pipeline*/
+pid_t fglast = -1;
+/*when the foreground job, or the job being started, was started*/
+struct timespec fgstart;
+/*what its ended processes used*/
+struct rusage fgusage;
 
-char* last_cmd;
+/*cmdline of the foreground job, handed over to the job list when it is stopped*/
+char* last_cmd = NULL;
+/*cgroup and placement of the foreground job, handed over like last_cmd*/
+char* last_cgroup = NULL;
+char* last_place = NULL;
+/*argv of the foreground job for the job log, handed over like last_cmd*/
+char* last_argv = NULL;
 
 int stopped = 0;
 
@@ -90,14 +267,87 @@ static void RunCmdFork(commandT*, bool);
 static void RunExternalCmd(commandT*, bool);
 /* resolves the path and checks for exutable flag */
 static bool ResolveExternalCmd(commandT*);
+/* finds a command on PATH, through the PATH cache */
+static char* FindCmd(char*);
+/* looks a command up in the PATH cache, or remembers where it was found */
+static pathCacheL** PathCacheSlot(char*);
+/* the FNV-1a hash of a name, for the caches */
+static unsigned long long HashName(char*);
+/* execs the interpreter of a script directly */
+static void ResolveShebang(commandT*);
+/* reads the #! line of an executable into its entry */
+static void ReadShebang(shebangCacheL*);
+static shebangCacheL** ShebangSlot(char*);
+static void ClearPathCache();
 /* forks and runs a external program */
 static void Exec(commandT*, bool);
+/* forks and execs one process of a job */
+static pid_t SpawnCmd(commandT*, pid_t, int, int, char*);
+/* has the zygote start the command, -1 if the shell has to fork */
+static pid_t ZygoteCmd(commandT*, pid_t, int, int, char*);
+static int OpenRedirect(char*, int);
+/* sets up a child's fds, signals and limits and execs the command */
+static void ExecChild(commandT*, int, int, char*);
+/* puts the body of a here-document into a readable fd */
+static int OpenHeredoc(commandT*);
+/* sets up stdin and stdout of a command */
+static bool RedirectFds(commandT*, int, int);
+/* runs a command line in a forked shell and exits with its status */
+static void RunForked(char*, commandT**, int);
+/* closes the shell's ends of the process substitutions of the line */
+static void CloseProcSubst();
+/* in a child: leaves the process substitutions of the parent behind */
+static void ForgetProcSubst();
+/* in a child: keeps the process substitutions of its command across exec
+   and closes the others */
+static void KeepProcSubst(commandT*);
+/* in a child: closes every fd above stderr but those of its command */
+static void CloseOtherFds(commandT*);
+/* runs a builtin command with its own stdin and stdout */
+static void RunBuiltInCmdFds(commandT*, int, int);
+/* builds the cmdline of a pipeline */
+static char* PipelineCmdline(commandT**, int);
 /* runs a builtin command */
 static void RunBuiltInCmd(commandT*);
 /* checks whether a command is a builtin command */
 static bool IsBuiltIn(char*);
 /* adds a new job to the background jobs*/
-static void AddJobToBg(pid_t, int); 
+static void AddJobToBg(pid_t, int, pid_t);
+/* keeps a pidfd of a new process of the foreground job */
+static void TrackProc(pid_t);
+/* reaps a process of a job that has changed */
+static pid_t ReapProc(procT*, int*, int*, struct rusage*);
+/* the status waitpid would have given */
+static int WaitStatus(siginfo_t*);
+/* sends a signal to a job */
+static void SignalJob(pid_t, procT*, int, int);
+/* moves the processes of a job to the background priority or back */
+static bool JobPriority(bgjobL*, bool);
+static void ReleaseProcs(procT*, int);
+/* marks the /proc files of every job unopened, in a child that closed them */
+static void ForgetProcFiles();
+/* reaps the processes of a job that have changed */
+static void ReapJob(bgjobL*);
+/* the pid index of the background processes */
+static void IndexPid(pid_t, bgjobL*);
+static bgjobL* PidJob(pid_t);
+static void ForgetPid(pid_t);
+/* takes the processes of a job out of the index */
+static void DetachProcs(bgjobL*);
+/* takes a job out of the queue of ended jobs */
+static void Dequeue(bgjobL*);
+/* runs the wait builtin */
+static int RunWait(commandT*);
+/* runs the coproc builtin */
+static int RunCoproc(commandT*);
+/* closes the shell's ends of the coprocess and clears its variables */
+static void CloseCoproc();
+/* points stdin or stdout at a file, or at an fd for &N */
+static bool RedirectFd(char*, int, int);
+/* waits until a job has ended or stopped */
+static bool WaitJob(bgjobL*);
+/* finds the job of %n or of a pid */
+static bgjobL* FindJob(char*);
 /*Removes jobs with status = "Done" from the background jobs list*/
 static void removeCompletedJobs();
 /*Frees the given job*/
@@ -106,6 +356,11 @@ static void ReleaseJob(bgjobL*);
 static void wait_fg();
 /*Removes the job with the given pid from the bgjobs list*/
 static void RemoveJob(pid_t);
+/*Removes the given job from the bgjobs list and frees it*/
+static void UnlinkJob(bgjobL*);
+/* shows or sets shell options */
+static int RunShopt(commandT*);
+static void PrintShopt(shoptT*);
 
 /************External Declaration*****************************************/
 
@@ -115,24 +370,46 @@ void RunCmd(commandT** cmd, int n)
 {
   int i;
   total_task = n;
-  
-  if(n == 1)
-    RunCmdFork(cmd[0], TRUE);
-  else{
-    RunCmdPipe(cmd[0], cmd[1]);
+  stats.commands += n;
+
+  //take off prefixes like limit
+  for(i = 0; i < n; i++)
+  {
+    if(!TakeLaunchPrefix(cmd[i]))
+    {
+      for(i = 0; i < n; i++)
+        ReleaseCmdT(&cmd[i]);
+      return;
+    }
+  }
+  //the limits of a job are taken from its first command
+  if(!CheckJobLimits(cmd, n))
+  {
     for(i = 0; i < n; i++)
       ReleaseCmdT(&cmd[i]);
+    return;
   }
+
+  if(n == 1)
+    RunCmdFork(cmd[0], TRUE);
+  else
+    RunCmdPipe(cmd, n);
+  for(i = 0; i < n; i++)
+    ReleaseCmdT(&cmd[i]);
 }
 
 void RunCmdFork(commandT* cmd, bool fork)
 {
-  // printf("in runcmdfork\n");
   if (cmd->argc<=0)
     return;
-  if (IsBuiltIn(cmd->argv[0]))
+  //filters read their input, they get a process like any program
+  if (IsFilterBuiltIn(cmd->argv[0]))
   {
-    RunBuiltInCmd(cmd);
+    Exec(cmd, fork);
+  }
+  else if (IsBuiltIn(cmd->argv[0]))
+  {
+    RunBuiltInCmdFds(cmd, -1, -1);
   }
   else
   {
@@ -142,19 +419,375 @@ void RunCmdFork(commandT* cmd, bool fork)
 
 void RunCmdBg(commandT* cmd)
 {
-  RunCmdFork(cmd, FALSE);// TODO
+  cmd->bg = 1;
+  RunCmdFork(cmd, TRUE);
 }
 
-void RunCmdPipe(commandT* cmd1, commandT* cmd2)
+char* RunCmdCapture(char* text)
 {
+  commandT** command = NULL;
+  int task = 0, fds[2], status, i;
+  char* out = NULL;
+  size_t len = 0, cap = 256;
+  ssize_t n;
+  pid_t child;
+  FILE *mem = NULL, *saved;
+
+  if(!IsScript(text))
+    task = ParseCommandLine(text, &command);
+
+  //a lone builtin utility writes straight into a memory stream: no fork, no pipe
+  if(task == 1 && command[0]->argc > 0 && !command[0]->bg
+      && !command[0]->is_redirect_in && !command[0]->is_redirect_out
+      && IsUtilityBuiltIn(command[0]->argv[0])
+      && (fflush(stdout), mem = open_memstream(&out, &len)) != NULL)
+  {
+    saved = stdout;
+    stdout = mem;
+    RunParsed(command, task);
+    fclose(mem);
+    stdout = saved;
+  }
+  else if(pipe2(fds, O_CLOEXEC) < 0)
+  {
+    PrintPError("pipe");
+    lastStatus = 1;
+    out = strdup("");
+  }
+  else
+  {
+    fflush(stdout);
+    child = fork();
+    if(child > 0)
+      stats.forks++;
+    if(child == 0)
+    {
+      dup2(fds[1], STDOUT_FILENO);
+      RunForked(text, command, task);
+    }
+    close(fds[1]);
+    if(child < 0)
+      PrintPError("fork");
+
+    //read everything into one buffer, growing it as needed
+    out = malloc(cap);
+    while((n = read(fds[0], out + len, cap - len - 1)) != 0)
+    {
+      if(n < 0)
+      {
+        if(errno == EINTR) continue;
+        break;
+      }
+      len += n;
+      if(len + 1 == cap)
+      {
+        cap *= 2;
+        out = realloc(out, cap);
+      }
+    }
+    out[len] = '\0';
+    close(fds[0]);
+
+    lastStatus = 1;
+    while(child > 0 && waitpid(child, &status, 0) < 0 && errno == EINTR)
+      ;
+    if(child > 0 && WIFEXITED(status))
+      lastStatus = WEXITSTATUS(status);
+    else if(child > 0 && WIFSIGNALED(status))
+      lastStatus = 128 + WTERMSIG(status);
+  }
+
+  for(i = 0; i < task; i++)
+    ReleaseCmdT(&command[i]);
+  free(command);
+
+  //the trailing newlines are not part of the value
+  while(len > 0 && out[len - 1] == '\n')
+    len--;
+  out[len] = '\0';
+  return out;
+}
+
+char* RunProcSubst(char* text, bool output)
+{
+  commandT** command = NULL;
+  int task = 0, fds[2], i;
+  char* path;
+  pid_t child;
+
+  if(pipe2(fds, O_CLOEXEC) < 0)
+  {
+    PrintPError("pipe");
+    return NULL;
+  }
+  if(!IsScript(text))
+    task = ParseCommandLine(text, &command);
+  fflush(stdout);
+  child = fork();
+  if(child == 0)
+  {
+    //the first one starts the group of the job, the others join it
+    setpgid(0, substPgid);
+    //the command writes what <(...) reads, or reads what >(...) gets
+    dup2(fds[output ? 0 : 1], output ? STDIN_FILENO : STDOUT_FILENO);
+    //holding on to the other end, >(...) would never see the end of it
+    close(fds[0]);
+    close(fds[1]);
+    RunForked(text, command, task);
+  }
+  for(i = 0; i < task; i++)
+    ReleaseCmdT(&command[i]);
+  free(command);
+  close(fds[output ? 0 : 1]);
+  if(child < 0)
+  {
+    PrintPError("fork");
+    close(fds[output ? 1 : 0]);
+    return NULL;
+  }
+  stats.forks++;
+  if(substPgid == 0)
+    substPgid = child;
+  setpgid(child, substPgid);
+  //the job of the line takes it over with the processes it starts
+  TrackProc(child);
+
+  substFds = realloc(substFds, sizeof(int) * (nsubstFds + 1));
+  substFds[nsubstFds++] = fds[output ? 1 : 0];
+  path = malloc(32);
+  snprintf(path, 32, "/dev/fd/%d", fds[output ? 1 : 0]);
+  return path;
+}
+
+void TakeProcSubst(commandT* cmd)
+{
+  int n = nsubstFds - substClaimed;
+
+  if(n == 0)
+    return;
+  cmd->substFds = realloc(cmd->substFds, sizeof(int) * (cmd->nsubstFds + n));
+  memcpy(cmd->substFds + cmd->nsubstFds, substFds + substClaimed, sizeof(int) * n);
+  cmd->nsubstFds += n;
+  substClaimed = nsubstFds;
+}
+
+void WaitProcSubst()
+{
+  CloseProcSubst();
+  //a builtin, or a command that was not found, started no job to take
+  //the substituted processes over
+  if(fgprocs > 0 && fgpid < 0)
+  {
+    fgpid = substPgid;
+    fglast = -1;
+    stopped = 0;
+    wait_fg();
+  }
+  substPgid = 0;
+}
+
+static void RunForked(char* text, commandT** command, int task)
+{
+  commandT* cmd;
+
+  //the epoll set and signalfd are the parent's, get our own
+  InitEvents();
+  ForgetProcSubst();
+  ForgetZygote();
+  if(task == 1 && !command[0]->bg)
+  {
+    //a single command replaces the child instead of forking again
+    cmd = ExpandCmdT(CopyCmdT(command[0]));
+    if(TakeLaunchPrefix(cmd))
+      RunCmdFork(cmd, FALSE);
+  }
+  else
+  {
+    Interpret(text);
+  }
+  fflush(stdout);
+  _exit(lastStatus);
+}
+
+static void CloseProcSubst()
+{
+  int i;
+
+  for(i = 0; i < nsubstFds; i++)
+    close(substFds[i]);
+  free(substFds);
+  substFds = NULL;
+  nsubstFds = substClaimed = 0;
+}
+
+static void ForgetProcSubst()
+{
+  CloseProcSubst();
+  substPgid = 0;
+  //the processes are the parent's children, not ours
+  ReleaseProcs(fgproc, fgprocs);
+  fgproc = NULL;
+  fgprocs = 0;
+}
+
+static void KeepProcSubst(commandT* cmd)
+{
+  int i, j;
+
+  for(i = 0; i < nsubstFds; i++)
+  {
+    for(j = 0; j < cmd->nsubstFds && cmd->substFds[j] != substFds[i]; j++)
+      ;
+    if(j < cmd->nsubstFds)
+      fcntl(substFds[i], F_SETFD, 0);
+    else
+      close(substFds[i]);
+  }
+}
+
+static void CloseOtherFds(commandT* cmd)
+{
+  unsigned int from = 3, next;
+  int i;
+
+  for(;;)
+  {
+    next = ~0U;
+    for(i = 0; i < cmd->nsubstFds; i++)
+      if((unsigned int) cmd->substFds[i] >= from && (unsigned int) cmd->substFds[i] < next)
+        next = cmd->substFds[i];
+    if(next == ~0U)
+      break;
+    if(next > from)
+      close_range(from, next - 1, 0);
+    from = next + 1;
+  }
+  close_range(from, ~0U, 0);
+}
+
+void RunCmdPipe(commandT** cmd, int n)
+{
+  int i, nprocs = 0;
+  int (*pipes)[2] = malloc(sizeof(int[2]) * (n - 1));
+  pid_t* pids = calloc(n, sizeof(pid_t));
+  bool bg = cmd[n - 1]->bg, inproc = FALSE;
+  //the processes of <(...) and >(...) already started the group
+  pid_t pid, pgid = substPgid, lastpid = -1;
+  char *cgroup, *place;
+
+  for(i = 0; i < n - 1; i++)
+  {
+    if(pipe2(pipes[i], O_CLOEXEC) < 0)
+    {
+      PrintPError("pipe");
+      while(i-- > 0)
+      {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+      }
+      free(pipes);
+      free(pids);
+      lastStatus = 1;
+      return;
+    }
+    //the launch of the first command covers the whole pipeline
+    GrowPipe(pipes[i][1], cmd[0]->launch);
+  }
+
+  //the limits of the first command cover the whole pipeline
+  cgroup = CreateJobCgroup(cmd[0]->launch);
+  place = PlaceJob(cmd, n, bg);
+  ScheduleJob(cmd, n, bg);
+
+  lastStatus = 0;
+  clock_gettime(CLOCK_MONOTONIC, &fgstart);
+  memset(&fgusage, 0, sizeof(fgusage));
+  for(i = 0; i < n; i++)
+  {
+    if(cmd[i]->argc <= 0)
+      continue;
+    //a utility at the end never reads its input or waits on a pipe, so it
+    //runs in the shell once the rest is started; earlier ones could fill
+    //their pipe and block the shell, so they are forked like the others
+    if(!bg && i == n - 1 && IsUtilityBuiltIn(cmd[i]->argv[0]))
+    {
+      inproc = TRUE;
+      continue;
+    }
+    if(!IsBuiltIn(cmd[i]->argv[0]) && !ResolveExternalCmd(cmd[i]))
+    {
+      printf("%s: command not found\n", cmd[i]->argv[0]);
+      fflush(stdout);
+      stats.execFailures++;
+      if(i == n - 1) lastStatus = 127;
+      continue;
+    }
+    pid = SpawnCmd(cmd[i], pgid, i > 0 ? pipes[i - 1][0] : -1, i < n - 1 ? pipes[i][1] : -1, cgroup);
+    if(pid > 0)
+    {
+      if(pgid == 0) pgid = pid;
+      if(i == n - 1) lastpid = pid;
+      pids[i] = pid;
+      nprocs++;
+    }
+  }
+
+  //the children have their ends
+  for(i = 0; i < n - 1; i++)
+  {
+    close(pipes[i][0]);
+    close(pipes[i][1]);
+  }
+
+  if(nprocs > 0)
+  {
+    stats.jobsStarted++;
+    last_cmd = PipelineCmdline(cmd, n);
+    last_cgroup = cgroup;
+    last_place = place;
+    last_argv = JobLogArgv(cmd, n);
+    if(bg)
+    {
+      AddJobToBg(pgid, 0, lastpid);
+    }
+    else
+    {
+      fgpid = pgid;
+      fglast = lastpid;
+      stopped = 0;
+      LogJobEvent(JOBLOG_START, 0, pgid, lastpid, last_argv, 0, NULL, NULL);
+      StartPipeStats(cmd, pids, n);
+    }
+  }
+  else
+  {
+    RemoveJobCgroup(cgroup);
+    free(place);
+  }
+
+  if(inproc)
+    RunBuiltInCmdFds(cmd[n - 1], -1, -1);
+  CloseProcSubst();
+
+  if(nprocs > 0 && !bg)
+    wait_fg();
+
+  free(pipes);
+  free(pids);
 }
 
 void RunCmdRedirOut(commandT* cmd, char* file)
 {
+  cmd->is_redirect_out = 1;
+  cmd->redirect_out = strdup(file);
+  RunCmdFork(cmd, TRUE);
 }
 
 void RunCmdRedirIn(commandT* cmd, char* file)
 {
+  cmd->is_redirect_in = 1;
+  cmd->redirect_in = strdup(file);
+  RunCmdFork(cmd, TRUE);
 }
 
 
@@ -167,30 +800,61 @@ static void RunExternalCmd(commandT* cmd, bool fork)
   else {
     printf("%s: command not found\n", cmd->argv[0]);
     fflush(stdout);
-    ReleaseCmdT(&cmd);
+    stats.execFailures++;
+    lastStatus = 127;
   }
 }
 
-/*Find the executable based on search list provided by environment variable PATH*/
 static bool ResolveExternalCmd(commandT* cmd)
+{
+  if((cmd->name = FindCmd(cmd->argv[0])) == NULL)
+    return FALSE;
+  ResolveShebang(cmd);
+  return TRUE;
+}
+
+/*Find the executable based on search list provided by environment variable PATH*/
+static char* FindCmd(char* name)
 {
   char *pathlist, *c;
   char buf[1024];
   int i, j;
   struct stat fs;
+  pathCacheL **slot, *entry;
 
-  if(strchr(cmd->argv[0],'/') != NULL){
-    if(stat(cmd->argv[0], &fs) >= 0){
+  if(strchr(name,'/') != NULL){
+    if(stat(name, &fs) >= 0){
       if(S_ISDIR(fs.st_mode) == 0)
-        if(access(cmd->argv[0],X_OK) == 0){/*Whether it's an executable or the user has required permisson to run it*/
-          cmd->name = strdup(cmd->argv[0]);
-          return TRUE;
+        if(access(name,X_OK) == 0){/*Whether it's an executable or the user has required permisson to run it*/
+          return strdup(name);
         }
     }
-    return FALSE;
+    return NULL;
   }
   pathlist = getenv("PATH");
-  if(pathlist == NULL) return FALSE;
+  if(pathlist == NULL) return NULL;
+  //the cache only holds for the PATH it was filled from
+  if(pathCachePath == NULL || strcmp(pathCachePath, pathlist) != 0)
+  {
+    ClearPathCache();
+    pathCachePath = strdup(pathlist);
+  }
+  slot = PathCacheSlot(name);
+  if(*slot != NULL)
+  {
+    //one check instead of a stat per directory, it may be gone by now
+    if(access((*slot)->path, X_OK) == 0)
+    {
+      stats.pathHits++;
+      return strdup((*slot)->path);
+    }
+    entry = *slot;
+    *slot = entry->next;
+    free(entry->name);
+    free(entry->path);
+    free(entry);
+  }
+  stats.pathMisses++;
   i = 0;
   while(i<strlen(pathlist)){
     c = strchr(&(pathlist[i]),':');
@@ -205,69 +869,232 @@ static bool ResolveExternalCmd(commandT* cmd)
     }
     buf[j] = '\0';
     strcat(buf, "/");
-    strcat(buf,cmd->argv[0]);
+    strcat(buf,name);
     if(stat(buf, &fs) >= 0){
       if(S_ISDIR(fs.st_mode) == 0)
         if(access(buf,X_OK) == 0){/*Whether it's an executable or the user has required permisson to run it*/
-          cmd->name = strdup(buf); 
-          return TRUE;
+          //what a relative directory gives depends on the working directory
+          if(buf[0] == '/')
+          {
+            entry = (pathCacheL*) malloc(sizeof(pathCacheL));
+            entry->name = strdup(name);
+            entry->path = strdup(buf);
+            entry->next = NULL;
+            *slot = entry;
+          }
+          return strdup(buf);
         }
     }
   }
-  return FALSE; /*The command is not found or the user don't have enough priority to run.*/
+  return NULL; /*The command is not found or the user don't have enough priority to run.*/
 }
 
-static void Exec(commandT* cmd, bool forceFork)
+/*Returns the link to the entry of a command, or the empty link at the end
+ *of its bucket where it would go*/
+static pathCacheL** PathCacheSlot(char* name)
 {
-  pid_t child_pid;
-  sigset_t mask;
+  pathCacheL** slot;
 
-  //empty out the masking set
-  sigemptyset(&mask);
+  for(slot = &pathCache[HashName(name) & (PATHCACHE_BUCKETS - 1)]; *slot != NULL; slot = &(*slot)->next)
+  {
+    if(strcmp((*slot)->name, name) == 0)
+      break;
+  }
+  return slot;
+}
 
-  //add child signal to the mask
-  sigaddset(&mask, SIGCHLD);
+static unsigned long long HashName(char* name)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  char* c;
 
-  //block child signal
-  sigprocmask(SIG_BLOCK, &mask, NULL);
+  //FNV-1a, like the parse cache
+  for(c = name; *c != '\0'; c++)
+  {
+    hash ^= (unsigned char) *c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
 
-  //fork the process
-  child_pid = fork();
-  
-  if(child_pid == 0)
+/*The kernel would read the #! line and, for /usr/bin/env NAME, env would
+ *walk PATH again, on every run. The shell reads the line once per inode
+ *and mtime and execs the interpreter itself, with the argv the kernel
+ *would have built: the interpreter, its argument, the script and the
+ *arguments of the command. Under env the interpreter comes from the PATH
+ *cache and is called by NAME, as env would have.*/
+static void ResolveShebang(commandT* cmd)
+{
+  shebangCacheL **slot, *entry;
+  struct stat st;
+  char* interp;
+  int i, n = 0;
+
+  if(stat(cmd->name, &st) < 0)
+    return;
+  slot = ShebangSlot(cmd->name);
+  entry = *slot;
+  if(entry != NULL && entry->dev == st.st_dev && entry->ino == st.st_ino && entry->size == st.st_size
+     && entry->mtime.tv_sec == st.st_mtim.tv_sec && entry->mtime.tv_nsec == st.st_mtim.tv_nsec)
   {
-    //child process here
+    stats.shebangHits++;
+  }
+  else
+  {
+    if(entry == NULL)
+    {
+      entry = (shebangCacheL*) calloc(1, sizeof(shebangCacheL));
+      entry->path = strdup(cmd->name);
+      *slot = entry;
+    }
+    entry->dev = st.st_dev;
+    entry->ino = st.st_ino;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtim;
+    ReadShebang(entry);
+    stats.shebangMisses++;
+  }
+  if(entry->interp == NULL)
+    return;
 
-    //put the child process in a new process group
-    //this group's id is the child's pid
-    setpgid(0, 0);
+  cmd->execArgv = malloc(sizeof(char*) * (cmd->argc + 3));
+  if(entry->viaEnv && (interp = FindCmd(entry->arg)) != NULL)
+  {
+    cmd->execPath = interp;
+    cmd->execArgv[n++] = strdup(entry->arg);
+  }
+  else
+  {
+    cmd->execPath = strdup(entry->interp);
+    cmd->execArgv[n++] = strdup(entry->interp);
+    if(entry->arg != NULL)
+      cmd->execArgv[n++] = strdup(entry->arg);
+  }
+  cmd->execArgv[n++] = strdup(cmd->name);
+  for(i = 1; i < cmd->argc; i++)
+    cmd->execArgv[n++] = strdup(cmd->argv[i]);
+  cmd->execArgv[n] = NULL;
+}
 
-    //execute child process
-    execv(cmd->name, cmd->argv);
+/*Parsed like the kernel does: the interpreter up to a blank, the rest of
+ *the line without surrounding blanks is one argument. A line longer than
+ *the kernel reads is left to it.*/
+static void ReadShebang(shebangCacheL* entry)
+{
+  char buf[SHEBANG_MAX + 1];
+  char *p, *end, *name;
+  ssize_t n;
+  int fd;
 
-    //this should only display if the execution fails
-    fprintf(stdout, "Error executing child command: %s\n", cmd->cmdline);
+  free(entry->interp);
+  free(entry->arg);
+  entry->interp = entry->arg = NULL;
+  entry->viaEnv = FALSE;
+  if((fd = open(entry->path, O_RDONLY | O_CLOEXEC)) < 0)
+    return;
+  n = read(fd, buf, SHEBANG_MAX);
+  close(fd);
+  if(n < 2 || buf[0] != '#' || buf[1] != '!' || (end = memchr(buf, '\n', n)) == NULL)
+    return;
+  for(*end = '\0', end--; end > buf + 1 && (*end == ' ' || *end == '\t' || *end == '\r'); end--)
+    *end = '\0';
+  for(p = buf + 2; *p == ' ' || *p == '\t'; p++)
+    ;
+  if(*p == '\0')
+    return;
+  entry->interp = p;
+  for(; *p != '\0' && *p != ' ' && *p != '\t'; p++)
+    ;
+  if(*p != '\0')
+  {
+    for(*p++ = '\0'; *p == ' ' || *p == '\t'; p++)
+      ;
+    if(*p != '\0')
+      entry->arg = strdup(p);
   }
-  else if(child_pid > 0)
+  entry->interp = strdup(entry->interp);
+  //env with options or assignments does more than a PATH lookup
+  name = strrchr(entry->interp, '/');
+  entry->viaEnv = strcmp(name != NULL ? name + 1 : entry->interp, "env") == 0 && entry->arg != NULL
+                  && entry->arg[0] != '-' && strpbrk(entry->arg, " \t=") == NULL;
+}
+
+static shebangCacheL** ShebangSlot(char* path)
+{
+  shebangCacheL** slot;
+
+  for(slot = &shebangCache[HashName(path) & (PATHCACHE_BUCKETS - 1)]; *slot != NULL; slot = &(*slot)->next)
+  {
+    if(strcmp((*slot)->path, path) == 0)
+      break;
+  }
+  return slot;
+}
+
+static void ClearPathCache()
+{
+  pathCacheL *entry, *next;
+  int i;
+
+  for(i = 0; i < PATHCACHE_BUCKETS; i++)
   {
-    //parent process here
+    for(entry = pathCache[i]; entry != NULL; entry = next)
+    {
+      next = entry->next;
+      free(entry->name);
+      free(entry->path);
+      free(entry);
+    }
+    pathCache[i] = NULL;
+  }
+  free(pathCachePath);
+  pathCachePath = NULL;
+}
 
-    //set last_cmd so we know the last command entered
-    last_cmd = cmd->cmdline;
+static void Exec(commandT* cmd, bool forceFork)
+{
+  pid_t child_pid, pgid;
+  char *cgroup, *place;
+
+  //we already are the child, run the command in place
+  if(!forceFork)
+    ExecChild(cmd, -1, -1, NULL);
+
+  //a job with limits gets a cgroup of its own
+  cgroup = CreateJobCgroup(cmd->launch);
+  place = PlaceJob(&cmd, 1, cmd->bg);
+  ScheduleJob(&cmd, 1, cmd->bg);
+
+  //fork the process into its own process group
+  clock_gettime(CLOCK_MONOTONIC, &fgstart);
+  memset(&fgusage, 0, sizeof(fgusage));
+  //the processes of <(...) and >(...) already started the group
+  child_pid = SpawnCmd(cmd, substPgid, -1, -1, cgroup);
+  pgid = substPgid != 0 ? substPgid : child_pid;
+  //the child has its ends, the substituted processes see the end of
+  //what it writes when it is gone
+  CloseProcSubst();
+
+  if(child_pid > 0)
+  {
+    stats.jobsStarted++;
+    //set last_cmd so we know the last command entered, the job list owns it from here
+    last_cmd = strdup(cmd->cmdline);
+    last_cgroup = cgroup;
+    last_place = place;
+    last_argv = JobLogArgv(&cmd, 1);
     //if it is a background job
     if(cmd->bg)
     {
       //add to bg jobs
-      AddJobToBg(child_pid, 0);
-      //unblock child signals
-      sigprocmask(SIG_UNBLOCK, &mask, NULL);
+      AddJobToBg(pgid, 0, child_pid);
     }
     else
     {
-      //set foreground pid to the child pid
-      fgpid = child_pid;
-      //unblock child signals
-      sigprocmask(SIG_UNBLOCK, &mask, NULL);
+      //set foreground pid to the group of the child
+      fgpid = pgid;
+      fglast = child_pid;
+      LogJobEvent(JOBLOG_START, 0, pgid, child_pid, last_argv, 0, NULL, NULL);
       //reset stopped so we can loop
       stopped = 0;
       //wait for the foreground process to finish
@@ -275,24 +1102,353 @@ static void Exec(commandT* cmd, bool forceFork)
     }
   }
   else
+  {
+    RemoveJobCgroup(cgroup);
+    free(place);
+    lastStatus = 1;
+  }
+}
+
+/*Fork a child in the given process group (0 for a new one) with its stdin and
+ *stdout on the given fds (-1 to keep them), and exec the command in it*/
+static pid_t SpawnCmd(commandT* cmd, pid_t pgid, int in, int out, char* cgroup)
+{
+  pid_t child_pid;
+  struct timespec start;
+
+  //fork the process, or have the zygote do it
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  child_pid = ZygoteCmd(cmd, pgid, in, out, cgroup);
+  if(child_pid < 0)
+    child_pid = fork();
+
+  if(child_pid == 0)
+  {
+    //child process here
+
+    //put the child process in the job's process group
+    //a new group's id is the child's pid
+    setpgid(0, pgid);
+    ExecChild(cmd, in, out, cgroup);
+  }
+  else if(child_pid > 0)
+  {
+    //set the group from the parent as well, so it does not matter who runs first
+    setpgid(child_pid, pgid == 0 ? child_pid : pgid);
+    TrackProc(child_pid);
+    stats.forks++;
+    RecordSince(STATS_LAUNCH, &start);
+  }
+  else
   {
     //let us know that the fork failed
     fprintf(stdout, "Fork failed for command: %s\n", cmd->cmdline);
+    fflush(stdout);
   }
+  return child_pid;
+}
+
+/*The shell opens the redirections itself and hands the zygote what the
+ *child would have ended up with on each fd. Anything it cannot do, a
+ *builtin, launch options or a redirection that fails, is left to a fork,
+ *which also shows the error*/
+static pid_t ZygoteCmd(commandT* cmd, pid_t pgid, int in, int out, char* cgroup)
+{
+  int fds[ZYGOTE_MAXFDS], targets[ZYGOTE_MAXFDS], opened[4];
+  int nfds = 3, nopened = 0, fd, i;
+  pid_t pid = -1;
+  bool ok = TRUE;
+
+  if(!useZygote || IsBuiltIn(cmd->argv[0]) || !PlainLaunch(cmd->launch, cgroup)
+     || cmd->nsubstFds + 4 > ZYGOTE_MAXFDS)
+    return -1;
+
+  //in the order RedirectFds puts them
+  fds[0] = in >= 0 ? in : STDIN_FILENO;
+  fds[1] = out >= 0 ? out : STDOUT_FILENO;
+  fds[2] = STDERR_FILENO;
+  if(cmd->is_redirect_in)
+  {
+    ok = (fd = OpenRedirect(cmd->redirect_in, O_RDONLY)) >= 0;
+    if(ok) fds[0] = opened[nopened++] = fd;
+  }
+  if(ok && cmd->is_heredoc != HEREDOC_NONE && cmd->heredoc != NULL)
+  {
+    ok = (fd = OpenHeredoc(cmd)) >= 0;
+    if(ok) fds[0] = opened[nopened++] = fd;
+  }
+  if(ok && cmd->is_redirect_out)
+  {
+    ok = (fd = OpenRedirect(cmd->redirect_out, O_WRONLY | O_CREAT | O_TRUNC)) >= 0;
+    if(ok) fds[1] = opened[nopened++] = fd;
+  }
+  //the child changes into the shell's directory, whatever its path
+  if(ok)
+  {
+    ok = (fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC)) >= 0;
+    if(ok) fds[3] = opened[nopened++] = fd;
+  }
+
+  if(ok)
+  {
+    for(i = 0; i < 3; i++)
+      targets[i] = i;
+    targets[nfds++] = ZYGOTE_CWD;
+    //<(...) and >(...) are read through /dev/fd at the same numbers
+    for(i = 0; i < cmd->nsubstFds; i++)
+    {
+      fds[nfds] = targets[nfds] = cmd->substFds[i];
+      nfds++;
+    }
+    pid = ZygoteSpawn(cmd->execPath != NULL ? cmd->execPath : cmd->name, cmd->cmdline,
+                      cmd->execArgv != NULL ? cmd->execArgv : cmd->argv, pgid, fds, targets, nfds);
+  }
+  for(i = 0; i < nopened; i++)
+    close(opened[i]);
+  return pid;
+}
+
+/*Opens a redirection for the zygote without a word on failure, &N gives a
+ *copy of the shell's fd*/
+static int OpenRedirect(char* target, int flags)
+{
+  char* end;
+  long n;
+
+  if(target[0] != '&')
+    return open(target, flags | O_CLOEXEC, 0666);
+  n = strtol(target + 1, &end, 10);
+  if(end == target + 1 || *end != '\0' || n < 0 || n > INT_MAX)
+    return -1;
+  return fcntl((int) n, F_DUPFD_CLOEXEC, 0);
+}
+
+/*Runs in the child: undo the shell's signal setup, enter the limits,
+ *redirect and exec*/
+static void ExecChild(commandT* cmd, int in, int out, char* cgroup)
+{
+  sigset_t none;
+
+  EnterLaunch(cmd->launch, cgroup);
+
+  //undo what the shell set up for itself
+  signal(SIGPIPE, SIG_DFL);
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, NULL);
+
+  KeepProcSubst(cmd);
+  if(!RedirectFds(cmd, in, out))
+    _exit(1);
+
+  //builtins that end up in a pipeline run in the child
+  if(IsBuiltIn(cmd->argv[0]))
+  {
+    //there is no exec to drop the shell's other pipe ends, a filter would
+    //otherwise hold its own input open and never see the end of it
+    CloseOtherFds(cmd);
+    ForgetProcFiles();
+    RunBuiltInCmd(cmd);
+    fflush(stdout);
+    _exit(lastStatus);
+  }
+
+  //execute child process
+  if(cmd->execPath != NULL)
+    execv(cmd->execPath, cmd->execArgv);
+  else
+    execv(cmd->name, cmd->argv);
+
+  //this should only display if the execution fails
+  fprintf(stdout, "Error executing child command: %s\n", cmd->cmdline);
+  fflush(stdout);
+  _exit(126);
+}
+
+/*Point stdin and stdout at the given fds and then at the redirection files*/
+static bool RedirectFds(commandT* cmd, int in, int out)
+{
+  int fd;
+
+  if(in >= 0) dup2(in, STDIN_FILENO);
+  if(out >= 0) dup2(out, STDOUT_FILENO);
+  if(cmd->is_redirect_in && !RedirectFd(cmd->redirect_in, O_RDONLY, STDIN_FILENO))
+    return FALSE;
+  if(cmd->is_heredoc != HEREDOC_NONE && cmd->heredoc != NULL)
+  {
+    fd = OpenHeredoc(cmd);
+    if(fd < 0)
+    {
+      PrintPError("here-document");
+      return FALSE;
+    }
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+  }
+  if(cmd->is_redirect_out && !RedirectFd(cmd->redirect_out, O_WRONLY | O_CREAT | O_TRUNC, STDOUT_FILENO))
+    return FALSE;
+  return TRUE;
+}
+
+/*<&N and >&N duplicate an fd the shell has open, like ${COPROC[0]}*/
+static bool RedirectFd(char* target, int flags, int to)
+{
+  char* end;
+  long n;
+  int fd;
+
+  if(target[0] == '&')
+  {
+    n = strtol(target + 1, &end, 10);
+    if(end == target + 1 || *end != '\0' || n < 0 || n > INT_MAX || dup2((int) n, to) < 0)
+    {
+      fprintf(stderr, "%s: bad file descriptor\n", target);
+      return FALSE;
+    }
+    return TRUE;
+  }
+  fd = open(target, flags, 0666);
+  if(fd < 0)
+  {
+    PrintPError(target);
+    return FALSE;
+  }
+  dup2(fd, to);
+  close(fd);
+  return TRUE;
+}
+
+/*Hand out the body of a here-document: through a pipe when it fits into the
+ *pipe buffer, so one write is all it takes, otherwise through a sealed memfd
+ *the command reads straight from. Neither needs a writer process.*/
+static int OpenHeredoc(commandT* cmd)
+{
+  struct iovec iov[2];
+  int fds[2], fd, n = 1;
+  ssize_t len = strlen(cmd->heredoc);
+
+  iov[0].iov_base = cmd->heredoc;
+  iov[0].iov_len = len;
+  //a here-string ends with a newline
+  if(cmd->is_heredoc == HEREDOC_STRING)
+  {
+    iov[1].iov_base = "\n";
+    iov[1].iov_len = 1;
+    n = 2;
+    len++;
+  }
+
+  if(len <= HEREDOC_PIPE_MAX)
+  {
+    if(pipe(fds) < 0) return -1;
+    //an empty pipe always takes this much without blocking
+    if(writev(fds[1], iov, n) != len)
+    {
+      close(fds[0]);
+      fds[0] = -1;
+    }
+    close(fds[1]);
+    return fds[0];
+  }
+
+  fd = memfd_create("heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if(fd < 0) return -1;
+  if(writev(fd, iov, n) != len)
+  {
+    close(fd);
+    return -1;
+  }
+  //the body can no longer change under the reader
+  fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+  lseek(fd, 0, SEEK_SET);
+  return fd;
+}
+
+/*Run a builtin in the shell with its stdin and stdout pointed at the given
+ *fds and redirections, restoring the shell's own afterwards*/
+static void RunBuiltInCmdFds(commandT* cmd, int in, int out)
+{
+  int saved[2] = { -1, -1 };
+
+  if(in < 0 && out < 0 && !cmd->is_redirect_in && !cmd->is_redirect_out)
+  {
+    RunBuiltInCmd(cmd);
+    return;
+  }
+
+  fflush(stdout);
+  saved[0] = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+  saved[1] = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+  if(RedirectFds(cmd, in, out))
+    RunBuiltInCmd(cmd);
+  else
+    lastStatus = 1;
+  fflush(stdout);
+  dup2(saved[0], STDIN_FILENO);
+  dup2(saved[1], STDOUT_FILENO);
+  close(saved[0]);
+  close(saved[1]);
+}
+
+/*Join the commands of a pipeline back into one line for the job list*/
+static char* PipelineCmdline(commandT** cmd, int n)
+{
+  int i;
+  size_t len = 0;
+  char* line;
+
+  for(i = 0; i < n; i++)
+    len += strlen(cmd[i]->cmdline) + 3;
+  line = malloc(len + 1);
+  line[0] = '\0';
+  for(i = 0; i < n; i++)
+  {
+    if(i > 0) strcat(line, "| ");
+    strcat(line, cmd[i]->cmdline);
+    //parser_single leaves the blank before the next '|'
+    if(i < n - 1 && line[strlen(line) - 1] != ' ') strcat(line, " ");
+  }
+  return line;
 }
 
 static bool IsBuiltIn(char* cmd)
 {
-  //check for fg, bg, jobs, and cd as builtin commands
-  return strcmp(cmd, "fg") == 0 
+  //check for fg, bg, jobs, wait, stats, coproc, cache, cd, parsecache, ulimit, pin, shopt, the utilities and tee as builtin commands
+  return IsUtilityBuiltIn(cmd)
+      || IsFilterBuiltIn(cmd)
+      || strcmp(cmd, "fg") == 0 
       || strcmp(cmd, "bg") == 0
       || strcmp(cmd, "jobs") == 0
-      || strcmp(cmd, "cd") == 0;   
+      || strcmp(cmd, "wait") == 0
+      || strcmp(cmd, "stats") == 0
+      || strcmp(cmd, "coproc") == 0
+      || strcmp(cmd, "cache") == 0
+      || strcmp(cmd, "cd") == 0
+      || strcmp(cmd, "parsecache") == 0
+      || strcmp(cmd, "ulimit") == 0
+      || strcmp(cmd, "pin") == 0
+      || strcmp(cmd, "shopt") == 0;
 }
 
 
 static void RunBuiltInCmd(commandT* cmd)
 { 
+  //builtins succeed unless they say otherwise
+  lastStatus = 0;
+
+  // Execute echo, printf, test, true, false, and pwd
+  if(IsUtilityBuiltIn(cmd->argv[0]))
+  {
+    lastStatus = RunUtilityBuiltIn(cmd);
+    return;
+  }
+
+  // Execute tee, in a child
+  if(IsFilterBuiltIn(cmd->argv[0]))
+  {
+    lastStatus = RunFilterBuiltIn(cmd);
+    return;
+  }
+
   // Execute cd
   if(!strcmp(cmd->argv[0],"cd"))
   {
@@ -301,18 +1457,18 @@ static void RunBuiltInCmd(commandT* cmd)
     {
       //go HOME
       int ret = chdir(getenv("HOME"));
-      //need this if for compiler warnings about ret even thought we don't do anything
       if(ret == -1)
       {
+        lastStatus = 1;
       }
     } 
     else
     {
       //try to go where it tells us
       int ret = chdir(cmd->argv[1]);
-      //need this if for compiler warnings about ret even thought we don't do anything
       if(ret == -1)
       {
+        lastStatus = 1;
       }
     } 
   }
@@ -351,122 +1507,657 @@ static void RunBuiltInCmd(commandT* cmd)
       //if we found it
       if(jobPointer != NULL)
       {
+        //it competes with the foreground again, give way to it
+        if(BGSCHED_ON() && !jobPointer->demoted)
+        {
+          if(!JobPriority(jobPointer, TRUE))
+            fprintf(stderr, "bg: could not lower the priority of every process\n");
+          jobPointer->demoted = TRUE;
+        }
         //send it a SIGCONT signal
-        kill(-jobPointer->pid, SIGCONT);
+        SignalJob(jobPointer->pid, jobPointer->procs, jobPointer->nprocs, SIGCONT);
         //set status to running
         jobPointer->status = "Running\0";
+        LogJobEvent(JOBLOG_CONT, jobPointer->id, jobPointer->pid, jobPointer->last, jobPointer->argv, 0, NULL, NULL);
+      }
+    }
+  }
+  // Execute jobs
+  else if (strcmp(cmd->argv[0], "jobs") == 0)
+  {
+    //get job list
+    struct bgjob_l* jobPointer = bgjobs;
+    //-l adds the processes, placement and what they use, -v the cgroup's usage too
+    bool showPlace = FALSE, showUsage = FALSE;
+    procstatT* stats = NULL;
+    int i, k, njobs = 0;
+    for(i = 1; i < cmd->argc && cmd->argv[i][0] == '-'; i++)
+    {
+      if(strchr(cmd->argv[i], 'l') != NULL) showPlace = TRUE;
+      if(strchr(cmd->argv[i], 'v') != NULL) showUsage = TRUE;
+    }
+    //read /proc for every job in one go before anything is printed
+    if(showPlace || showUsage)
+    {
+      for(jobPointer = bgjobs; jobPointer != NULL; jobPointer = jobPointer->next)
+        njobs++;
+      stats = (procstatT*) calloc(njobs + 1, sizeof(procstatT));
+      for(i = 0, jobPointer = bgjobs; jobPointer != NULL; i++, jobPointer = jobPointer->next)
+      {
+        for(k = 0; k < jobPointer->nprocs; k++)
+          ReadProcStat(jobPointer->procs[k].pid, jobPointer->procs[k].files, jobPointer->pid, &stats[i]);
       }
+      jobPointer = bgjobs;
     }
+    //if there is a job list, go through it
+    if(jobPointer != NULL)
+    {
+      //while we have a job
+      for(i = 0; jobPointer != NULL; i++)
+      {
+        //print out status
+        printf("[%d] %-24s%s%s\n", jobPointer->id, jobPointer->status, jobPointer->cmdline, strcmp(jobPointer->status, "Running") == 0 ?  " &" : "");
+        if(showPlace || showUsage)
+        {
+          printf("    pgid %d, pid", jobPointer->pid);
+          for(k = 0; k < jobPointer->nprocs; k++)
+            printf(" %d", jobPointer->procs[k].pid);
+          printf("%s, %s\n", jobPointer->nprocs > 0 ? "" : " none left", jobPointer->place != NULL ? jobPointer->place : "not pinned");
+          PrintJobStats(&stats[i]);
+        }
+        if(showUsage)
+          PrintJobUsage(jobPointer->cgroup);
+        //move to next job
+        jobPointer = jobPointer->next;
+      }
+      fflush(stdout);
+      //if any jobs are complete, remove them
+      removeCompletedJobs();
+    }
+    free(stats);
+  }
+  // Execute fg
+  else if (strcmp(cmd->argv[0], "fg") == 0){
+    struct bgjob_l* job = bgjobs;
+    //if we have background jobs
+    if(job != NULL)
+    {
+      // if just fg
+      if(cmd->argc < 2) 
+      {
+        //find most recent job
+        while(job->next != NULL)
+        {
+          job = job->next;
+        }
+      }
+      else
+      { // get job number to get
+        int job_num = atoi(cmd->argv[1]);
+        //find given job if it exists
+        while(job != NULL)
+        {
+          if(job->id == job_num)
+          {
+            break;
+          }
+          job = job->next;
+        }
+      }
+      //no such job
+      if(job == NULL)
+      {
+        lastStatus = 1;
+        return;
+      }
+      //if the job is running, stop it
+      if(strcmp(job->status, "Running") == 0)
+      {
+        SignalJob(job->pid, job->procs, job->nprocs, SIGTSTP);
+      }
+      //back to normal priority now that the user waits for it
+      if(job->demoted && !JobPriority(job, FALSE))
+        fprintf(stderr, "fg: could not restore the priority of every process\n");
+      //update foreground pid to equal the selected job's pid
+      fgpid = job->pid;
+      DetachProcs(job);
+      fgproc = job->procs;
+      fgprocs = job->nprocs;
+      job->procs = NULL;
+      job->nprocs = 0;
+      fglast = job->last;
+      fgstart = job->started;
+      fgusage = job->usage;
+      last_argv = job->argv;
+      job->argv = NULL;
+      //take over the cmdline in case the job gets stopped again
+      last_cmd = job->cmdline;
+      job->cmdline = NULL;
+      last_cgroup = job->cgroup;
+      job->cgroup = NULL;
+      last_place = job->place;
+      job->place = NULL;
+      //continue the job
+      SignalJob(fgpid, fgproc, fgprocs, SIGCONT);
+      LogJobEvent(JOBLOG_CONT, job->id, fgpid, fglast, last_argv, 0, NULL, NULL);
+      //reset stopped value so we can loop
+      stopped = 0;
+      //remove the job from the background jobs list
+      RemoveJob(fgpid);
+      //wait for the new foreground job to finish
+      wait_fg();
+    }
+    else
+    {
+      lastStatus = 1;
+    }
+  }
+  // Execute parsecache
+  else if (strcmp(cmd->argv[0], "parsecache") == 0)
+  {
+    //-c drops the cached parse trees, otherwise show the hit rate
+    if(cmd->argc > 1 && strcmp(cmd->argv[1], "-c") == 0)
+    {
+      ClearParseCache();
+    }
+    else
+    {
+      PrintParseCacheStats();
+    }
+  }
+  // Execute ulimit
+  else if (strcmp(cmd->argv[0], "ulimit") == 0)
+  {
+    lastStatus = RunUlimit(cmd);
+  }
+  // Execute pin
+  else if (strcmp(cmd->argv[0], "pin") == 0)
+  {
+    lastStatus = RunPin(cmd);
+  }
+  // Execute shopt
+  else if (strcmp(cmd->argv[0], "shopt") == 0)
+  {
+    lastStatus = RunShopt(cmd);
+  }
+  // Execute wait
+  else if (strcmp(cmd->argv[0], "wait") == 0)
+  {
+    lastStatus = RunWait(cmd);
+  }
+  // Execute stats
+  else if (strcmp(cmd->argv[0], "stats") == 0)
+  {
+    lastStatus = RunStats(cmd);
+  }
+  // Execute coproc
+  else if (strcmp(cmd->argv[0], "coproc") == 0)
+  {
+    lastStatus = RunCoproc(cmd);
+  }
+  // Execute cache
+  else if (strcmp(cmd->argv[0], "cache") == 0)
+  {
+    lastStatus = RunCache(cmd);
+  }
+}
+
+/*coproc starts a command as a background job with its stdin and stdout on
+ *pipes to the shell. The shell's ends are ${COPROC[1]} to write to it and
+ *${COPROC[0]} to read from it, for redirections like >&${COPROC[1]}; they
+ *are close-on-exec, so no other command holds them open.*/
+static int RunCoproc(commandT* cmd)
+{
+  commandT* co;
+  int toCo[2] = { -1, -1 }, fromCo[2] = { -1, -1 }, i;
+  char *cgroup, *place;
+  char num[16];
+  pid_t pid, pgid;
+
+  if(cmd->argc < 2)
+  {
+    fprintf(stderr, "coproc: usage: coproc command [args]\n");
+    return 2;
+  }
+  //the command without coproc in front, with the fds of its substitutions
+  co = CreateCmdT(cmd->argc - 1);
+  for(i = 1; i < cmd->argc; i++)
+    co->argv[i - 1] = strdup(cmd->argv[i]);
+  co->cmdline = strdup(cmd->cmdline);
+  co->substFds = cmd->substFds;
+  co->nsubstFds = cmd->nsubstFds;
+  cmd->substFds = NULL;
+  cmd->nsubstFds = 0;
+  if(!TakeLaunchPrefix(co))
+  {
+    ReleaseCmdT(&co);
+    return 2;
+  }
+  if(!IsBuiltIn(co->argv[0]) && !ResolveExternalCmd(co))
+  {
+    printf("%s: command not found\n", co->argv[0]);
+    fflush(stdout);
+    stats.execFailures++;
+    ReleaseCmdT(&co);
+    return 127;
+  }
+  if(pipe2(toCo, O_CLOEXEC) < 0 || pipe2(fromCo, O_CLOEXEC) < 0)
+  {
+    PrintPError("coproc: pipe");
+    if(toCo[0] >= 0)
+    {
+      close(toCo[0]);
+      close(toCo[1]);
+    }
+    ReleaseCmdT(&co);
+    return 1;
+  }
+
+  cgroup = CreateJobCgroup(co->launch);
+  place = PlaceJob(&co, 1, TRUE);
+  ScheduleJob(&co, 1, TRUE);
+  clock_gettime(CLOCK_MONOTONIC, &fgstart);
+  memset(&fgusage, 0, sizeof(fgusage));
+  pid = SpawnCmd(co, substPgid, toCo[0], fromCo[1], cgroup);
+  pgid = substPgid != 0 ? substPgid : pid;
+  CloseProcSubst();
+  close(toCo[0]);
+  close(fromCo[1]);
+  if(pid <= 0)
+  {
+    close(toCo[1]);
+    close(fromCo[0]);
+    RemoveJobCgroup(cgroup);
+    free(place);
+    ReleaseCmdT(&co);
+    return 1;
+  }
+
+  stats.jobsStarted++;
+  last_cmd = strdup(cmd->cmdline);
+  last_cgroup = cgroup;
+  last_place = place;
+  last_argv = JobLogArgv(&co, 1);
+  AddJobToBg(pgid, 0, pid);
+  ReleaseCmdT(&co);
+
+  //like bash, one coprocess at a time has the variables
+  CloseCoproc();
+  coprocPgid = pgid;
+  coprocFds[0] = fromCo[0];
+  coprocFds[1] = toCo[1];
+  snprintf(num, sizeof(num), "%d", coprocFds[0]);
+  SetVar("COPROC", num);
+  SetVar("COPROC[0]", num);
+  snprintf(num, sizeof(num), "%d", coprocFds[1]);
+  SetVar("COPROC[1]", num);
+  snprintf(num, sizeof(num), "%d", (int) pid);
+  SetVar("COPROC_PID", num);
+  return 0;
+}
+
+static void CloseCoproc()
+{
+  if(coprocPgid == 0)
+    return;
+  close(coprocFds[0]);
+  close(coprocFds[1]);
+  coprocFds[0] = coprocFds[1] = -1;
+  coprocPgid = 0;
+  UnsetVar("COPROC");
+  UnsetVar("COPROC[0]");
+  UnsetVar("COPROC[1]");
+  UnsetVar("COPROC_PID");
+}
+
+/*wait waits for every running job, wait %n or wait pid for those jobs and
+ *wait -n for the next job to end. The loop sleeps until a process changes
+ *and only the job it belongs to is looked at*/
+static int RunWait(commandT* cmd)
+{
+  bgjobL* job;
+  int i, status = 0;
+
+  interrupted = FALSE;
+  //reap what has ended already
+  WaitEvents(FALSE, 0);
+  if(cmd->argc > 1 && strcmp(cmd->argv[1], "-n") == 0)
+  {
+    while(doneHead == NULL && liveJobs > 0 && !interrupted)
+      WaitEvents(FALSE, -1);
+    if(interrupted)
+      return 128 + SIGINT;
+    if(doneHead == NULL)
+      return 127;
+    //it has been waited for, it is not reported anymore
+    job = doneHead;
+    status = job->exitStatus;
+    UnlinkJob(job);
+    return status;
+  }
+  if(cmd->argc == 1)
+  {
+    //ended jobs are still reported at the prompt
+    for(job = bgjobs; job != NULL; job = job->next)
+    {
+      if(!WaitJob(job))
+        return 128 + SIGINT;
+    }
+    return 0;
+  }
+  for(i = 1; i < cmd->argc; i++)
+  {
+    if((job = FindJob(cmd->argv[i])) == NULL)
+    {
+      fprintf(stderr, "wait: %s: no such job\n", cmd->argv[i]);
+      status = 127;
+      continue;
+    }
+    if(!WaitJob(job))
+      return 128 + SIGINT;
+    if(job->nprocs > 0)
+    {
+      //stopped, it stays a job
+      status = 128 + SIGTSTP;
+      continue;
+    }
+    status = job->exitStatus;
+    UnlinkJob(job);
+  }
+  return status;
+}
+
+/*Returns false if ctrl+c came first*/
+static bool WaitJob(bgjobL* job)
+{
+  while(job->nprocs > 0 && strcmp(job->status, "Stopped") != 0 && !interrupted)
+    WaitEvents(FALSE, -1);
+  return !interrupted;
+}
+
+static bgjobL* FindJob(char* arg)
+{
+  bgjobL* job;
+  char* end;
+  long n;
+
+  n = strtol(arg[0] == '%' ? arg + 1 : arg, &end, 10);
+  if(*end != '\0' || end == arg || n <= 0)
+    return NULL;
+  if(arg[0] != '%' && (job = PidJob(n)) != NULL)
+    return job;
+  //a job id, or the pid of a process that has ended already
+  for(job = bgjobs; job != NULL; job = job->next)
+  {
+    if(arg[0] == '%' ? job->id == n : job->pid == n || job->last == n)
+      return job;
   }
-  // Execute jobs
-  else if (strcmp(cmd->argv[0], "jobs") == 0)
+  return NULL;
+}
+
+/*shopt lists every option, shopt NAME shows one and shopt NAME=VALUE sets it*/
+static int RunShopt(commandT* cmd)
+{
+  shoptT* opt;
+  char *eq, *end;
+  int i, j;
+  long value;
+
+  if(cmd->argc == 1)
   {
-    //get job list
-    struct bgjob_l* jobPointer = bgjobs;
-    //if there is a job list, go through it
-    if(jobPointer != NULL)
+    for(j = 0; j < NSHOPTS; j++)
+      PrintShopt(&shopts[j]);
+    fflush(stdout);
+    return 0;
+  }
+  for(i = 1; i < cmd->argc; i++)
+  {
+    eq = strchr(cmd->argv[i], '=');
+    for(j = 0; j < NSHOPTS; j++)
     {
-      //while we have a job
-      while(jobPointer != NULL)
-      {
-        //print out status
-        printf("[%d] %-24s%s%s\n", jobPointer->id, jobPointer->status, jobPointer->cmdline, strcmp(jobPointer->status, "Running") == 0 ?  " &" : "");
-        fflush(stdout);
-        //move to next job
-        jobPointer = jobPointer->next;
-      }
-      //if any jobs are complete, remove them
-      removeCompletedJobs();
+      if(eq == NULL ? strcmp(shopts[j].name, cmd->argv[i]) == 0
+                    : strncmp(shopts[j].name, cmd->argv[i], eq - cmd->argv[i]) == 0 && shopts[j].name[eq - cmd->argv[i]] == '\0')
+        break;
     }
-  }
-  // Execute fg
-  else if (strcmp(cmd->argv[0], "fg") == 0){
-    struct bgjob_l* job = bgjobs;
-    //if we have background jobs
-    if(job != NULL)
+    if(j == NSHOPTS)
     {
-      // if just fg
-      if(cmd->argc < 2) 
-      {
-        //find most recent job
-        while(job->next != NULL)
-        {
-          job = job->next;
-        }
-      }
-      else
-      { // get job number to get
-        int job_num = atoi(cmd->argv[1]);
-        //find given job if it exists
-        while(job != NULL)
-        {
-          if(job->id == job_num)
-          {
-            break;
-          }
-          job = job->next;
-        }
-      }
-      //if the job is running, stop it
-      if(job != NULL && strcmp(job->status, "Running") == 0)
-      {
-        kill(-job->pid, SIGTSTP);
-      }
-      //update foreground pid to equal the selected job's pid
-      fgpid = job->pid;
-      //continue the job
-      kill(-job->pid, SIGCONT);
-      //reset stopped value so we can loop
-      stopped = 0;
-      //remove the job from the background jobs list
-      RemoveJob(fgpid);
-      //wait for the new foreground job to finish
-      wait_fg();
+      fprintf(stderr, "shopt: no such option '%s'\n", cmd->argv[i]);
+      return 1;
+    }
+    opt = &shopts[j];
+    if(eq == NULL)
+    {
+      PrintShopt(opt);
+      continue;
+    }
+    if(opt->set != NULL)
+    {
+      //it reports its own errors
+      if(!opt->set(eq + 1))
+        return 1;
+      continue;
+    }
+    if(opt->words != NULL)
+    {
+      for(value = 0; opt->words[value] != NULL && strcmp(opt->words[value], eq + 1) != 0; value++)
+        ;
+      end = opt->words[value] != NULL ? "" : eq + 1;
+    }
+    else
+    {
+      value = strtol(eq + 1, &end, 10);
+      if(end == eq + 1 || value < opt->min || value > opt->max)
+        end = eq + 1;
+    }
+    if(*end != '\0' || *(eq + 1) == '\0')
+    {
+      fprintf(stderr, "shopt: invalid value '%s' for %s\n", eq + 1, opt->name);
+      return 1;
     }
+    *opt->value = (int) value;
   }
+  fflush(stdout);
+  return 0;
+}
+
+static void PrintShopt(shoptT* opt)
+{
+  if(opt->text != NULL)
+    printf("%-12s%s\n", opt->name, *opt->text != NULL ? *opt->text : "off");
+  else if(opt->words != NULL)
+    printf("%-12s%s\n", opt->name, opt->words[*opt->value]);
+  else
+    printf("%-12s%d\n", opt->name, *opt->value);
 }
 
 void CheckJobs()
 {
-  bgjobL* jobs = bgjobs;
+  bgjobL* job;
+
+  //pick up what the loop has not seen yet
+  WaitEvents(FALSE, 0);
+  //only the jobs that have ended are looked at
+  while((job = doneHead) != NULL)
+  {
+    Dequeue(job);
+    //a served request goes back to its client, whatever the end
+    if(job->reply >= 0)
+    {
+      ReplyJob(job->reply, job->exitStatus, &job->usage);
+      UnlinkJob(job);
+    }
+    //a job killed by a signal stays in the list as Error
+    else if(strcmp(job->status, "Done") == 0)
+    {
+      //print out id, status, and cmd line, above the line being edited
+      HideEditLine();
+      printf("[%d] %-24s%s\n", job->id, "Done", job->cmdline);
+      fflush(stdout);
+      //remove it since it has been displayed
+      UnlinkJob(job);
+    }
+  }
+}
+
+void JobChanged(pid_t pid)
+{
+  bgjobL* job = PidJob(pid);
+
+  if(job != NULL)
+  {
+    ReapJob(job);
+  }
+  else if(rawProcs)
+  {
+    //SIGCHLDs that come together only tell one pid
+    for(job = bgjobs; job != NULL; job = job->next)
+      ReapJob(job);
+  }
+}
+
+static void ReapJob(bgjobL* job)
+{
   pid_t endid;
   int status;
-  while(jobs != NULL)
-  {
-    //get the endid for the current job
-    endid = waitpid(jobs->pid, &status, WNOHANG|WUNTRACED);
 
-    //if it is equal to the job pid, then it has exited
-    if(endid == jobs->pid)
+  //reap whatever processes of the job have changed
+  while((endid = ReapProc(job->procs, &job->nprocs, &status, &job->usage)) > 0)
+  {
+    //check if the process was stopped
+    if(WIFSTOPPED(status))
     {
-      //check if it exited normally
-      if(WIFEXITED(status))
+      if(strcmp(job->status, "Stopped") != 0)
       {
-        //if it has, print out id, status, and cmd line
-        printf("[%d] %-24s%s\n", jobs->id, "Done", jobs->cmdline);
-        fflush(stdout);
-        //set status to done
-        jobs->status = (char*) "Done\0";
+        stats.jobsStopped++;
+        LogJobEvent(JOBLOG_STOP, job->id, job->pid, job->last, job->argv, 0, NULL, NULL);
       }
+      //set status to stopped
+      job->status = (char*) "Stopped\0";
+      continue;
+    }
+    ForgetPid(endid);
+    if(WIFEXITED(status) && WEXITSTATUS(status) == 126)
+      stats.execFailures++;
+    //the last process of a pipeline decides how the job ended
+    if(endid == job->last || job->last < 0)
+    {
+      job->exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
       //check if there was an uncaught signal
-      else if(WIFSIGNALED(status))
+      if(WIFSIGNALED(status))
       {
         //set status to error
-        jobs->status = (char*) "Error\0";
-      }
-      //check if the process was stopped
-      else if(WIFSTOPPED(status))
-      {
-        //set status to stopped
-        jobs->status = (char*) "Stopped\0";
+        job->status = (char*) "Error\0";
+        stats.jobsKilled++;
       }
     }
-    //move on to next job
-    jobs = jobs->next; 
+    if(job->nprocs == 0)
+    {
+      liveJobs--;
+      RecordSince(STATS_JOB, &job->started);
+      LogJobEvent(JOBLOG_EXIT, job->id, job->pid, job->last, job->argv, job->exitStatus, &job->started, &job->usage);
+      if(strcmp(job->status, "Error") != 0)
+        job->status = (char*) "Done\0";
+      //queue it to be reported at the prompt
+      job->queued = TRUE;
+      job->doneNext = NULL;
+      if(doneTail != NULL)
+        doneTail->doneNext = job;
+      else
+        doneHead = job;
+      doneTail = job;
+    }
+  }
+}
+
+static void Dequeue(bgjobL* job)
+{
+  bgjobL* prev = NULL;
+  bgjobL* cur;
+
+  if(!job->queued)
+    return;
+  //it is nearly always the head
+  for(cur = doneHead; cur != job; cur = cur->doneNext)
+    prev = cur;
+  if(prev != NULL)
+    prev->doneNext = job->doneNext;
+  else
+    doneHead = job->doneNext;
+  if(doneTail == job)
+    doneTail = prev;
+  job->queued = FALSE;
+}
+
+static void IndexPid(pid_t pid, bgjobL* job)
+{
+  pidslotT* old = pidSlots;
+  int oldSize = pidSlotsSize, i;
+
+  if(2 * (pidSlotsUsed + 1) > pidSlotsSize)
+  {
+    pidSlotsSize = pidSlotsSize > 0 ? 2 * pidSlotsSize : 64;
+    pidSlots = calloc(pidSlotsSize, sizeof(pidslotT));
+    pidSlotsUsed = 0;
+    for(i = 0; i < oldSize; i++)
+    {
+      if(old[i].pid > 0)
+        IndexPid(old[i].pid, old[i].job);
+    }
+    free(old);
+  }
+  for(i = PIDSLOT(pid); pidSlots[i].pid > 0; i = (i + 1) & (pidSlotsSize - 1))
+    ;
+  pidSlots[i].pid = pid;
+  pidSlots[i].job = job;
+  pidSlotsUsed++;
+}
+
+static bgjobL* PidJob(pid_t pid)
+{
+  int i;
+
+  if(pidSlotsSize == 0)
+    return NULL;
+  for(i = PIDSLOT(pid); pidSlots[i].pid > 0; i = (i + 1) & (pidSlotsSize - 1))
+  {
+    if(pidSlots[i].pid == pid)
+      return pidSlots[i].job;
+  }
+  return NULL;
+}
+
+static void ForgetPid(pid_t pid)
+{
+  int mask = pidSlotsSize - 1, i, j, home;
+
+  if(pidSlotsSize == 0)
+    return;
+  for(i = PIDSLOT(pid); pidSlots[i].pid != pid; i = (i + 1) & mask)
+  {
+    if(pidSlots[i].pid == 0)
+      return;
   }
-  //remove all completed jobs since they have been displayed
-  removeCompletedJobs();
-  
+  //move back the entries that had to probe past the hole
+  for(j = (i + 1) & mask; pidSlots[j].pid > 0; j = (j + 1) & mask)
+  {
+    home = PIDSLOT(pidSlots[j].pid);
+    if(i <= j ? (i < home && home <= j) : (i < home || home <= j))
+      continue;
+    pidSlots[i] = pidSlots[j];
+    i = j;
+  }
+  pidSlots[i].pid = 0;
+  pidSlotsUsed--;
+}
+
+static void DetachProcs(bgjobL* job)
+{
+  int i;
+
+  for(i = 0; i < job->nprocs; i++)
+    ForgetPid(job->procs[i].pid);
+  if(job->nprocs > 0)
+    liveJobs--;
 }
 
 
@@ -478,34 +2169,116 @@ commandT* CreateCmdT(int n)
   cd -> cmdline = NULL;
   cd -> is_redirect_in = cd -> is_redirect_out = 0;
   cd -> redirect_in = cd -> redirect_out = NULL;
+  cd -> heredoc = cd -> heredoc_delim = NULL;
+  cd -> is_heredoc = HEREDOC_NONE;
+  cd -> heredoc_quoted = 0;
+  cd -> launch = NULL;
+  cd -> substFds = NULL;
+  cd -> nsubstFds = 0;
+  cd -> execPath = NULL;
+  cd -> execArgv = NULL;
+  cd -> shared = FALSE;
   cd -> argc = n;
   for(i = 0; i <=n; i++)
     cd -> argv[i] = NULL;
   return cd;
 }
 
+char* getCurrentWorkingDir()
+{
+  //getcwd allocates a buffer of the right size
+  return getcwd(NULL, 0);
+}
+
+/*Deep copy a parsed commandT struct, used to hand out cached parse trees*/
+commandT* CopyCmdT(commandT* cmd)
+{
+  int i;
+  commandT* cd = CreateCmdT(cmd->argc);
+  cd->bg = cmd->bg;
+  if(cmd->cmdline != NULL) cd->cmdline = strdup(cmd->cmdline);
+  cd->is_redirect_in = cmd->is_redirect_in;
+  cd->is_redirect_out = cmd->is_redirect_out;
+  if(cmd->redirect_in != NULL) cd->redirect_in = strdup(cmd->redirect_in);
+  if(cmd->redirect_out != NULL) cd->redirect_out = strdup(cmd->redirect_out);
+  cd->is_heredoc = cmd->is_heredoc;
+  cd->heredoc_quoted = cmd->heredoc_quoted;
+  if(cmd->heredoc != NULL) cd->heredoc = strdup(cmd->heredoc);
+  if(cmd->heredoc_delim != NULL) cd->heredoc_delim = strdup(cmd->heredoc_delim);
+  if(cmd->launch != NULL)
+  {
+    cd->launch = (launchT*) malloc(sizeof(launchT));
+    *cd->launch = *cmd->launch;
+  }
+  for(i = 0; i < cmd->argc; i++)
+    if(cmd->argv[i] != NULL) cd->argv[i] = strdup(cmd->argv[i]);
+  return cd;
+}
+
+/*Copy a commandT struct that keeps pointing to the strings of cmd*/
+commandT* ShareCmdT(commandT* cmd)
+{
+  commandT* cd = CreateCmdT(cmd->argc);
+  cd->shared = TRUE;
+  cd->bg = cmd->bg;
+  cd->cmdline = cmd->cmdline;
+  cd->is_redirect_in = cmd->is_redirect_in;
+  cd->is_redirect_out = cmd->is_redirect_out;
+  cd->redirect_in = cmd->redirect_in;
+  cd->redirect_out = cmd->redirect_out;
+  cd->is_heredoc = cmd->is_heredoc;
+  cd->heredoc_quoted = cmd->heredoc_quoted;
+  cd->heredoc = cmd->heredoc;
+  cd->heredoc_delim = cmd->heredoc_delim;
+  if(cmd->launch != NULL)
+  {
+    cd->launch = (launchT*) malloc(sizeof(launchT));
+    *cd->launch = *cmd->launch;
+  }
+  memcpy(cd->argv, cmd->argv, sizeof(char*) * cmd->argc);
+  return cd;
+}
+
 /*Release and collect the space of a commandT struct*/
 void ReleaseCmdT(commandT **cmd){
   int i;
   if((*cmd)->name != NULL) free((*cmd)->name);
-  if((*cmd)->cmdline != NULL) free((*cmd)->cmdline);
-  if((*cmd)->redirect_in != NULL) free((*cmd)->redirect_in);
-  if((*cmd)->redirect_out != NULL) free((*cmd)->redirect_out);
-  for(i = 0; i < (*cmd)->argc; i++)
-    if((*cmd)->argv[i] != NULL) free((*cmd)->argv[i]);
+  if(!(*cmd)->shared)
+  {
+    if((*cmd)->cmdline != NULL) free((*cmd)->cmdline);
+    if((*cmd)->redirect_in != NULL) free((*cmd)->redirect_in);
+    if((*cmd)->redirect_out != NULL) free((*cmd)->redirect_out);
+    if((*cmd)->heredoc != NULL) free((*cmd)->heredoc);
+    if((*cmd)->heredoc_delim != NULL) free((*cmd)->heredoc_delim);
+    for(i = 0; i < (*cmd)->argc; i++)
+      if((*cmd)->argv[i] != NULL) free((*cmd)->argv[i]);
+  }
+  if((*cmd)->launch != NULL) free((*cmd)->launch);
+  free((*cmd)->substFds);
+  free((*cmd)->execPath);
+  for(i = 0; (*cmd)->execArgv != NULL && (*cmd)->execArgv[i] != NULL; i++)
+    free((*cmd)->execArgv[i]);
+  free((*cmd)->execArgv);
   free(*cmd);
 }
 
 /*Adds a job to the background jobs list*/
-void AddJobToBg(pid_t pid, int stopped){
+void AddJobToBg(pid_t pid, int stopped, pid_t lastpid){
   //make variables
   bgjobL* last = bgjobs;
   bgjobL* toAdd = (bgjobL*) malloc(sizeof(bgjobL));
+  int i;
 
   //set next to null for the job to be added, since it is at the end of the list
   toAdd->next = NULL;
   //set the pid for the job to the appropriate pid
   toAdd->pid = pid;
+  //the job takes over the processes just started or stopped
+  toAdd->procs = fgproc;
+  toAdd->nprocs = fgprocs;
+  fgproc = NULL;
+  fgprocs = 0;
+  toAdd->last = lastpid;
   //set previous to null, will be replaced later if needed
   toAdd->prev = NULL;
   //set status to running
@@ -515,8 +2288,37 @@ void AddJobToBg(pid_t pid, int stopped){
   {
     toAdd->status = (char*) "Stopped\0";
   }
-  //set the cmdline of the new job
+  //set the cmdline of the new job, the job owns it now
   toAdd->cmdline = last_cmd;
+  last_cmd = NULL;
+  toAdd->cgroup = last_cgroup;
+  last_cgroup = NULL;
+  toAdd->place = last_place;
+  last_place = NULL;
+  //jobs started with & were demoted if any option was on
+  toAdd->demoted = !stopped && BGSCHED_ON();
+  toAdd->prio = NULL;
+  toAdd->nprio = 0;
+  if(toAdd->demoted)
+  {
+    toAdd->prio = malloc(sizeof(prioT));
+    toAdd->nprio = 1;
+    LaunchPriority(toAdd->prio);
+  }
+  toAdd->exitStatus = 0;
+  toAdd->started = fgstart;
+  toAdd->usage = fgusage;
+  toAdd->argv = last_argv;
+  last_argv = NULL;
+  toAdd->reply = jobReply;
+  jobReply = -1;
+  toAdd->queued = FALSE;
+  toAdd->doneNext = NULL;
+  //a change of any of its processes leads straight to the job
+  for(i = 0; i < toAdd->nprocs; i++)
+    IndexPid(toAdd->procs[i].pid, toAdd);
+  if(toAdd->nprocs > 0)
+    liveJobs++;
 
   //if bgjobs is empty, set last to the job being added
   if(last == NULL)
@@ -539,9 +2341,11 @@ void AddJobToBg(pid_t pid, int stopped){
     //set the new job's id correctly
     toAdd->id = last->id + 1;
   }
+  LogJobEvent(stopped ? JOBLOG_STOP : JOBLOG_START, toAdd->id, pid, lastpid, toAdd->argv, 0, NULL, NULL);
   //if it was stopped by ctrl+z
   if(stopped)
   {
+    stats.jobsStopped++;
     //print out id, status, and cmdline 
     printf("[%d] %-24s%s\n", toAdd->id, toAdd->status, toAdd->cmdline);
     fflush(stdout);
@@ -568,9 +2372,10 @@ void removeCompletedJobs(){
       {
         //set the previous job's next pointer to the next job
         prev->next = current->next;
-        //set the next job's prev pointer to the prev job
-        current->next->prev = prev;
       }
+      //set the next job's prev pointer to the prev job
+      if(current->next != NULL)
+        current->next->prev = prev;
       //set the temp pointer to the next job so we have it after we free the current job
       temp = current->next;
       //release the current job
@@ -581,52 +2386,122 @@ void removeCompletedJobs(){
     else
     {
       //move on to the next job
+      prev = current;
       current = current->next;
     }
   }
 }
 
 void ReleaseJob(bgjobL* toRelease){
+  //the pipes of a coprocess go with its job, fg gets it to the end of its input
+  if(toRelease->pid == coprocPgid)
+    CloseCoproc();
+  if(toRelease->reply >= 0)
+    close(toRelease->reply);
+  Dequeue(toRelease);
+  DetachProcs(toRelease);
+  if(toRelease->cmdline != NULL) free(toRelease->cmdline);
+  free(toRelease->argv);
+  RemoveJobCgroup(toRelease->cgroup);
+  free(toRelease->place);
+  free(toRelease->prio);
+  ReleaseProcs(toRelease->procs, toRelease->nprocs);
   free(toRelease);
 }
 
 void StopJob(){
   if(fgpid > 0)
   {
-    kill(-fgpid, SIGTSTP);
+    SignalJob(fgpid, fgproc, fgprocs, SIGTSTP);
     stopped = 1;
-    AddJobToBg(fgpid, 1);
+    AddJobToBg(fgpid, 1, fglast);
     fgpid = -1;
-    CheckJobs();
   }
 }
 
 void KillJob(){
+  //stop any loop that is currently running
+  interrupted = TRUE;
   //if we have a valid foreground job
   if(fgpid > 0)
   {
-    //send it a SIGINT
-    kill(fgpid, SIGINT);
+    //send it a SIGINT, to every process of a pipeline
+    SignalJob(fgpid, fgproc, fgprocs, SIGINT);
   }
 }
 
 void wait_fg(){
   if(fgpid > 0)
   {
-    int status;
-    //wait for the foreground job to finish
-    while(waitpid(fgpid, &status, WNOHANG|WUNTRACED) == 0 && !stopped)
+    int status, timeout;
+    pid_t ret;
+    //wait for every process of the foreground job to finish
+    while(fgprocs > 0 && !stopped)
+    {
+      //a sampled pipeline is looked at before its processes are gone
+      timeout = SamplePipeStats();
+      ret = ReapProc(fgproc, &fgprocs, &status, &fgusage);
+      if(ret == 0)
+      {
+        //sleep until a process ends or stops (SIGCHLD) or ctrl+c or
+        //ctrl+z come in
+        WaitEvents(FALSE, timeout);
+        continue;
+      }
+      if(WIFSTOPPED(status))
+      {
+        //stopped from outside, keep it as a job rather than losing it
+        lastStatus = 128 + WSTOPSIG(status);
+        AddJobToBg(fgpid, 1, fglast);
+        break;
+      }
+      if(WIFEXITED(status) && WEXITSTATUS(status) == 126)
+        stats.execFailures++;
+      //remember how the pipeline ended
+      if(ret == fglast)
+      {
+        if(WIFEXITED(status))
+          lastStatus = WEXITSTATUS(status);
+        else if(WIFSIGNALED(status))
+        {
+          lastStatus = 128 + WTERMSIG(status);
+          stats.jobsKilled++;
+        }
+      }
+      if(fgprocs == 0)
+      {
+        RecordSince(STATS_JOB, &fgstart);
+        LogJobEvent(JOBLOG_EXIT, 0, fgpid, fglast, last_argv, lastStatus, &fgstart, &fgusage);
+      }
+    }
+    if(stopped)
     {
-      //sleep when not finished yet
-      sleep(0.5);
+      lastStatus = 128 + SIGTSTP;
     }
+    //a stopped pipeline has no table
+    EndPipeStats(fgprocs == 0);
     //set no foreground job when finished
     fgpid = -1;
   }
+  ReleaseProcs(fgproc, fgprocs);
+  fgproc = NULL;
+  fgprocs = 0;
+  //free the cmdline unless the job was stopped and moved to the job list
+  if(last_cmd != NULL)
+  {
+    free(last_cmd);
+    last_cmd = NULL;
+  }
+  RemoveJobCgroup(last_cgroup);
+  last_cgroup = NULL;
+  free(last_place);
+  last_place = NULL;
+  free(last_argv);
+  last_argv = NULL;
 }
 
 //Remove the given job from the background jobs list
-void RemoveJob(pid){
+void RemoveJob(pid_t pid){
   //get the list
   bgjobL* job = bgjobs;
   //while it isn't null
@@ -635,33 +2510,179 @@ void RemoveJob(pid){
     //if this is our job
     if(job->pid == pid)
     {
-      //if this is the only job in the background jobs list
-      if(job->prev == NULL && job->next == NULL)
-      {
-        //set the list pointer to null
-        bgjobs = NULL;
-      }
-      else
-      {
-        //if is isn't the first element
-        if(job->prev != NULL)
-        {
-          //set the previous job's next pointer to the current job's next pointer
-          job->prev->next = job->next;
-        }
-        //if it isn't the last element
-        if(job->next != NULL)
-        {
-          //set the next job's prev pointer to the current job's prev pointer
-          job->next->prev = job->prev;
-        }
-      }
-      //release the job
-      ReleaseJob(job);
+      UnlinkJob(job);
       //stop the loop
       break;
     }
     //move to the next job
     job = job->next;
   }
-}
\ No newline at end of file
+}
+
+void UnlinkJob(bgjobL* job){
+  //if it is the first element, the list starts at the next one
+  if(job->prev == NULL)
+  {
+    bgjobs = job->next;
+  }
+  else
+  {
+    //set the previous job's next pointer to the current job's next pointer
+    job->prev->next = job->next;
+  }
+  //if it isn't the last element
+  if(job->next != NULL)
+  {
+    //set the next job's prev pointer to the current job's prev pointer
+    job->next->prev = job->prev;
+  }
+  //release the job
+  ReleaseJob(job);
+}
+
+/*The pidfd is taken before the child can be reaped, so it always refers
+ *to our child and never to a process that got the pid later*/
+static void TrackProc(pid_t pid)
+{
+  int i;
+
+  fgproc = realloc(fgproc, sizeof(procT) * (fgprocs + 1));
+  fgproc[fgprocs].pid = pid;
+  fgproc[fgprocs].pidfd = syscall(SYS_pidfd_open, pid, 0);
+  for(i = 0; i < NPROCFILES; i++)
+    fgproc[fgprocs].files[i] = -1;
+  if(fgproc[fgprocs].pidfd >= 0)
+    WatchFd(fgproc[fgprocs].pidfd, pid);
+  else
+    rawProcs = TRUE;
+  fgprocs++;
+}
+
+/*Returns the pid of a process that stopped or ended, with its status, or 0
+ *if none has changed. Ended processes are dropped from the list*/
+static pid_t ReapProc(procT* procs, int* nprocs, int* status, struct rusage* usage)
+{
+  siginfo_t info;
+  struct rusage ru;
+  pid_t pid;
+  int i, ret;
+
+  for(i = 0; i < *nprocs; i++)
+  {
+    if(procs[i].pidfd >= 0)
+    {
+      info.si_pid = 0;
+      //the system call, unlike the libc wrapper, also gives the rusage
+      ret = syscall(SYS_waitid, P_PIDFD, procs[i].pidfd, &info, WEXITED|WSTOPPED|WNOHANG, &ru);
+      if(ret == 0 && info.si_pid == 0)
+        continue;
+      *status = ret == 0 ? WaitStatus(&info) : LOSTSTATUS;
+    }
+    else
+    {
+      ret = wait4(procs[i].pid, status, WNOHANG|WUNTRACED, &ru);
+      if(ret == 0)
+        continue;
+      if(ret < 0)
+        *status = LOSTSTATUS;
+    }
+    //an error means it is not ours to wait for anymore, forget it too
+    if(ret < 0 && errno != ECHILD)
+      continue;
+    pid = procs[i].pid;
+    if(ret < 0 || !WIFSTOPPED(*status))
+    {
+      if(ret >= 0)
+        AddRusage(usage, &ru);
+      if(procs[i].pidfd >= 0)
+        close(procs[i].pidfd);
+      CloseProcFiles(procs[i].files);
+      procs[i] = procs[--*nprocs];
+    }
+    return pid;
+  }
+  return 0;
+}
+
+static int WaitStatus(siginfo_t* info)
+{
+  switch(info->si_code)
+  {
+    case CLD_EXITED:
+      return (info->si_status & 0xff) << 8;
+    case CLD_KILLED:
+      return info->si_status;
+    case CLD_DUMPED:
+      return info->si_status | 0x80;
+    default:
+      return (info->si_status << 8) | 0x7f;
+  }
+}
+
+/*Through a pidfd the signal cannot reach a stranger that reused an id.
+ *It goes to the whole process group, so it also reaches what the job
+ *started itself. When the group cannot be signalled that way, because
+ *the kernel is older or the leader is gone, each process of the job is
+ *signalled on its own; one without a pidfd by its pid, which stays ours
+ *until it is reaped. The group id itself is never used.*/
+static void SignalJob(pid_t pgid, procT* procs, int nprocs, int sig)
+{
+  int i;
+
+  if(nprocs == 0)
+    return;
+  //the leader is the one least likely to have left the group
+  for(i = 0; i < nprocs && procs[i].pid != pgid; i++)
+    ;
+  if(i == nprocs)
+    i = 0;
+  if(procs[i].pidfd >= 0 && syscall(SYS_pidfd_send_signal, procs[i].pidfd, sig, NULL, PIDFD_SIGNAL_PROCESS_GROUP) == 0)
+    return;
+  for(i = 0; i < nprocs; i++)
+  {
+    if(procs[i].pidfd >= 0)
+      syscall(SYS_pidfd_send_signal, procs[i].pidfd, sig, NULL, 0);
+    else
+      kill(procs[i].pid, sig);
+  }
+}
+
+/*Only the processes the job is known to have are looked at*/
+static bool JobPriority(bgjobL* job, bool background)
+{
+  pid_t* pids = malloc(sizeof(pid_t) * (job->nprocs + 1));
+  int i;
+  bool ok;
+
+  for(i = 0; i < job->nprocs; i++)
+    pids[i] = job->procs[i].pid;
+  ok = SetJobPriority(pids, job->nprocs, &job->prio, &job->nprio, background);
+  free(pids);
+  return ok;
+}
+
+static void ForgetProcFiles()
+{
+  bgjobL* job;
+  int i, k;
+
+  for(job = bgjobs; job != NULL; job = job->next)
+  {
+    for(i = 0; i < job->nprocs; i++)
+      for(k = 0; k < NPROCFILES; k++)
+        job->procs[i].files[k] = -1;
+  }
+}
+
+static void ReleaseProcs(procT* procs, int nprocs)
+{
+  int i;
+
+  for(i = 0; i < nprocs; i++)
+  {
+    if(procs[i].pidfd >= 0)
+      close(procs[i].pidfd);
+    CloseProcFiles(procs[i].files);
+  }
+  free(procs);
+}
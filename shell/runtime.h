@@ -53,12 +53,49 @@
 #define VAREXTERN(x, y) extern x;
 #endif
 
+/* kinds of here-documents */
+#define HEREDOC_NONE   0
+#define HEREDOC_DOC    1  /* <<WORD */
+#define HEREDOC_TABS   2  /* <<-WORD, leading tabs are stripped */
+#define HEREDOC_STRING 3  /* <<<word */
+
+/* bodies up to this size go through a pipe, larger ones through a memfd */
+#define HEREDOC_PIPE_MAX 4096
+
+/* values of shopt bgsched */
+#define BGSCHED_OFF   0
+#define BGSCHED_BATCH 1
+#define BGSCHED_IDLE  2
+
+/* values of shopt bgioprio, best-effort levels 0 to 7 follow BE */
+#define BGIOPRIO_OFF  0
+#define BGIOPRIO_IDLE 1
+#define BGIOPRIO_BE   2
+
+/* launch options of a command, see launch.h */
+typedef struct launch_s launchT;
+
 typedef struct command_t
 {
   char* name;
   char *cmdline;
   char *redirect_in, *redirect_out;
   int is_redirect_in, is_redirect_out;
+  /* the body of a here-document or the word of a here-string */
+  char *heredoc, *heredoc_delim;
+  int is_heredoc, heredoc_quoted;
+  /* limits set by prefixes like limit, NULL if there are none */
+  launchT* launch;
+  /* the fds of its process substitutions, handed to it as /dev/fd/N */
+  int* substFds;
+  int nsubstFds;
+  /* what is exec'd instead of name and argv for a script whose
+   * interpreter the shell looked up itself, NULL otherwise */
+  char* execPath;
+  char** execArgv;
+  /* the strings of a shared copy belong to its template and are not
+   * freed with it */
+  bool shared;
   int bg;
   int argc;
   char* argv[];
@@ -73,6 +110,66 @@ typedef struct command_t
  ***********************************************************************/
 VAREXTERN(bool forceExit, FALSE);
 
+/***********************************************************************
+ *  Title: Exit status of the last command 
+ * ---------------------------------------------------------------------
+ *    Purpose: Holds the exit status of the last command that ran, as
+ *    reported by $?
+ ***********************************************************************/
+VAREXTERN(int lastStatus, 0);
+
+/***********************************************************************
+ *  Title: Interrupt requested 
+ * ---------------------------------------------------------------------
+ *    Purpose: Set when the user hits ctrl+c, stops running loops
+ ***********************************************************************/
+VAREXTERN(bool interrupted, FALSE);
+
+/***********************************************************************
+ *  Title: Background scheduling options
+ * ---------------------------------------------------------------------
+ *    Purpose: Set with shopt. Background jobs start with the scheduling
+ *    class in bgsched, bgnice added to the shell's nice value and the
+ *    io priority in bgioprio; fg undoes it and bg applies it again.
+ ***********************************************************************/
+VAREXTERN(int bgSched, BGSCHED_OFF);
+VAREXTERN(int bgNice, 0);
+VAREXTERN(int bgIoprio, BGIOPRIO_OFF);
+#define BGSCHED_ON() (bgSched != BGSCHED_OFF || bgNice != 0 || bgIoprio != BGIOPRIO_OFF)
+
+/***********************************************************************
+ *  Title: Pipeline statistics
+ * ---------------------------------------------------------------------
+ *    Purpose: Set with shopt pipestats=on. Foreground pipelines are
+ *    sampled while they run and print a table per stage when they end.
+ ***********************************************************************/
+VAREXTERN(int pipeStats, 0);
+
+/***********************************************************************
+ *  Title: Zygote launches
+ * ---------------------------------------------------------------------
+ *    Purpose: Set with shopt zygote=off to have the shell fork every
+ *    command itself instead of the zygote started with it.
+ ***********************************************************************/
+VAREXTERN(int useZygote, 1);
+
+/***********************************************************************
+ *  Title: Size of the command cache
+ * ---------------------------------------------------------------------
+ *    Purpose: Set with shopt cachesize, in MB. The cache builtin drops
+ *    the least recently used entries above it; 0 stores nothing.
+ ***********************************************************************/
+VAREXTERN(int cacheSize, 64);
+
+/***********************************************************************
+ *  Title: Connection of a served request
+ * ---------------------------------------------------------------------
+ *    Purpose: Set by tsh --serve while a request runs; the job it
+ *    starts takes the connection over to reply to when it ends, like
+ *    it takes over last_cmd.
+ ***********************************************************************/
+VAREXTERN(int jobReply, -1);
+
 /************Function Prototypes******************************************/
 
 /***********************************************************************
@@ -94,13 +191,59 @@ EXTERN void RunCmd(commandT**,int);
 EXTERN void RunCmdBg(commandT*);
 
 /***********************************************************************
- *  Title: Runs two command with a pipe
+ *  Title: Runs commands connected with pipes
+ * ---------------------------------------------------------------------
+ *    Purpose: Runs the commands of a pipeline as one job, each one
+ *    reading the output of the one before it.
+ *    Input: the command structures and their number
+ *    Output: void
+ ***********************************************************************/
+EXTERN void RunCmdPipe(commandT**, int);
+
+/***********************************************************************
+ *  Title: Runs a command and captures its output
+ * ---------------------------------------------------------------------
+ *    Purpose: Runs a command line for a command substitution and
+ *    collects what it writes to standard output. A lone builtin
+ *    utility runs in the shell, everything else in a child whose
+ *    output comes back through a pipe. Sets lastStatus.
+ *    Input: the command line
+ *    Output: a newly allocated string without trailing newlines
+ ***********************************************************************/
+EXTERN char* RunCmdCapture(char*);
+
+/***********************************************************************
+ *  Title: Starts a process substitution
+ * ---------------------------------------------------------------------
+ *    Purpose: Runs a command line for <(command) or >(command) in a
+ *    child connected to a pipe, in the process group the job of the
+ *    line will get, so it is reaped with that job. The shell keeps the
+ *    other end of the pipe until the job is started.
+ *    Input: the command line and whether it reads, for >(command)
+ *    Output: a newly allocated /dev/fd/N path, NULL if it failed
+ ***********************************************************************/
+EXTERN char* RunProcSubst(char*, bool);
+
+/***********************************************************************
+ *  Title: Hands process substitutions to a command
+ * ---------------------------------------------------------------------
+ *    Purpose: Gives a command the fds of the process substitutions
+ *    started while its words were expanded. It keeps them across exec,
+ *    every other child of the line closes them.
+ *    Input: the command structure
+ *    Output: void
+ ***********************************************************************/
+EXTERN void TakeProcSubst(commandT*);
+
+/***********************************************************************
+ *  Title: Finishes the process substitutions of a line
  * ---------------------------------------------------------------------
- *    Purpose: Runs two command connected with a pipe.
- *    Input: two command structure
+ *    Purpose: Closes the shell's ends of the pipes and waits for the
+ *    substituted processes no job took over, like those of a builtin.
+ *    Input: void
  *    Output: void
  ***********************************************************************/
-EXTERN void RunCmdPipe(commandT*, commandT*);
+EXTERN void WaitProcSubst();
 
 /***********************************************************************
  *  Title: Runs two command with output redirection
@@ -147,12 +290,35 @@ EXTERN commandT* CreateCmdT(int);
  ***********************************************************************/
 EXTERN void ReleaseCmdT(commandT**);
 
+/***********************************************************************
+ *  Title: Copy a command structure 
+ * ---------------------------------------------------------------------
+ *    Purpose: Creates a deep copy of a parsed command structure. The
+ *    resolved executable name is not copied.
+ *    Input: the command structure
+ *    Output: the new command structure
+ ***********************************************************************/
+EXTERN commandT* CopyCmdT(commandT*);
+
+/***********************************************************************
+ *  Title: Share a command structure 
+ * ---------------------------------------------------------------------
+ *    Purpose: Creates a copy of a command structure that points to the
+ *    words, redirections and here-document of the original instead of
+ *    copying them, for a command that expands to itself. The original
+ *    must outlive the copy.
+ *    Input: the command structure
+ *    Output: the new command structure
+ ***********************************************************************/
+EXTERN commandT* ShareCmdT(commandT*);
+
 /***********************************************************************
  *  Title: Get the current working directory 
  * ---------------------------------------------------------------------
  *    Purpose: Gets the current working directory.
  *    Input: void
- *    Output: a string containing the current working directory
+ *    Output: a newly allocated string containing the current working
+ *    directory, NULL on error
  ***********************************************************************/
 EXTERN char* getCurrentWorkingDir();
 
@@ -168,12 +334,25 @@ EXTERN char* getLogin();
 /***********************************************************************
  *  Title: Check the jobs 
  * ---------------------------------------------------------------------
- *    Purpose: Checks the status of the background jobs.
+ *    Purpose: Reaps what has changed and reports the background jobs
+ *    that have ended since the last check.
  *    Input: void
  *    Output: void 
  ***********************************************************************/
 EXTERN void CheckJobs();
 
+/***********************************************************************
+ *  Title: A process has changed
+ * ---------------------------------------------------------------------
+ *    Purpose: Reaps the background job a process belongs to when it
+ *    stops or ends. Only that job is looked at, so it stays cheap with
+ *    thousands of jobs. Processes of the foreground job are left to
+ *    the shell waiting for it.
+ *    Input: the pid of the process
+ *    Output: void 
+ ***********************************************************************/
+EXTERN void JobChanged(pid_t);
+
 /***********************************************************************
  *  Title: Stop the current job
  * ---------------------------------------------------------------------
@@ -0,0 +1,964 @@
+/***************************************************************************
+ *  Title: Script
+ * -------------------------------------------------------------------------
+ *    Purpose: Compiles control flow constructs (for, while, until, if,
+ *    case) and lists of commands to a small bytecode and runs it. The
+ *    commands inside a construct are parsed once at compile time, so a
+ *    loop iteration only expands and runs them.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: script.c
+ ***************************************************************************/
+#define __SCRIPT_IMPL__
+#define _GNU_SOURCE
+
+/************System include***********************************************/
+#include <ctype.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/************Private include**********************************************/
+#include "script.h"
+#include "interpreter.h"
+#include "runtime.h"
+#include "event.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* the instructions */
+#define OP_RUN    0 /* run pipeline a */
+#define OP_JMP    1 /* jump to a */
+#define OP_JFALSE 2 /* jump to a if the last status is not 0 */
+#define OP_JTRUE  3 /* jump to a if the last status is 0 */
+#define OP_STATUS 4 /* set the last status to a */
+#define OP_FOR    5 /* start for loop a */
+#define OP_NEXT   6 /* assign the next value of for loop a or jump to b */
+#define OP_CASE   7 /* expand the word of case a */
+#define OP_MATCH  8 /* jump to b unless pattern list a matches */
+#define OP_CLEAR  9 /* set the status of loop a to 0 */
+#define OP_SAVE  10 /* keep the last status as the status of loop a */
+#define OP_LOAD  11 /* set the last status to the status of loop a */
+
+/* instructions between looks for ctrl+c, a loop of builtins never waits
+   in the event loop otherwise */
+#define EVENT_PERIOD 256
+
+typedef struct instr_s {
+  int op;
+  int a;
+  int b;
+} instrT;
+
+typedef struct pipeline_s {
+  commandT** command;
+  int task;
+} pipelineT;
+
+/* a word of a for loop, ranges like 1..10 or {1..10} are never materialized */
+typedef struct word_s {
+  char* text;
+  bool range;
+  long from;
+  long to;
+} wordT;
+
+typedef struct for_s {
+  char* var;
+  int nwords;
+  wordT* words;
+  /* the iteration state */
+  char** values;
+  int idx;
+  bool inrange;
+  long cur;
+  /* the next field of a split value, NULL when not in one */
+  char* field;
+  bool split;
+} forT;
+
+typedef struct case_s {
+  char* word;
+  char* subject;
+} caseT;
+
+typedef struct match_s {
+  int caseidx;
+  int npats;
+  char** pats;
+} matchT;
+
+struct script_s {
+  instrT* code;
+  int ncode;
+  int capcode;
+  pipelineT* pipes;
+  int npipes;
+  forT* fors;
+  int nfors;
+  caseT* cases;
+  int ncases;
+  matchT* matches;
+  int nmatches;
+  /* the status of the last body command of each loop */
+  int* loops;
+  int nloops;
+};
+
+/* an enclosing loop, for break and continue */
+typedef struct loop_s {
+  int slot;
+  int cont;
+  int nbreaks;
+  int* breaks;
+  struct loop_s* outer;
+} loopT;
+
+typedef struct compiler_s {
+  char* p;
+  scriptT* s;
+  int status;
+  loopT* loop;
+  /* here-document bodies of the current line, skipped at its end */
+  char* here;
+  char* hereEnd;
+} compilerT;
+
+/************Global Variables*********************************************/
+
+static char* doTerms[]   = { "do", NULL };
+static char* doneTerms[] = { "done", NULL };
+static char* thenTerms[] = { "then", NULL };
+static char* elseTerms[] = { "elif", "else", "fi", NULL };
+static char* fiTerms[]   = { "fi", NULL };
+static char* caseTerms[] = { ";;", "esac", NULL };
+
+/* words that may not start a simple command */
+static char* reserved[] = { "do", "done", "then", "elif", "else", "fi", "esac", NULL };
+
+/************Function Prototypes******************************************/
+/* compiles commands until one of the terminators is reached */
+static void CompileList(compilerT*, char**);
+/* compiles a single command or construct */
+static void CompileCommand(compilerT*);
+static void CompileSimple(compilerT*);
+static void CompileFor(compilerT*);
+static void CompileWhile(compilerT*, bool);
+static void CompileIf(compilerT*);
+static void CompileCase(compilerT*);
+static void CompileLoopJump(compilerT*);
+/* opens and closes the scope of a loop */
+static void BeginLoop(compilerT*, loopT*);
+static void EndLoop(compilerT*, loopT*);
+/* appends an instruction and returns its address */
+static int Emit(compilerT*, int, int, int);
+/* consumes a reserved word or reports a syntax error */
+static bool ExpectWord(compilerT*, char*);
+/* checks that a construct is followed by a separator */
+static void EndCompound(compilerT*);
+static void SyntaxError(compilerT*);
+static bool AtWord(compilerT*, char*);
+static bool AtTerminator(compilerT*, char**);
+static void SkipBlanks(compilerT*);
+static void SkipSeparators(compilerT*);
+/* finds the first unquoted character out of a set */
+static char* ScanTo(char*, char*);
+/* checks whether a line has a here-document */
+static bool HasHeredoc(char*);
+/* reads the body of a here-document from the lines after the command */
+static bool ReadHeredoc(compilerT*, commandT*);
+/* reads one word and removes its quotes */
+static char* ReadWord(compilerT*, bool*);
+/* copies a piece of text without its quotes */
+static char* Unquote(char*, char*, bool*);
+/* parses a range like 1..10 or {1..10} */
+static bool ParseRange(char*, long*, long*);
+/* sets the loop variable to the next value */
+static bool NextFor(forT*);
+/* matches the word of a case against a pattern list */
+static bool MatchCase(scriptT*, matchT*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+bool IsScript(char* line)
+{
+  compilerT c;
+  int i;
+
+  c.p = line;
+  SkipBlanks(&c);
+  if(AtWord(&c, "for") || AtWord(&c, "while") || AtWord(&c, "until")
+      || AtWord(&c, "if") || AtWord(&c, "case"))
+    return TRUE;
+  //let the compiler report misplaced reserved words
+  for(i = 0; reserved[i] != NULL; i++)
+    if(AtWord(&c, reserved[i]))
+      return TRUE;
+  //here-document bodies follow on the next lines
+  return *ScanTo(line, ";") == ';' || HasHeredoc(line);
+}
+
+scriptT* CompileScript(char* text, int* status)
+{
+  compilerT c;
+
+  c.p = text;
+  c.status = SCRIPT_OK;
+  c.loop = NULL;
+  c.here = c.hereEnd = NULL;
+  c.s = (scriptT*) calloc(1, sizeof(scriptT));
+
+  CompileList(&c, NULL);
+
+  *status = c.status;
+  if(c.status != SCRIPT_OK)
+  {
+    ReleaseScript(c.s);
+    return NULL;
+  }
+  return c.s;
+}
+
+void RunScript(scriptT* s)
+{
+  int pc = 0;
+  unsigned int steps = 0;
+  instrT* in;
+
+  interrupted = FALSE;
+  while(pc < s->ncode && !interrupted && !forceExit)
+  {
+    if(++steps % EVENT_PERIOD == 0)
+    {
+      WaitEvents(FALSE, 0);
+      if(interrupted) break;
+    }
+    in = &s->code[pc++];
+    switch(in->op)
+    {
+      case OP_RUN:
+        RunParsed(s->pipes[in->a].command, s->pipes[in->a].task);
+        break;
+      case OP_JMP:
+        pc = in->a;
+        break;
+      case OP_JFALSE:
+        if(lastStatus != 0) pc = in->a;
+        break;
+      case OP_JTRUE:
+        if(lastStatus == 0) pc = in->a;
+        break;
+      case OP_STATUS:
+        lastStatus = in->a;
+        break;
+      case OP_FOR:
+      {
+        forT* f = &s->fors[in->a];
+        int i;
+        //plain words are expanded once when the loop is entered
+        for(i = 0; i < f->nwords; i++)
+        {
+          free(f->values[i]);
+          f->values[i] = f->words[i].range ? NULL : ExpandFields(f->words[i].text);
+        }
+        f->idx = 0;
+        f->inrange = FALSE;
+        f->field = NULL;
+        break;
+      }
+      case OP_NEXT:
+        if(!NextFor(&s->fors[in->a])) pc = in->b;
+        break;
+      case OP_CASE:
+        free(s->cases[in->a].subject);
+        s->cases[in->a].subject = ExpandWord(s->cases[in->a].word);
+        break;
+      case OP_MATCH:
+        if(!MatchCase(s, &s->matches[in->a])) pc = in->b;
+        break;
+      case OP_CLEAR:
+        s->loops[in->a] = 0;
+        break;
+      case OP_SAVE:
+        s->loops[in->a] = lastStatus;
+        break;
+      case OP_LOAD:
+        lastStatus = s->loops[in->a];
+        break;
+    }
+  }
+}
+
+void ReleaseScript(scriptT* s)
+{
+  int i, j;
+
+  for(i = 0; i < s->npipes; i++)
+  {
+    for(j = 0; j < s->pipes[i].task; j++)
+      ReleaseCmdT(&(s->pipes[i].command[j]));
+    free(s->pipes[i].command);
+  }
+  for(i = 0; i < s->nfors; i++)
+  {
+    for(j = 0; j < s->fors[i].nwords; j++)
+    {
+      free(s->fors[i].words[j].text);
+      free(s->fors[i].values[j]);
+    }
+    free(s->fors[i].words);
+    free(s->fors[i].values);
+    free(s->fors[i].var);
+  }
+  for(i = 0; i < s->ncases; i++)
+  {
+    free(s->cases[i].word);
+    free(s->cases[i].subject);
+  }
+  for(i = 0; i < s->nmatches; i++)
+  {
+    for(j = 0; j < s->matches[i].npats; j++)
+      free(s->matches[i].pats[j]);
+    free(s->matches[i].pats);
+  }
+  free(s->code);
+  free(s->pipes);
+  free(s->fors);
+  free(s->cases);
+  free(s->matches);
+  free(s->loops);
+  free(s);
+}
+
+static void CompileList(compilerT* c, char** terms)
+{
+  for(;;)
+  {
+    SkipSeparators(c);
+    if(c->status != SCRIPT_OK) return;
+    if(*c->p == '\0')
+    {
+      //inside a construct the rest is still to come
+      if(terms != NULL) c->status = SCRIPT_MORE;
+      return;
+    }
+    if(terms != NULL && AtTerminator(c, terms)) return;
+    CompileCommand(c);
+  }
+}
+
+static void CompileCommand(compilerT* c)
+{
+  int i;
+
+  if(AtWord(c, "for"))
+    CompileFor(c);
+  else if(AtWord(c, "while"))
+    CompileWhile(c, FALSE);
+  else if(AtWord(c, "until"))
+    CompileWhile(c, TRUE);
+  else if(AtWord(c, "if"))
+    CompileIf(c);
+  else if(AtWord(c, "case"))
+    CompileCase(c);
+  else if(AtWord(c, "break") || AtWord(c, "continue"))
+    CompileLoopJump(c);
+  else
+  {
+    for(i = 0; reserved[i] != NULL; i++)
+    {
+      if(AtWord(c, reserved[i]))
+      {
+        SyntaxError(c);
+        return;
+      }
+    }
+    CompileSimple(c);
+  }
+}
+
+static void CompileSimple(compilerT* c)
+{
+  char* end = ScanTo(c->p, ";\n");
+  char* text = strndup(c->p, end - c->p);
+  commandT** command;
+  int i, task = ParseCommandLine(text, &command);
+
+  free(text);
+  if(task == 0)
+  {
+    SyntaxError(c);
+    return;
+  }
+  c->p = end;
+  for(i = 0; i < task; i++)
+  {
+    if(command[i]->heredoc_delim != NULL && !ReadHeredoc(c, command[i]))
+    {
+      for(i = 0; i < task; i++)
+        ReleaseCmdT(&command[i]);
+      free(command);
+      return;
+    }
+  }
+  c->s->pipes = realloc(c->s->pipes, sizeof(pipelineT) * (c->s->npipes + 1));
+  c->s->pipes[c->s->npipes].command = command;
+  c->s->pipes[c->s->npipes].task = task;
+  Emit(c, OP_RUN, c->s->npipes++, 0);
+}
+
+static void CompileFor(compilerT* c)
+{
+  forT* f;
+  loopT loop;
+  char* word;
+  bool quoted;
+  int idx = c->s->nfors, next;
+
+  c->p += 3;
+  word = ReadWord(c, NULL);
+  if(word == NULL || !(isalpha((unsigned char) word[0]) || word[0] == '_'))
+  {
+    free(word);
+    SyntaxError(c);
+    return;
+  }
+  c->s->fors = realloc(c->s->fors, sizeof(forT) * (c->s->nfors + 1));
+  f = &c->s->fors[c->s->nfors++];
+  memset(f, 0, sizeof(forT));
+  f->var = word;
+
+  SkipBlanks(c);
+  if(AtWord(c, "in"))
+  {
+    c->p += 2;
+    while((word = ReadWord(c, &quoted)) != NULL)
+    {
+      f->words = realloc(f->words, sizeof(wordT) * (f->nwords + 1));
+      f->values = realloc(f->values, sizeof(char*) * (f->nwords + 1));
+      f->words[f->nwords].text = word;
+      f->words[f->nwords].range = !quoted
+          && ParseRange(word, &f->words[f->nwords].from, &f->words[f->nwords].to);
+      f->values[f->nwords] = NULL;
+      f->nwords++;
+    }
+  }
+  SkipSeparators(c);
+  if(!ExpectWord(c, "do")) return;
+
+  Emit(c, OP_FOR, idx, 0);
+  BeginLoop(c, &loop);
+  Emit(c, OP_CLEAR, loop.slot, 0);
+  next = Emit(c, OP_NEXT, idx, -1);
+  loop.cont = next;
+
+  CompileList(c, doneTerms);
+  if(ExpectWord(c, "done")) EndCompound(c);
+  Emit(c, OP_SAVE, loop.slot, 0);
+  Emit(c, OP_JMP, next, 0);
+
+  c->s->code[next].b = c->s->ncode;
+  EndLoop(c, &loop);
+}
+
+static void CompileWhile(compilerT* c, bool until)
+{
+  loopT loop;
+  int cond, leave;
+
+  c->p += 5;
+  BeginLoop(c, &loop);
+  Emit(c, OP_CLEAR, loop.slot, 0);
+  cond = c->s->ncode;
+  loop.cont = cond;
+  CompileList(c, doTerms);
+  if(!ExpectWord(c, "do"))
+  {
+    EndLoop(c, &loop);
+    return;
+  }
+  leave = Emit(c, until ? OP_JTRUE : OP_JFALSE, -1, 0);
+
+  CompileList(c, doneTerms);
+  if(ExpectWord(c, "done")) EndCompound(c);
+  Emit(c, OP_SAVE, loop.slot, 0);
+  Emit(c, OP_JMP, cond, 0);
+
+  c->s->code[leave].a = c->s->ncode;
+  EndLoop(c, &loop);
+}
+
+/*Enters a loop, giving it a slot for the status of its body*/
+static void BeginLoop(compilerT* c, loopT* loop)
+{
+  c->s->loops = realloc(c->s->loops, sizeof(int) * (c->s->nloops + 1));
+  c->s->loops[c->s->nloops] = 0;
+  loop->slot = c->s->nloops++;
+  loop->nbreaks = 0;
+  loop->breaks = NULL;
+  loop->outer = c->loop;
+  c->loop = loop;
+}
+
+/*Leaves a loop: the status is the one of the last body command that ran,
+ *0 if the body never ran*/
+static void EndLoop(compilerT* c, loopT* loop)
+{
+  Emit(c, OP_LOAD, loop->slot, 0);
+  c->loop = loop->outer;
+  while(loop->nbreaks > 0)
+    c->s->code[loop->breaks[--loop->nbreaks]].a = c->s->ncode;
+  free(loop->breaks);
+}
+
+static void CompileIf(compilerT* c)
+{
+  int skip, nends = 0;
+  int* ends = NULL;
+
+  c->p += 2;
+  for(;;)
+  {
+    CompileList(c, thenTerms);
+    if(!ExpectWord(c, "then")) break;
+    skip = Emit(c, OP_JFALSE, -1, 0);
+    CompileList(c, elseTerms);
+    if(c->status != SCRIPT_OK) break;
+
+    //the branch was taken, skip the rest
+    ends = realloc(ends, sizeof(int) * (nends + 1));
+    ends[nends++] = Emit(c, OP_JMP, -1, 0);
+    c->s->code[skip].a = c->s->ncode;
+
+    if(AtWord(c, "elif"))
+    {
+      c->p += 4;
+      continue;
+    }
+    if(AtWord(c, "else"))
+    {
+      c->p += 4;
+      CompileList(c, fiTerms);
+    }
+    else
+    {
+      //no branch taken
+      Emit(c, OP_STATUS, 0, 0);
+    }
+    if(ExpectWord(c, "fi")) EndCompound(c);
+    break;
+  }
+  while(nends > 0)
+    c->s->code[ends[--nends]].a = c->s->ncode;
+  free(ends);
+}
+
+static void CompileCase(compilerT* c)
+{
+  char* word;
+  char *start, *end, *bar;
+  matchT* m;
+  int idx = c->s->ncases, test, nends = 0;
+  int* ends = NULL;
+
+  c->p += 4;
+  word = ReadWord(c, NULL);
+  if(word == NULL)
+  {
+    SyntaxError(c);
+    return;
+  }
+  c->s->cases = realloc(c->s->cases, sizeof(caseT) * (c->s->ncases + 1));
+  c->s->cases[c->s->ncases].word = word;
+  c->s->cases[c->s->ncases].subject = NULL;
+  c->s->ncases++;
+
+  SkipBlanks(c);
+  if(!ExpectWord(c, "in")) return;
+  Emit(c, OP_CASE, idx, 0);
+
+  for(;;)
+  {
+    SkipSeparators(c);
+    if(*c->p == '\0')
+    {
+      c->status = SCRIPT_MORE;
+      break;
+    }
+    if(AtWord(c, "esac")) break;
+
+    //read the patterns up to ')'
+    if(*c->p == '(') c->p++;
+    start = c->p;
+    end = ScanTo(start, ")\n");
+    if(*end != ')')
+    {
+      c->p = end;
+      SyntaxError(c);
+      break;
+    }
+    c->s->matches = realloc(c->s->matches, sizeof(matchT) * (c->s->nmatches + 1));
+    m = &c->s->matches[c->s->nmatches];
+    m->caseidx = idx;
+    m->npats = 0;
+    m->pats = NULL;
+    while(start < end)
+    {
+      bar = ScanTo(start, "|)");
+      while(*start == ' ' || *start == '\t') start++;
+      m->pats = realloc(m->pats, sizeof(char*) * (m->npats + 1));
+      m->pats[m->npats] = Unquote(start, bar, NULL);
+      //drop trailing blanks
+      while(strlen(m->pats[m->npats]) > 0 && isblank((unsigned char) m->pats[m->npats][strlen(m->pats[m->npats]) - 1]))
+        m->pats[m->npats][strlen(m->pats[m->npats]) - 1] = '\0';
+      m->npats++;
+      start = (*bar == '|') ? bar + 1 : bar;
+    }
+    c->p = end + 1;
+
+    test = Emit(c, OP_MATCH, c->s->nmatches++, -1);
+    CompileList(c, caseTerms);
+    if(c->status != SCRIPT_OK) break;
+    ends = realloc(ends, sizeof(int) * (nends + 1));
+    ends[nends++] = Emit(c, OP_JMP, -1, 0);
+    c->s->code[test].b = c->s->ncode;
+    if(strncmp(c->p, ";;", 2) == 0) c->p += 2;
+  }
+
+  //nothing matched
+  Emit(c, OP_STATUS, 0, 0);
+  while(nends > 0)
+    c->s->code[ends[--nends]].a = c->s->ncode;
+  free(ends);
+  if(c->status == SCRIPT_OK && ExpectWord(c, "esac")) EndCompound(c);
+}
+
+static void CompileLoopJump(compilerT* c)
+{
+  bool isbreak = AtWord(c, "break");
+
+  if(c->loop == NULL)
+  {
+    SyntaxError(c);
+    return;
+  }
+  c->p += isbreak ? 5 : 8;
+  //both succeed: break leaves the loop with 0, continue makes 0 the
+  //status of the body in case the loop ends after it
+  if(isbreak)
+  {
+    Emit(c, OP_STATUS, 0, 0);
+    c->loop->breaks = realloc(c->loop->breaks, sizeof(int) * (c->loop->nbreaks + 1));
+    c->loop->breaks[c->loop->nbreaks++] = Emit(c, OP_JMP, -1, 0);
+  }
+  else
+  {
+    Emit(c, OP_CLEAR, c->loop->slot, 0);
+    Emit(c, OP_JMP, c->loop->cont, 0);
+  }
+  EndCompound(c);
+}
+
+static int Emit(compilerT* c, int op, int a, int b)
+{
+  scriptT* s = c->s;
+
+  if(s->ncode == s->capcode)
+  {
+    s->capcode = s->capcode == 0 ? 16 : s->capcode * 2;
+    s->code = realloc(s->code, sizeof(instrT) * s->capcode);
+  }
+  s->code[s->ncode].op = op;
+  s->code[s->ncode].a = a;
+  s->code[s->ncode].b = b;
+  return s->ncode++;
+}
+
+static bool ExpectWord(compilerT* c, char* word)
+{
+  if(c->status != SCRIPT_OK) return FALSE;
+  if(!AtWord(c, word))
+  {
+    SyntaxError(c);
+    return FALSE;
+  }
+  c->p += strlen(word);
+  return TRUE;
+}
+
+static void EndCompound(compilerT* c)
+{
+  SkipBlanks(c);
+  if(*c->p != '\0' && *c->p != ';' && *c->p != '\n')
+    SyntaxError(c);
+}
+
+static void SyntaxError(compilerT* c)
+{
+  if(c->status != SCRIPT_OK) return;
+  //running out of text just means more lines are needed
+  if(*c->p == '\0')
+  {
+    c->status = SCRIPT_MORE;
+    return;
+  }
+  printf("syntax error near '%.*s'\n", (int) (ScanTo(c->p + 1, " \t;\n") - c->p), c->p);
+  fflush(stdout);
+  c->status = SCRIPT_ERROR;
+}
+
+static bool AtWord(compilerT* c, char* word)
+{
+  size_t n = strlen(word);
+
+  //the character after the word is only there if the word matched
+  return strncmp(c->p, word, n) == 0
+      && (c->p[n] == '\0' || c->p[n] == ' ' || c->p[n] == '\t' || c->p[n] == '\n' || c->p[n] == ';');
+}
+
+static bool AtTerminator(compilerT* c, char** terms)
+{
+  int i;
+
+  for(i = 0; terms[i] != NULL; i++)
+  {
+    if(strcmp(terms[i], ";;") == 0 ? strncmp(c->p, ";;", 2) == 0 : AtWord(c, terms[i]))
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static void SkipBlanks(compilerT* c)
+{
+  while(*c->p == ' ' || *c->p == '\t')
+    c->p++;
+}
+
+static void SkipSeparators(compilerT* c)
+{
+  for(;;)
+  {
+    SkipBlanks(c);
+    //';;' ends a case item and is left alone
+    if(*c->p == '\n' || (*c->p == ';' && c->p[1] != ';'))
+      c->p++;
+    else
+      break;
+    //the next line starts with here-document bodies that are already read
+    if(c->p == c->here)
+    {
+      c->p = c->hereEnd;
+      c->here = c->hereEnd = NULL;
+    }
+  }
+}
+
+static char* ScanTo(char* p, char* stops)
+{
+  int quot1 = 0, quot2 = 0, n;
+
+  for(; *p != '\0'; p++)
+  {
+    if(*p == '\'' && !quot2)
+      quot1 = !quot1;
+    else if(!quot1 && (n = SubstLength(p)) > 0)
+      p += n - 1;
+    else if(*p == '"' && !quot1)
+      quot2 = !quot2;
+    else if(!quot1 && !quot2 && strchr(stops, *p) != NULL)
+      break;
+  }
+  return p;
+}
+
+static bool HasHeredoc(char* line)
+{
+  char* p;
+
+  for(p = ScanTo(line, "<"); *p != '\0'; p = ScanTo(p + strspn(p, "<"), "<"))
+  {
+    //'<<<' is a here-string, it has no body
+    if(p[1] == '<' && p[2] != '<')
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static bool ReadHeredoc(compilerT* c, commandT* cmd)
+{
+  char *p, *eol, *body;
+  size_t len = 0, n;
+
+  //the body starts on the next line, or after the body of an earlier one
+  if(c->here == NULL)
+  {
+    p = ScanTo(c->p, "\n");
+    if(*p == '\0')
+    {
+      c->status = SCRIPT_MORE;
+      return FALSE;
+    }
+    c->here = c->hereEnd = p + 1;
+  }
+  p = c->hereEnd;
+  body = malloc(1);
+  for(;;)
+  {
+    if(*p == '\0')
+    {
+      //the delimiter has not been typed yet
+      free(body);
+      c->status = SCRIPT_MORE;
+      return FALSE;
+    }
+    if(cmd->is_heredoc == HEREDOC_TABS)
+      p += strspn(p, "\t");
+    eol = strchrnul(p, '\n');
+    n = eol - p;
+    if(n == strlen(cmd->heredoc_delim) && strncmp(p, cmd->heredoc_delim, n) == 0)
+      break;
+    body = realloc(body, len + n + 2);
+    memcpy(body + len, p, n);
+    len += n;
+    body[len++] = '\n';
+    p = (*eol == '\n') ? eol + 1 : eol;
+  }
+  body[len] = '\0';
+  c->hereEnd = (*eol == '\n') ? eol + 1 : eol;
+  cmd->heredoc = body;
+  return TRUE;
+}
+
+static char* ReadWord(compilerT* c, bool* quoted)
+{
+  char *start, *end;
+
+  SkipBlanks(c);
+  start = c->p;
+  end = ScanTo(start, " \t;\n");
+  if(end == start) return NULL;
+  c->p = end;
+  return Unquote(start, end, quoted);
+}
+
+static char* Unquote(char* start, char* end, bool* quoted)
+{
+  int quot1 = 0, quot2 = 0, n = 0, len;
+  char* out = malloc(end - start + 1);
+
+  if(quoted != NULL) *quoted = FALSE;
+  for(; start < end; start++)
+  {
+    if(!quot1 && (len = SubstLength(start)) > 0)
+    {
+      //copied as it is, the command inside keeps its quotes
+      memcpy(out + n, start, len);
+      if(quot2 && *start != '<' && *start != '>')
+        out[n] = (*start == '$') ? QUOTED_SUBST : QUOTED_BACKTICK;
+      n += len;
+      start += len - 1;
+    }
+    else if(*start == '\'' && !quot2)
+    {
+      quot1 = !quot1;
+      if(quoted != NULL) *quoted = TRUE;
+    }
+    else if(*start == '"' && !quot1)
+    {
+      quot2 = !quot2;
+      if(quoted != NULL) *quoted = TRUE;
+    }
+    else
+    {
+      out[n++] = (*start == '$' && quot1) ? QUOTED_DOLLAR : *start;
+    }
+  }
+  out[n] = '\0';
+  return out;
+}
+
+static bool ParseRange(char* word, long* from, long* to)
+{
+  char* end;
+  bool brace = (*word == '{');
+
+  if(brace) word++;
+  if(!isdigit((unsigned char) *word) && *word != '-') return FALSE;
+  *from = strtol(word, &end, 10);
+  if(end == word || strncmp(end, "..", 2) != 0) return FALSE;
+  word = end + 2;
+  if(!isdigit((unsigned char) *word) && *word != '-') return FALSE;
+  *to = strtol(word, &end, 10);
+  if(end == word) return FALSE;
+  if(brace)
+  {
+    if(*end != '}') return FALSE;
+    end++;
+  }
+  return *end == '\0';
+}
+
+static bool NextFor(forT* f)
+{
+  char num[24];
+  char* value;
+  wordT* w;
+
+  for(;;)
+  {
+    if(f->inrange)
+    {
+      w = &f->words[f->idx - 1];
+      if(w->from <= w->to ? f->cur <= w->to : f->cur >= w->to)
+      {
+        snprintf(num, sizeof(num), "%ld", f->cur);
+        f->cur += (w->from <= w->to) ? 1 : -1;
+        SetVar(f->var, num);
+        return TRUE;
+      }
+      f->inrange = FALSE;
+    }
+    if(f->field != NULL)
+    {
+      value = f->field;
+      f->field = strchr(value, FIELD_SEP);
+      if(f->field != NULL) *f->field++ = '\0';
+      //blanks around the output of a command substitution leave empty fields
+      if(f->split && *value == '\0') continue;
+      SetVar(f->var, value);
+      return TRUE;
+    }
+    if(f->idx >= f->nwords) return FALSE;
+    w = &f->words[f->idx++];
+    if(w->range)
+    {
+      f->inrange = TRUE;
+      f->cur = w->from;
+      continue;
+    }
+    f->field = f->values[f->idx - 1];
+    f->split = strchr(f->field, FIELD_SEP) != NULL;
+  }
+}
+
+static bool MatchCase(scriptT* s, matchT* m)
+{
+  int i;
+  bool match = FALSE;
+  char* pat;
+
+  for(i = 0; i < m->npats && !match; i++)
+  {
+    pat = ExpandWord(m->pats[i]);
+    match = fnmatch(pat, s->cases[m->caseidx].subject, 0) == 0;
+    free(pat);
+  }
+  return match;
+}
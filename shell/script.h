@@ -0,0 +1,89 @@
+/***************************************************************************
+ *  Title: Script
+ * -------------------------------------------------------------------------
+ *    Purpose: Compiles and runs control flow constructs
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: script.h
+ ***************************************************************************/
+
+#ifndef __SCRIPT_H__
+#define __SCRIPT_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+
+/************Private include**********************************************/
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __SCRIPT_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/* results of compiling a script */
+#define SCRIPT_OK    0
+#define SCRIPT_MORE  1
+#define SCRIPT_ERROR 2
+
+typedef struct script_s scriptT;
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Checks whether a line is a script
+ * ---------------------------------------------------------------------
+ *    Purpose: Checks whether a command line starts a control flow
+ *    construct (for, while, until, if, case) or is a list of
+ *    commands separated by ';'.
+ *    Input: a command line
+ *    Output: true if it has to be compiled
+ ***********************************************************************/
+EXTERN bool IsScript(char*);
+
+/***********************************************************************
+ *  Title: Compile a script
+ * ---------------------------------------------------------------------
+ *    Purpose: Compiles the text of a script into bytecode. Syntax
+ *    errors are reported on standard output.
+ *    Input: the script text and a pointer to receive SCRIPT_OK,
+ *    SCRIPT_MORE if a construct is not closed yet or SCRIPT_ERROR
+ *    Output: the compiled script, NULL unless the status is SCRIPT_OK
+ ***********************************************************************/
+EXTERN scriptT* CompileScript(char*, int*);
+
+/***********************************************************************
+ *  Title: Run a script
+ * ---------------------------------------------------------------------
+ *    Purpose: Runs a compiled script until it ends or ctrl+c is hit.
+ *    Input: the compiled script
+ *    Output: void
+ ***********************************************************************/
+EXTERN void RunScript(scriptT*);
+
+/***********************************************************************
+ *  Title: Release a script
+ * ---------------------------------------------------------------------
+ *    Purpose: Frees a compiled script.
+ *    Input: the compiled script
+ *    Output: void
+ ***********************************************************************/
+EXTERN void ReleaseScript(scriptT*);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __SCRIPT_H__ */
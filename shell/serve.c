@@ -0,0 +1,299 @@
+/***************************************************************************
+ *  Title: Command server
+ * -------------------------------------------------------------------------
+ *    Purpose: Runs commands sent over a unix socket through the same
+ *    path as typed ones. The shell stays up, so its PATH cache is warm
+ *    and a request costs a fork and an exec.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: serve.c
+ ***************************************************************************/
+#define __SERVE_IMPL__
+#define _GNU_SOURCE
+
+/************System include***********************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "event.h"
+#include "io.h"
+#include "serve.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* the largest request, a message is taken whole or not at all */
+#define SERVE_MAXREQ 65536
+
+/* stdin, stdout and stderr */
+#define SERVE_MAXFDS 3
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+/* takes a new connection, it is read once the request is in */
+static void AcceptConn(int);
+/* reads the request of a connection */
+static void ServeRequest(int);
+/* runs the command of a request */
+static void RunRequest(int, char*, size_t, int*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+int Serve(char* path)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  mode_t mask;
+  int fd, conn;
+  bool ready;
+
+  if(strlen(path) >= sizeof(addr.sun_path))
+  {
+    fprintf(stderr, "tsh: %s: socket path too long\n", path);
+    return 1;
+  }
+  //the socket of a server that was killed is in the way
+  if(lstat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+    unlink(path);
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  //seqpacket keeps a request in one message, with its fds; the socket is
+  //made 0600, connecting runs commands as the shell's user
+  mask = umask(077);
+  if((fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0
+     || bind(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0
+     || listen(fd, SOMAXCONN) < 0)
+  {
+    umask(mask);
+    PrintPError(path);
+    return 1;
+  }
+  umask(mask);
+
+  //connections wake the loop instead of lines on stdin
+  SetEventInput(fd);
+  while(!forceExit)
+  {
+    //jobs that end meanwhile are replied to by CheckJobs, requests that
+    //came in are run
+    ready = WaitEvents(TRUE, -1);
+    while((conn = TakeReadyFd()) >= 0)
+      ServeRequest(conn);
+    if(!ready)
+      continue;
+    while((conn = accept4(fd, NULL, NULL, SOCK_CLOEXEC)) >= 0)
+      AcceptConn(conn);
+  }
+  close(fd);
+  unlink(path);
+  return 0;
+}
+
+void ReplyJob(int conn, int status, struct rusage* usage)
+{
+  serveReplyT reply;
+
+  memset(&reply, 0, sizeof(reply));
+  reply.status = status;
+  if(usage != NULL)
+    reply.usage = *usage;
+  //a client that went away does not matter
+  send(conn, &reply, sizeof(reply), MSG_NOSIGNAL);
+}
+
+/*A client that connects and takes its time to send must not hold up the
+ *others, so the connection waits in the event loop until it can be read*/
+static void AcceptConn(int conn)
+{
+  struct ucred peer;
+  socklen_t peerLen = sizeof(peer);
+
+  //the mode of the socket can have been changed, only the user is served
+  if(getsockopt(conn, SOL_SOCKET, SO_PEERCRED, &peer, &peerLen) < 0 || peer.uid != getuid())
+  {
+    close(conn);
+    return;
+  }
+  WatchFd(conn, 0);
+}
+
+static void ServeRequest(int conn)
+{
+  static char buf[SERVE_MAXREQ];
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * SERVE_MAXFDS)];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { buf, sizeof(buf) };
+  struct msghdr msg;
+  struct cmsghdr* c;
+  int fds[SERVE_MAXFDS] = { -1, -1, -1 };
+  int nfds = 0, n, i, fd;
+  ssize_t len;
+
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  len = recvmsg(conn, &msg, MSG_CMSG_CLOEXEC | MSG_DONTWAIT);
+
+  //fds beyond the first three, or that did not fit, are closed
+  for(c = len >= 0 ? CMSG_FIRSTHDR(&msg) : NULL; c != NULL; c = CMSG_NXTHDR(&msg, c))
+  {
+    if(c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+      continue;
+    n = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    for(i = 0; i < n; i++)
+    {
+      memcpy(&fd, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+      if(nfds < SERVE_MAXFDS)
+        fds[nfds++] = fd;
+      else
+        close(fd);
+    }
+  }
+
+  if(len > 0 && !(msg.msg_flags & MSG_TRUNC) && buf[len - 1] == '\0')
+    RunRequest(conn, buf, len, fds);
+  else
+    close(conn);
+  for(i = 0; i < nfds; i++)
+    close(fds[i]);
+}
+
+/*The shell takes on the directory, environment and fds of the request
+ *while the command is started, so the child inherits them and the command
+ *goes through RunCmd like a typed one. The job started takes the
+ *connection over; without a job, for a builtin or a command that was not
+ *found, the reply goes out right away.*/
+static void RunRequest(int conn, char* buf, size_t len, int* fds)
+{
+  char *p = buf, *end = buf + len, *cwd, *env, *args, *eq;
+  char **names = NULL, **saved = NULL;
+  int savedFds[SERVE_MAXFDS], savedCwd = -1, devNull = -1;
+  int nenv = 0, argc = 0, i;
+  size_t linelen = 0;
+  commandT* cmd;
+
+  cwd = p;
+  p += strlen(p) + 1;
+  for(env = p; p < end && *p != '\0'; p += strlen(p) + 1)
+    nenv++;
+  if(p >= end)
+  {
+    close(conn);
+    return;
+  }
+  for(args = ++p; p < end; p += strlen(p) + 1)
+  {
+    argc++;
+    linelen += strlen(p) + 1;
+  }
+  if(argc == 0)
+  {
+    close(conn);
+    return;
+  }
+
+  if(*cwd != '\0')
+  {
+    savedCwd = open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if(chdir(cwd) < 0)
+    {
+      if(fds[2] >= 0)
+        dprintf(fds[2], "tsh: %s: %s\n", cwd, strerror(errno));
+      ReplyJob(conn, 1, NULL);
+      close(conn);
+      if(savedCwd >= 0)
+        close(savedCwd);
+      return;
+    }
+  }
+
+  names = malloc(sizeof(char*) * (nenv + 1));
+  saved = malloc(sizeof(char*) * (nenv + 1));
+  for(i = 0, p = env; i < nenv; i++, p += strlen(p) + 1)
+  {
+    eq = strchr(p, '=');
+    names[i] = eq != NULL ? strndup(p, eq - p) : strdup(p);
+    saved[i] = getenv(names[i]) != NULL ? strdup(getenv(names[i])) : NULL;
+    if(eq != NULL)
+      setenv(names[i], eq + 1, 1);
+    else
+      unsetenv(names[i]);
+  }
+
+  fflush(stdout);
+  fflush(stderr);
+  for(i = 0; i < SERVE_MAXFDS; i++)
+  {
+    savedFds[i] = fcntl(i, F_DUPFD_CLOEXEC, 10);
+    if(fds[i] < 0 && devNull < 0)
+      devNull = open("/dev/null", O_RDWR | O_CLOEXEC);
+    dup2(fds[i] >= 0 ? fds[i] : devNull, i);
+  }
+
+  cmd = CreateCmdT(argc);
+  cmd->cmdline = malloc(linelen);
+  cmd->cmdline[0] = '\0';
+  for(i = 0, p = args; i < argc; i++, p += strlen(p) + 1)
+  {
+    cmd->argv[i] = strdup(p);
+    if(i > 0)
+      strcat(cmd->cmdline, " ");
+    strcat(cmd->cmdline, p);
+  }
+  cmd->bg = 1;
+  jobReply = conn;
+  RunCmd(&cmd, 1);
+  if(jobReply >= 0)
+  {
+    ReplyJob(conn, lastStatus, NULL);
+    close(conn);
+    jobReply = -1;
+  }
+
+  //back to the shell's own
+  fflush(stdout);
+  fflush(stderr);
+  for(i = 0; i < SERVE_MAXFDS; i++)
+  {
+    dup2(savedFds[i], i);
+    close(savedFds[i]);
+  }
+  if(devNull >= 0)
+    close(devNull);
+  for(i = nenv - 1; i >= 0; i--)
+  {
+    if(saved[i] != NULL)
+      setenv(names[i], saved[i], 1);
+    else
+      unsetenv(names[i]);
+    free(names[i]);
+    free(saved[i]);
+  }
+  free(names);
+  free(saved);
+  if(savedCwd >= 0)
+  {
+    if(fchdir(savedCwd) < 0)
+      PrintPError("fchdir");
+    close(savedCwd);
+  }
+}
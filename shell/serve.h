@@ -0,0 +1,81 @@
+/***************************************************************************
+ *  Title: Command server
+ * -------------------------------------------------------------------------
+ *    Purpose: tsh --serve PATH runs commands for other programs sent
+ *    over a unix socket, so they do not pay for starting a shell each
+ *    time
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: serve.h
+ ***************************************************************************/
+
+#ifndef __SERVE_H__
+#define __SERVE_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+#include <sys/resource.h>
+
+/************Private include**********************************************/
+#include "runtime.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __SERVE_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/* what a client gets back on its connection when its command ends */
+typedef struct serve_reply_s {
+  /* the exit status, 128 + the signal for a killed command */
+  int status;
+  /* what the processes of the command used */
+  struct rusage usage;
+} serveReplyT;
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Runs the command server
+ * ---------------------------------------------------------------------
+ *    Purpose: Listens on a SOCK_SEQPACKET unix socket. A client
+ *    connects and sends one message of NUL terminated strings: the
+ *    directory to run in ("" for the shell's), the environment changes
+ *    (NAME=value sets, NAME alone unsets) ended by an empty string, and
+ *    the argv. Up to three fds passed along with SCM_RIGHTS become
+ *    stdin, stdout and stderr of the command, missing ones /dev/null.
+ *    The command runs as a background job like any other, and the
+ *    client gets a serveReplyT when it ends. The socket is created
+ *    0600, and a client of another user is hung up on.
+ *    Input: the path of the socket
+ *    Output: the exit status of the shell
+ ***********************************************************************/
+EXTERN int Serve(char*);
+
+/***********************************************************************
+ *  Title: Replies to a request
+ * ---------------------------------------------------------------------
+ *    Purpose: Sends how the command of a request ended to its client.
+ *    Input: the connection, the exit status and the resource usage
+ *    (NULL for none)
+ *    Output: void
+ ***********************************************************************/
+EXTERN void ReplyJob(int, int, struct rusage*);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __SERVE_H__ */
@@ -0,0 +1,242 @@
+/***************************************************************************
+ *  Title: Statistics
+ * -------------------------------------------------------------------------
+ *    Purpose: Counters and histograms of what the shell does. Recording
+ *    is an increment or a clock read, everything else happens when the
+ *    statistics are shown or written out.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: stats.c
+ ***************************************************************************/
+#define __STATS_IMPL__
+
+/************System include***********************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "event.h"
+#include "stats.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* how often stats -w writes out unless told, in seconds */
+#define STATS_PERIOD 10
+
+/* buckets of a histogram, without the +Inf one */
+#define NBUCKETS 8
+
+/* a counter of statsT */
+typedef struct counter_s {
+  char* name;
+  char* help;
+  unsigned long* value;
+} counterT;
+
+typedef struct histogram_s {
+  char* name;
+  char* help;
+  /* upper bounds of the buckets in seconds */
+  double le[NBUCKETS];
+  /* observations per bucket, the last one is +Inf */
+  unsigned long counts[NBUCKETS + 1];
+  double sum;
+  unsigned long count;
+} histogramT;
+
+/************Global Variables*********************************************/
+
+static counterT counters[] = {
+  { "tsh_commands_total",           "Commands run.",                                   &stats.commands     },
+  { "tsh_forks_total",              "Processes forked.",                               &stats.forks        },
+  { "tsh_exec_failures_total",      "Commands not found or that could not be executed.", &stats.execFailures },
+  { "tsh_path_cache_hits_total",    "Commands found in the PATH cache.",               &stats.pathHits     },
+  { "tsh_path_cache_misses_total",  "Commands looked up on PATH.",                     &stats.pathMisses   },
+  { "tsh_shebang_cache_hits_total", "Executables whose #! line was known.",            &stats.shebangHits  },
+  { "tsh_shebang_cache_misses_total", "Executables read for a #! line.",               &stats.shebangMisses },
+  { "tsh_jobs_started_total",       "Jobs started.",                                   &stats.jobsStarted  },
+  { "tsh_jobs_stopped_total",       "Times a job was stopped.",                        &stats.jobsStopped  },
+  { "tsh_jobs_killed_total",        "Jobs ended by a signal.",                         &stats.jobsKilled   },
+  { "tsh_cache_hits_total",         "Commands replayed from the cache.",               &stats.cacheHits    },
+  { "tsh_cache_misses_total",       "Cached commands that had to run.",                &stats.cacheMisses  },
+};
+
+#define NCOUNTERS (sizeof counters / sizeof(counterT))
+
+/* indexed by STATS_ */
+static histogramT histograms[NHISTOGRAMS] = {
+  { "tsh_launch_latency_seconds", "Time the shell took to start a process.",
+    { 0.00005, 0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.01, 0.1 } },
+  { "tsh_job_duration_seconds",   "Time from the start of a job to its end.",
+    { 0.01, 0.1, 0.5, 1, 5, 30, 300, 3600 } },
+};
+
+/* where stats -w writes to, NULL if it is off */
+static char* dumpPath = NULL;
+
+/************Function Prototypes******************************************/
+/* formats everything in Prometheus text format */
+static char* FormatStats(size_t*);
+/* writes the text to a file or a unix socket */
+static bool WriteStats(char*);
+
+/************External Declaration*****************************************/
+
+/**************Implementation***********************************************/
+
+void RecordSince(int which, struct timespec* start)
+{
+  histogramT* h = &histograms[which];
+  struct timespec now;
+  double secs;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  secs = (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+  for(i = 0; i < NBUCKETS && secs > h->le[i]; i++)
+    ;
+  h->counts[i]++;
+  h->sum += secs;
+  h->count++;
+}
+
+void DumpStats()
+{
+  if(dumpPath != NULL)
+    WriteStats(dumpPath);
+}
+
+int RunStats(commandT* cmd)
+{
+  char* text;
+  size_t len;
+  int period = STATS_PERIOD;
+
+  if(cmd->argc == 1)
+  {
+    text = FormatStats(&len);
+    fflush(stdout);
+    fwrite(text, 1, len, stdout);
+    fflush(stdout);
+    free(text);
+    return 0;
+  }
+  if(strcmp(cmd->argv[1], "-w") != 0 || cmd->argc < 3 || cmd->argc > 4)
+  {
+    fprintf(stderr, "stats: usage: stats [-w PATH [SECONDS] | -w off]\n");
+    return 1;
+  }
+  if(strcmp(cmd->argv[2], "off") == 0)
+  {
+    SetEventTimer(0);
+    free(dumpPath);
+    dumpPath = NULL;
+    return 0;
+  }
+  if(cmd->argc == 4 && (period = atoi(cmd->argv[3])) <= 0)
+  {
+    fprintf(stderr, "stats: invalid period '%s'\n", cmd->argv[3]);
+    return 1;
+  }
+  //write once now, so a wrong path shows up right away
+  if(!WriteStats(cmd->argv[2]))
+  {
+    fprintf(stderr, "stats: cannot write to %s: %s\n", cmd->argv[2], strerror(errno));
+    return 1;
+  }
+  free(dumpPath);
+  dumpPath = strdup(cmd->argv[2]);
+  SetEventTimer(period);
+  return 0;
+}
+
+static char* FormatStats(size_t* len)
+{
+  histogramT* h;
+  unsigned long total;
+  char* text = NULL;
+  FILE* out = open_memstream(&text, len);
+  int i, j;
+
+  for(i = 0; i < NCOUNTERS; i++)
+  {
+    fprintf(out, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n",
+            counters[i].name, counters[i].help, counters[i].name, counters[i].name, *counters[i].value);
+  }
+  for(i = 0; i < NHISTOGRAMS; i++)
+  {
+    h = &histograms[i];
+    fprintf(out, "# HELP %s %s\n# TYPE %s histogram\n", h->name, h->help, h->name);
+    //the buckets of the format count everything up to their bound
+    for(j = 0, total = 0; j < NBUCKETS; j++)
+    {
+      total += h->counts[j];
+      fprintf(out, "%s_bucket{le=\"%g\"} %lu\n", h->name, h->le[j], total);
+    }
+    fprintf(out, "%s_bucket{le=\"+Inf\"} %lu\n%s_sum %.9g\n%s_count %lu\n",
+            h->name, h->count, h->name, h->sum, h->name, h->count);
+  }
+  fclose(out);
+  return text;
+}
+
+/*A socket gets the text on a new connection, a file is replaced at once
+ *so a reader never sees half of it*/
+static bool WriteStats(char* path)
+{
+  struct sockaddr_un addr;
+  struct stat st;
+  char tmp[PATH_MAX];
+  char* text;
+  size_t len, done = 0;
+  ssize_t n;
+  int fd;
+  bool ok;
+
+  text = FormatStats(&len);
+  if(stat(path, &st) == 0 && S_ISSOCK(st.st_mode))
+  {
+    if(strlen(path) >= sizeof(addr.sun_path) || (fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0)) < 0)
+    {
+      free(text);
+      return FALSE;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    //never block the shell on a slow reader, it gets the next round
+    ok = connect(fd, (struct sockaddr*) &addr, sizeof(addr)) == 0;
+    while(ok && done < len && (n = write(fd, text + done, len - done)) > 0)
+      done += n;
+    ok = ok && done == len;
+  }
+  else
+  {
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0)
+    {
+      free(text);
+      return FALSE;
+    }
+    while(done < len && (n = write(fd, text + done, len - done)) > 0)
+      done += n;
+    ok = done == len && rename(tmp, path) == 0;
+    if(!ok)
+      unlink(tmp);
+  }
+  close(fd);
+  free(text);
+  return ok;
+}
@@ -0,0 +1,104 @@
+/***************************************************************************
+ *  Title: Statistics
+ * -------------------------------------------------------------------------
+ *    Purpose: Counters and histograms of what the shell does, shown by
+ *    the stats builtin and written out in Prometheus text format
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: stats.h
+ ***************************************************************************/
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+#include <time.h>
+
+/************Private include**********************************************/
+#include "runtime.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __STATS_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/* the shell has a single thread, recording is a plain increment */
+typedef struct stats_s {
+  unsigned long commands;
+  unsigned long forks;
+  /* commands not found or whose exec failed (exit status 126) */
+  unsigned long execFailures;
+  unsigned long pathHits;
+  unsigned long pathMisses;
+  /* executables whose #! line was known, or had to be read */
+  unsigned long shebangHits;
+  unsigned long shebangMisses;
+  unsigned long jobsStarted;
+  unsigned long jobsStopped;
+  /* jobs whose last process was ended by a signal */
+  unsigned long jobsKilled;
+  /* cache builtin lookups */
+  unsigned long cacheHits;
+  unsigned long cacheMisses;
+} statsT;
+
+/* histograms of STATS_ */
+#define STATS_LAUNCH 0
+#define STATS_JOB    1
+#define NHISTOGRAMS  2
+
+/************Global Variables*********************************************/
+
+EXTERN statsT stats;
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Records a duration
+ * ---------------------------------------------------------------------
+ *    Purpose: Adds the time since a start taken with CLOCK_MONOTONIC
+ *    to a histogram: STATS_LAUNCH for how long starting a process took
+ *    the shell, STATS_JOB for how long a job ran.
+ *    Input: the histogram and the start
+ *    Output: void
+ ***********************************************************************/
+EXTERN void RecordSince(int, struct timespec*);
+
+/***********************************************************************
+ *  Title: Writes out the statistics
+ * ---------------------------------------------------------------------
+ *    Purpose: Writes everything to the file or unix socket set with
+ *    stats -w, called by the event loop every period.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void DumpStats();
+
+/***********************************************************************
+ *  Title: Runs the stats builtin
+ * ---------------------------------------------------------------------
+ *    Purpose: Prints the statistics in Prometheus text format, or with
+ *    -w PATH [SECONDS] writes them to PATH every period (-w off stops).
+ *    PATH may be a file, replaced at once, or a listening unix socket.
+ *    Input: a command structure
+ *    Output: the exit status
+ ***********************************************************************/
+EXTERN int RunStats(commandT*);
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __STATS_H__ */
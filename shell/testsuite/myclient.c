@@ -0,0 +1,86 @@
+/*
+ * myclient.c - A client for testing tsh --serve
+ *
+ * usage: myclient <socket> <command> [args]
+ * Asks the shell serving on <socket> to run the command with this
+ * program's stdin, stdout and stderr, and prints the exit status the
+ * shell replies with.
+ *
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+
+/* the reply of the shell, laid out like its serveReplyT */
+struct reply {
+    int status;
+    struct rusage usage;
+};
+
+int main(int argc, char **argv)
+{
+    int i, fd, fds[3] = { 0, 1, 2 };
+    char buf[4096], ctl[CMSG_SPACE(sizeof(fds))];
+    size_t len = 0;
+    struct sockaddr_un addr;
+    struct iovec iov;
+    struct msghdr msg;
+    struct cmsghdr *c;
+    struct reply reply;
+
+    if (argc < 3) {
+	fprintf(stderr, "Usage: %s <socket> <command> [args]\n", argv[0]);
+	exit(0);
+    }
+
+    /* the shell's directory, no environment changes, then the argv */
+    buf[len++] = '\0';
+    buf[len++] = '\0';
+    for (i = 2; i < argc; i++) {
+	if (len + strlen(argv[i]) + 1 > sizeof(buf)) {
+	    fprintf(stderr, "request too long\n");
+	    exit(1);
+	}
+	strcpy(buf + len, argv[i]);
+	len += strlen(argv[i]) + 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, argv[1], sizeof(addr.sun_path) - 1);
+    if ((fd = socket(AF_UNIX, SOCK_SEQPACKET, 0)) < 0
+	|| connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+	perror(argv[1]);
+	exit(1);
+    }
+
+    /* stdin, stdout and stderr go along with the request */
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctl;
+    msg.msg_controllen = sizeof(ctl);
+    c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(c), fds, sizeof(fds));
+    if (sendmsg(fd, &msg, 0) < 0) {
+	perror("sendmsg");
+	exit(1);
+    }
+
+    if (recv(fd, &reply, sizeof(reply), 0) != sizeof(reply)) {
+	fprintf(stderr, "no reply\n");
+	exit(1);
+    }
+    printf("status %d\n", reply.status);
+    exit(0);
+}
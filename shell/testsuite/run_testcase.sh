@@ -51,6 +51,7 @@ sh ${TC_DIR}/setup.sh;
 cp ${TC_DIR}/${SDRIVER} .;
 cp ${TC_DIR}/${ORIG}.${SHELL_ARCH} .;
 gcc ${TC_DIR}/myspin.c -o myspin
+gcc ${TC_DIR}/myclient.c -o myclient
 
 # Compile the code
 echo "COMPILE"
@@ -44,6 +44,10 @@
 #include "io.h"
 #include "interpreter.h"
 #include "runtime.h"
+#include "launch.h"
+#include "event.h"
+#include "serve.h"
+#include "zygote.h"
 
 /************Defines and Typedefs*****************************************/
 /*  #defines and typedefs should have their names in all caps.
@@ -57,8 +61,6 @@
 /************Global Variables*********************************************/
 
 /************Function Prototypes******************************************/
-/* handles SIGINT and SIGSTOP signals */	
-static void sig(int);
 
 /************External Declaration*****************************************/
 
@@ -69,15 +71,31 @@ int main (int argc, char *argv[])
   /* Initialize command buffer */
   char* cmdLine = malloc(sizeof(char*)*BUFSIZE);
 
-  /* shell initialization */
-  if (signal(SIGINT, sig) == SIG_ERR) PrintPError("SIGINT");
-  if (signal(SIGTSTP, sig) == SIG_ERR) PrintPError("SIGTSTP");
-  if (signal(SIGCHLD, sig) == SIG_ERR) PrintPError("SIGCHLD");
+  /* shell initialization, ctrl+c, ctrl+z and ended children come
+   * through the event loop */
+  InitEvents();
+  /* builtins write into pipes from the shell, a gone reader must not kill it */
+  if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) PrintPError("SIGPIPE");
+  /* commands are started from a copy of the shell taken while it is small */
+  StartZygote();
+
+  /* tsh --serve PATH takes commands from a socket instead of stdin */
+  if (argc == 3 && strcmp(argv[1], "--serve") == 0)
+  {
+    forceExit = Serve(argv[2]);
+    CleanupLaunch();
+    free(cmdLine);
+    return forceExit;
+  }
 
   while (!forceExit) /* repeat forever */
   {
-    /* read command line */
-    getCommandLine(&cmdLine, BUFSIZE);
+    /* read command line, the end of the input ends the shell */
+    if(!getCommandLine(&cmdLine, BUFSIZE))
+    {
+      forceExit=TRUE;
+      continue;
+    }
 
     if(strcmp(cmdLine, "exit") == 0)
     {
@@ -95,23 +113,8 @@ int main (int argc, char *argv[])
   }
 
   /* shell termination */
+  CleanupLaunch();
   free(cmdLine);
   return 0;
 } /* end main */
 
-static void sig(int signo)
-{
-  //if is a sigint (ctrl + c)
-  if(signo == SIGINT)
-  {
-    //kill foreground job
-    KillJob();
-  }
-  //if is a sigtstp (ctrl + z)
-  else if(signo == SIGTSTP)
-  {
-    //Stop the current foreground job
-    StopJob();
-  }
-}
-
@@ -0,0 +1,320 @@
+/***************************************************************************
+ *  Title: Zygote
+ * -------------------------------------------------------------------------
+ *    Purpose: Starts commands from a helper forked when the shell was
+ *    small. Its children are cloned with CLONE_PARENT, so they are the
+ *    shell's own: the shell gets their SIGCHLD, waits for them through
+ *    pidfds and controls their process groups like those it forks.
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: zygote.c
+ ***************************************************************************/
+#define __ZYGOTE_IMPL__
+#define _GNU_SOURCE
+
+/************System include***********************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/************Private include**********************************************/
+#include "io.h"
+#include "zygote.h"
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+/* the largest request, a launch with a bigger environment is forked by
+ * the shell */
+#define ZYGOTE_MAXREQ 131072
+
+/* a launch, followed by the path, the command line, the argv and the
+ * environment as NUL terminated strings */
+typedef struct zygote_req_s {
+  pid_t pgid;
+  int argc;
+  int envc;
+  int nfds;
+  int targets[ZYGOTE_MAXFDS];
+} zygoteReqT;
+
+/* what the zygote answers */
+typedef struct zygote_reply_s {
+  pid_t pid;
+  int error;
+} zygoteReplyT;
+
+/************Global Variables*********************************************/
+
+/* the shell's end of the socketpair, -1 without a zygote */
+static int zygoteFd = -1;
+static pid_t zygotePid = -1;
+/* the shell the zygote clones children for */
+static pid_t zygoteOwner = -1;
+
+/************Function Prototypes******************************************/
+/* the loop of the zygote, never returns */
+static void RunZygote(int);
+/* launches one request in the zygote */
+static void ZygoteLaunch(int, zygoteReqT*, char*, int*, int);
+/* runs in the cloned child, never returns */
+static void ZygoteChild(zygoteReqT*, char*, char*, char**, char**, int*);
+/* gives up on a zygote that stopped answering */
+static void StopZygote();
+
+/************External Declaration*****************************************/
+extern char** environ;
+
+/**************Implementation***********************************************/
+
+void StartZygote()
+{
+  int sv[2];
+  pid_t pid;
+
+  if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+    return;
+  pid = fork();
+  if(pid == 0)
+  {
+    close(sv[0]);
+    RunZygote(sv[1]);
+  }
+  close(sv[1]);
+  if(pid < 0)
+  {
+    close(sv[0]);
+    return;
+  }
+  zygoteFd = sv[0];
+  zygotePid = pid;
+  zygoteOwner = getpid();
+}
+
+pid_t ZygoteSpawn(char* path, char* cmdline, char** argv, pid_t pgid, int* fds, int* targets, int nfds)
+{
+  static char buf[sizeof(zygoteReqT) + ZYGOTE_MAXREQ];
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAXFDS)];
+    struct cmsghdr align;
+  } control;
+  zygoteReqT* req = (zygoteReqT*) buf;
+  zygoteReplyT reply;
+  struct iovec iov;
+  struct msghdr msg;
+  struct cmsghdr* c;
+  char* p = buf + sizeof(zygoteReqT);
+  char* end = buf + sizeof(buf);
+  size_t len;
+  int i;
+
+  //a forked copy of the shell cannot have the shell's children
+  if(zygoteFd < 0 || nfds > ZYGOTE_MAXFDS || getpid() != zygoteOwner)
+    return -1;
+  memset(req, 0, sizeof(zygoteReqT));
+  req->pgid = pgid;
+  req->nfds = nfds;
+  memcpy(req->targets, targets, sizeof(int) * nfds);
+  for(req->argc = 0; argv[req->argc] != NULL; req->argc++)
+    ;
+  for(req->envc = 0; environ[req->envc] != NULL; req->envc++)
+    ;
+  //everything goes in one message, or the shell forks itself
+  for(i = -2; i < req->argc + req->envc; i++)
+  {
+    char* s = i == -2 ? path : i == -1 ? cmdline : i < req->argc ? argv[i] : environ[i - req->argc];
+    len = strlen(s) + 1;
+    if(len > (size_t) (end - p))
+      return -1;
+    memcpy(p, s, len);
+    p += len;
+  }
+
+  iov.iov_base = buf;
+  iov.iov_len = p - buf;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * nfds);
+  c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(sizeof(int) * nfds);
+  memcpy(CMSG_DATA(c), fds, sizeof(int) * nfds);
+
+  if(sendmsg(zygoteFd, &msg, MSG_NOSIGNAL) < 0)
+  {
+    //a bad fd is the command's problem, the fork shows the error
+    if(errno != EBADF && errno != EMSGSIZE)
+      StopZygote();
+    return -1;
+  }
+  if(recv(zygoteFd, &reply, sizeof(reply), 0) != sizeof(reply))
+  {
+    StopZygote();
+    return -1;
+  }
+  if(reply.pid < 0)
+    errno = reply.error;
+  return reply.pid;
+}
+
+void ForgetZygote()
+{
+  if(zygoteFd >= 0)
+    close(zygoteFd);
+  zygoteFd = -1;
+  zygotePid = -1;
+}
+
+static void StopZygote()
+{
+  close(zygoteFd);
+  zygoteFd = -1;
+  kill(zygotePid, SIGKILL);
+  waitpid(zygotePid, NULL, 0);
+  zygotePid = -1;
+}
+
+/*The zygote sits in a group of its own, out of the way of ctrl+c, and
+ *keeps nothing of the shell's but the socket. The end of it is the end
+ *of the shell.*/
+static void RunZygote(int sock)
+{
+  static char buf[sizeof(zygoteReqT) + ZYGOTE_MAXREQ];
+  union {
+    char buf[CMSG_SPACE(sizeof(int) * ZYGOTE_MAXFDS)];
+    struct cmsghdr align;
+  } control;
+  struct iovec iov = { buf, sizeof(buf) };
+  struct msghdr msg;
+  struct cmsghdr* c;
+  int fds[ZYGOTE_MAXFDS];
+  int nfds, devNull, i;
+  ssize_t len;
+
+  setpgid(0, 0);
+  if((devNull = open("/dev/null", O_RDWR)) >= 0)
+  {
+    for(i = 0; i < 3; i++)
+      dup2(devNull, i);
+  }
+  if(sock > 3)
+    close_range(3, sock - 1, 0);
+  close_range(sock + 1, ~0U, 0);
+
+  while(1)
+  {
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+    len = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    if(len < 0 && errno == EINTR)
+      continue;
+    if(len <= 0)
+      _exit(0);
+
+    nfds = 0;
+    for(c = CMSG_FIRSTHDR(&msg); c != NULL; c = CMSG_NXTHDR(&msg, c))
+    {
+      if(c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS)
+        continue;
+      for(i = 0; i < (c->cmsg_len - CMSG_LEN(0)) / sizeof(int); i++)
+      {
+        if(nfds < ZYGOTE_MAXFDS)
+          memcpy(&fds[nfds++], CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+      }
+    }
+    //the shell wrote the request, only the fds can have gone missing
+    if(len > sizeof(zygoteReqT))
+      ZygoteLaunch(sock, (zygoteReqT*) buf, buf + sizeof(zygoteReqT), fds, nfds);
+    for(i = 0; i < nfds; i++)
+      close(fds[i]);
+  }
+}
+
+static void ZygoteLaunch(int sock, zygoteReqT* req, char* strings, int* fds, int nfds)
+{
+  zygoteReplyT reply = { -1, EINVAL };
+  char **argv, **env;
+  char *p = strings, *path, *cmdline;
+  int i;
+
+  argv = malloc(sizeof(char*) * (req->argc + 1));
+  env = malloc(sizeof(char*) * (req->envc + 1));
+  path = p;
+  p += strlen(p) + 1;
+  cmdline = p;
+  p += strlen(p) + 1;
+  for(i = 0; i < req->argc + req->envc; i++, p += strlen(p) + 1)
+  {
+    if(i < req->argc)
+      argv[i] = p;
+    else
+      env[i - req->argc] = p;
+  }
+  argv[req->argc] = NULL;
+  env[req->envc] = NULL;
+
+  if(nfds == req->nfds)
+  {
+    reply.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL, NULL, NULL);
+    if(reply.pid == 0)
+      ZygoteChild(req, path, cmdline, argv, env, fds);
+    reply.error = reply.pid < 0 ? errno : 0;
+  }
+  send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+  free(argv);
+  free(env);
+}
+
+/*Does what the forked child of the shell does for a command without
+ *limits*/
+static void ZygoteChild(zygoteReqT* req, char* path, char* cmdline, char** argv, char** env, int* fds)
+{
+  sigset_t none;
+  int base = 3, i;
+
+  setpgid(0, req->pgid);
+  signal(SIGPIPE, SIG_DFL);
+  sigemptyset(&none);
+  sigprocmask(SIG_SETMASK, &none, NULL);
+
+  //move the fds above every target first, so none is put over another
+  for(i = 0; i < req->nfds; i++)
+    if(req->targets[i] >= base)
+      base = req->targets[i] + 1;
+  for(i = 0; i < req->nfds; i++)
+    fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, base);
+  for(i = 0; i < req->nfds; i++)
+  {
+    if(req->targets[i] == ZYGOTE_CWD)
+    {
+      if(fchdir(fds[i]) < 0)
+        PrintPError("fchdir");
+    }
+    else
+      dup2(fds[i], req->targets[i]);
+  }
+
+  execve(path, argv, env);
+
+  //this should only display if the execution fails
+  fprintf(stdout, "Error executing child command: %s\n", cmdline);
+  fflush(stdout);
+  _exit(126);
+}
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *  Title: Zygote
+ * -------------------------------------------------------------------------
+ *    Purpose: A helper forked when the shell starts, while it is still
+ *    small, that starts commands for it, so a launch does not copy
+ *    whatever the shell has grown to since
+ *    Author: Zachary Austin, Yifan Guo
+ *    File: zygote.h
+ ***************************************************************************/
+
+#ifndef __ZYGOTE_H__
+#define __ZYGOTE_H__
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+/************System include***********************************************/
+#include <sys/types.h>
+
+/************Private include**********************************************/
+
+/************Defines and Typedefs*****************************************/
+/*  #defines and typedefs should have their names in all caps.
+ *  Global variables begin with g. Global constants with k. Local
+ *  variables should be in all lower case. When initializing
+ *  structures and arrays, line everything up in neat columns.
+ */
+
+#undef EXTERN
+#ifdef __ZYGOTE_IMPL__
+#define EXTERN
+#else
+#define EXTERN extern
+#endif
+
+/* fds a launch can hand over: stdin, stdout, stderr, the directory and
+ * the pipes of process substitutions */
+#define ZYGOTE_MAXFDS 32
+
+/* the target of the fd the command changes into */
+#define ZYGOTE_CWD -1
+
+/************Global Variables*********************************************/
+
+/************Function Prototypes******************************************/
+
+/***********************************************************************
+ *  Title: Starts the zygote
+ * ---------------------------------------------------------------------
+ *    Purpose: Forks the helper and keeps one end of a socketpair to
+ *    it. Without it, commands are forked by the shell as before.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void StartZygote();
+
+/***********************************************************************
+ *  Title: Launches a command through the zygote
+ * ---------------------------------------------------------------------
+ *    Purpose: Sends the path, argv, the environment of the shell and
+ *    fds to the zygote, which clones with CLONE_PARENT, so the command
+ *    is a child of the shell and is waited for like one it forked.
+ *    The child joins the process group, puts each fd on its target
+ *    (ZYGOTE_CWD to change into it) and execs.
+ *    Input: the path, the command line for errors, the argv, the
+ *    process group (0 for a new one), the fds, their targets and how
+ *    many there are
+ *    Output: the pid, -1 if the zygote could not do it and the shell
+ *    has to fork itself
+ ***********************************************************************/
+EXTERN pid_t ZygoteSpawn(char*, char*, char**, pid_t, int*, int*, int);
+
+/***********************************************************************
+ *  Title: Forgets the zygote
+ * ---------------------------------------------------------------------
+ *    Purpose: Closes the socket in a forked copy of the shell; the
+ *    zygote's children can only be children of the shell it serves.
+ *    Input: void
+ *    Output: void
+ ***********************************************************************/
+EXTERN void ForgetZygote();
+
+/************External Declaration*****************************************/
+
+/**************Definition***************************************************/
+
+#endif /* __ZYGOTE_H__ */